@@ -13,44 +13,6 @@ ApplicationWindow {
     Material.theme: Material.Dark
     Material.accent: Material.Blue
 
-    ListModel { id: logModel }
-    ListModel { id: registersModel }
-    ListModel { id: coilsModel }
-
-
-    // Signals handler
-    Connections {
-        target: app
-        function onLogMessage(message) {
-            logModel.append({
-                time: Qt.formatTime(new Date(), "hh:mm:ss"),
-                text: message
-            })
-        }
-
-        function onRegistersUpdated(startAddress, values) {
-            registersModel.clear()
-
-            for (var i = 0; i < values.length; ++i) {
-                registersModel.append({
-                    address: startAddress + i,
-                    value: values[i]
-                })
-            }
-        }
-
-        function onCoilsUpdated(startAddress, values) {
-            coilsModel.clear()
-
-            for (var i = 0; i < values.length; ++i) {
-                coilsModel.append({
-                    address: startAddress + i,
-                    value: values[i]
-                })
-            }
-        }
-    }
-
     ColumnLayout {
         anchors.fill: parent
         anchors.margins: 10 // отступы со всех сторон по 10 пикселей
@@ -123,10 +85,7 @@ ApplicationWindow {
                                 var unit = parseInt(unitField.text)
 
                                 if (!host || isNaN(port) || isNaN(unit)) {
-                                    logModel.append({
-                                        time: Qt.formatTime(new Date(), "hh:mm:ss"),
-                                        text: "Invalid connection parameters"
-                                    })
+                                    app.log.append("Invalid connection parameters")
                                     return
                                 }
 
@@ -204,10 +163,7 @@ ApplicationWindow {
                                         var qos  = mqttQosField.model[mqttQosField.currentIndex].value
 
                                         if (!host || isNaN(port)) {
-                                            logModel.append({
-                                                time: Qt.formatTime(new Date(), "hh:mm:ss"),
-                                                text: "Invalid MQTT parameters"
-                                            })
+                                            app.log.append("Invalid MQTT parameters")
                                             return
                                         }
 
@@ -276,10 +232,7 @@ ApplicationWindow {
                                     var cnt = parseInt(readCountField.text)
 
                                     if (isNaN(addr) || isNaN(cnt) || cnt <= 0) {
-                                        logModel.append({
-                                            time: Qt.formatTime(new Date(), "hh:mm:ss"),
-                                            text: "Invalid read parameters"
-                                        })
+                                        app.log.append("Invalid read parameters")
                                         return
                                     }
 
@@ -316,10 +269,7 @@ ApplicationWindow {
                                     var val = parseInt(writeValueField.text)
 
                                     if (isNaN(addr) || addr < 0 || isNaN(val)) {
-                                        logModel.append({
-                                            time: Qt.formatTime(new Date(), "hh:mm:ss"),
-                                            text: "Invalid write parameters"
-                                        })
+                                        app.log.append("Invalid write parameters")
                                         return
                                     }
 
@@ -332,8 +282,9 @@ ApplicationWindow {
                     ListView {
                         Layout.fillWidth: true
                         Layout.fillHeight: true
-                        model: registersModel
+                        model: app.registers
                         clip: true
+                        reuseItems: true
                         spacing: 1
 
                         delegate: Row {
@@ -415,10 +366,7 @@ ApplicationWindow {
                                     var cnt = parseInt(readCoilsCountField.text)
 
                                     if (isNaN(addr) || isNaN(cnt) || cnt <= 0) {
-                                        logModel.append({
-                                            time: Qt.formatTime(new Date(), "hh:mm:ss"),
-                                            text: "Invalid coil read parameters"
-                                        })
+                                        app.log.append("Invalid coil read parameters")
                                         return
                                     }
 
@@ -454,10 +402,7 @@ ApplicationWindow {
                                     var val = (writeCoilValueField.currentText === "true")
 
                                     if (isNaN(addr) || addr < 0) {
-                                        logModel.append({
-                                            time: Qt.formatTime(new Date(), "hh:mm:ss"),
-                                            text: "Invalid coil write parameters"
-                                        })
+                                        app.log.append("Invalid coil write parameters")
                                         return
                                     }
 
@@ -471,8 +416,9 @@ ApplicationWindow {
                     ListView {
                         Layout.fillWidth: true
                         Layout.fillHeight: true
-                        model: coilsModel
+                        model: app.coils
                         clip: true
+                        reuseItems: true
                         spacing: 1
 
                         delegate: Row {
@@ -499,7 +445,7 @@ ApplicationWindow {
                                     checked: value
 
                                     onToggled: {
-                                        app.writeSingleCoil(address, checked)
+                                        app.writeCoil(address, checked)
                                     }
                                 }
                             }
@@ -533,7 +479,7 @@ ApplicationWindow {
 
                     Button {
                         text: "Clear"
-                        onClicked: logModel.clear()
+                        onClicked: app.log.clear()
                     }
                 }
 
@@ -541,11 +487,13 @@ ApplicationWindow {
                     id: logView
                     Layout.fillWidth: true
                     Layout.fillHeight: true
-                    model: logModel
+                    model: app.log
                     clip: true
 
                     delegate: Text {
+                        width: ListView.view.width
                         text: model.time + " " + model.text
+                              + (model.count > 1 ? "  (x" + model.count + ")" : "")
                         color: "lightgreen"
                         font.pixelSize: 12
                         wrapMode: Text.Wrap
@@ -556,9 +504,9 @@ ApplicationWindow {
             }
         }
     }
-    // Auto-scroll log
+    // Auto-scroll log (rows arrive in per-frame batches)
     Connections {
-        target: logModel
+        target: app.log
         function onCountChanged() {
             logView.positionViewAtEnd()
         }
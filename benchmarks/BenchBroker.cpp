@@ -0,0 +1,171 @@
+#include "BenchBroker.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+
+namespace {
+
+enum PacketType : quint8 {
+    Connect = 1, ConnAck, Publish, PubAck, PubRec, PubRel, PubComp,
+    Subscribe, SubAck, Unsubscribe, UnsubAck, PingReq, PingResp, Disconnect
+};
+
+quint16 readU16(const QByteArray &data, qsizetype pos)
+{
+    if (pos + 2 > data.size())
+        return 0;
+    return quint16((quint8(data[pos]) << 8) | quint8(data[pos + 1]));
+}
+
+QByteArray ack(quint8 header, quint16 packetId)
+{
+    const char bytes[] = { char(header), 0x02, char(packetId >> 8), char(packetId & 0xFF) };
+    return QByteArray(bytes, sizeof(bytes));
+}
+
+} // namespace
+
+BenchBroker::BenchBroker(PublishHandler handler, QObject *parent)
+    : QObject(parent),
+    m_server(new QTcpServer(this)),
+    m_handler(std::move(handler))
+{
+    connect(m_server, &QTcpServer::newConnection,
+            this, &BenchBroker::onNewConnection);
+}
+
+bool BenchBroker::listen(quint16 port)
+{
+    return m_server->listen(QHostAddress::LocalHost, port);
+}
+
+quint16 BenchBroker::port() const
+{
+    return m_server->serverPort();
+}
+
+void BenchBroker::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection())
+    {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        m_buffers.insert(socket, QByteArray());
+
+        connect(socket, &QTcpSocket::readyRead, this,
+                [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, this,
+                [this, socket]() {
+                    m_buffers.remove(socket);
+                    socket->deleteLater();
+                });
+    }
+}
+
+void BenchBroker::onReadyRead(QTcpSocket *socket)
+{
+    QByteArray &buffer = m_buffers[socket];
+    buffer += socket->readAll();
+
+    qsizetype pos = 0;
+    for (;;)
+    {
+        if (buffer.size() - pos < 2)
+            break;
+
+        // Fixed header: type/flags byte + variable length "remaining length"
+        const quint8 header = quint8(buffer[pos]);
+        quint32 length = 0;
+        quint32 multiplier = 1;
+        qsizetype p = pos + 1;
+        bool complete = false;
+
+        for (int i = 0; i < 4 && p < buffer.size(); ++i) {
+            const quint8 byte = quint8(buffer[p++]);
+            length += (byte & 0x7F) * multiplier;
+            multiplier *= 128;
+            if (!(byte & 0x80)) {
+                complete = true;
+                break;
+            }
+        }
+
+        if (!complete || buffer.size() - p < qsizetype(length))
+            break;
+
+        handlePacket(socket, header,
+                     QByteArray::fromRawData(buffer.constData() + p, length));
+        pos = p + length;
+    }
+
+    buffer.remove(0, pos);
+}
+
+void BenchBroker::handlePacket(QTcpSocket *socket, quint8 header, const QByteArray &body)
+{
+    switch (header >> 4)
+    {
+    case Connect: {
+        const char connAck[] = { char(ConnAck << 4), 0x02, 0x00, 0x00 };
+        socket->write(connAck, sizeof(connAck));
+        break;
+    }
+
+    case Publish: {
+        const int qos = (header >> 1) & 0x03;
+        const quint16 topicLength = readU16(body, 0);
+        qsizetype pos = 2 + topicLength;
+
+        quint16 packetId = 0;
+        if (qos > 0) {
+            packetId = readU16(body, pos);
+            pos += 2;
+        }
+
+        if (m_handler)
+            m_handler(body.mid(2, topicLength), body.mid(pos));
+
+        if (qos == 1)
+            socket->write(ack(PubAck << 4, packetId));
+        else if (qos == 2)
+            socket->write(ack(PubRec << 4, packetId));
+        break;
+    }
+
+    case PubRel:
+        socket->write(ack(PubComp << 4, readU16(body, 0)));
+        break;
+
+    case Subscribe: {
+        // Grant every filter the requested QoS
+        QByteArray reply;
+        reply.append(char(readU16(body, 0) >> 8)).append(char(readU16(body, 0) & 0xFF));
+        qsizetype pos = 2;
+        while (pos + 2 < body.size()) {
+            pos += 2 + readU16(body, pos);
+            if (pos >= body.size())
+                break;
+            reply.append(char(body[pos++] & 0x03));
+        }
+        socket->write(QByteArray(1, char(SubAck << 4)) + char(reply.size()) + reply);
+        break;
+    }
+
+    case Unsubscribe:
+        socket->write(ack(UnsubAck << 4, readU16(body, 0)));
+        break;
+
+    case PingReq: {
+        const char pingResp[] = { char(PingResp << 4), 0x00 };
+        socket->write(pingResp, sizeof(pingResp));
+        break;
+    }
+
+    case Disconnect:
+        socket->disconnectFromHost();
+        break;
+
+    default:
+        break;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef __BENCHBROKER_H__
+#define __BENCHBROKER_H__
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+
+#include <functional>
+
+class QTcpServer;
+class QTcpSocket;
+
+// Minimal MQTT 3.1.1 broker stand-in for benchmarks on loopback.
+// Accepts any CONNECT, acknowledges PUBLISH for QoS 0/1/2, answers
+// SUBSCRIBE/UNSUBSCRIBE/PINGREQ. Nothing is routed to subscribers;
+// every PUBLISH is handed to the handler on the broker's thread.
+class BenchBroker : public QObject
+{
+    Q_OBJECT
+
+public:
+    using PublishHandler = std::function<void(const QByteArray &topic,
+                                              const QByteArray &payload)>;
+
+    explicit BenchBroker(PublishHandler handler, QObject *parent = nullptr);
+
+    bool listen(quint16 port);
+    quint16 port() const;
+
+private:
+    void onNewConnection();
+    void onReadyRead(QTcpSocket *socket);
+    void handlePacket(QTcpSocket *socket, quint8 header, const QByteArray &body);
+
+    QTcpServer *m_server = nullptr;
+    QHash<QTcpSocket *, QByteArray> m_buffers;   // partial packets per client
+    PublishHandler m_handler;
+};
+
+#endif // __BENCHBROKER_H__
@@ -0,0 +1,60 @@
+#include "BenchModbusServer.h"
+
+#include <chrono>
+
+BenchModbusServer::BenchModbusServer(int registers, int blockSize, QObject *parent)
+    : QModbusTcpServer(parent),
+    m_blockSize(qMax(2, blockSize)),
+    m_stamps(new std::atomic<qint64>[StampSlots]())
+{
+    QModbusDataUnitMap map;
+    map.insert(QModbusDataUnit::HoldingRegisters,
+               QModbusDataUnit(QModbusDataUnit::HoldingRegisters, 0, quint16(registers)));
+    setMap(map);
+    setServerAddress(1);
+}
+
+bool BenchModbusServer::listen(quint16 port)
+{
+    setConnectionParameter(QModbusDevice::NetworkAddressParameter, "127.0.0.1");
+    setConnectionParameter(QModbusDevice::NetworkPortParameter, port);
+    return connectDevice() && state() == QModbusDevice::ConnectedState;
+}
+
+qint64 BenchModbusServer::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+qint64 BenchModbusServer::stampOf(quint32 seq) const
+{
+    return m_stamps[seq & (StampSlots - 1)].load(std::memory_order_acquire);
+}
+
+QModbusResponse BenchModbusServer::processRequest(const QModbusPdu &request)
+{
+    if (request.functionCode() == QModbusPdu::ReadHoldingRegisters) {
+        quint16 start = 0, count = 0;
+        request.decodeData(&start, &count);
+
+        const qint64 now = nowNs();
+        const int first = (start + m_blockSize - 1) / m_blockSize * m_blockSize;
+
+        for (int block = first; block + 1 < start + count; block += m_blockSize) {
+            const quint32 seq = ++m_seq;
+            m_stamps[seq & (StampSlots - 1)].store(now, std::memory_order_release);
+
+            setData(QModbusDataUnit::HoldingRegisters, quint16(block), quint16(seq & 0xFFFF));
+            setData(QModbusDataUnit::HoldingRegisters, quint16(block + 1), quint16(seq >> 16));
+
+            // Payload registers change on every read so nothing is filtered
+            for (int i = 2; i < m_blockSize && block + i < start + count; ++i)
+                setData(QModbusDataUnit::HoldingRegisters, quint16(block + i),
+                        quint16(seq * 7 + i));
+        }
+        m_replies.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return QModbusTcpServer::processRequest(request);
+}
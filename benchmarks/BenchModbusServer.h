@@ -0,0 +1,38 @@
+#ifndef __BENCHMODBUSSERVER_H__
+#define __BENCHMODBUSSERVER_H__
+
+#include <QModbusTcpServer>
+
+#include <atomic>
+#include <memory>
+
+// In-process Modbus TCP server with a synthetic holding register map.
+// Registers are grouped in blocks of blockSize; on every read the first two
+// registers of each block touched get a fresh 32-bit sequence number and the
+// reply time is remembered, so the receiver can compute end-to-end latency.
+class BenchModbusServer : public QModbusTcpServer
+{
+public:
+    static constexpr quint32 StampSlots = 1u << 20;
+
+    BenchModbusServer(int registers, int blockSize, QObject *parent = nullptr);
+
+    bool listen(quint16 port);
+
+    // Reply time of a sequence number (steady clock, ns), 0 if unknown
+    qint64 stampOf(quint32 seq) const;
+    quint64 replies() const { return m_replies.load(std::memory_order_relaxed); }
+
+    static qint64 nowNs();
+
+protected:
+    QModbusResponse processRequest(const QModbusPdu &request) override;
+
+private:
+    int m_blockSize;
+    quint32 m_seq = 0;
+    std::atomic<quint64> m_replies { 0 };
+    std::unique_ptr<std::atomic<qint64>[]> m_stamps;
+};
+
+#endif // __BENCHMODBUSSERVER_H__
@@ -0,0 +1,296 @@
+// End-to-end gateway benchmark:
+// BenchModbusServer -> ModbusController -> AppService -> MessageQueue
+//   -> MqttWorker -> BenchBroker, all on loopback in one process.
+// Latency is measured from the Modbus reply to broker receipt; results are
+// printed (or written) as JSON.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QStandardPaths>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <QTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QTextStream>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "AppService.h"
+#include "BenchBroker.h"
+#include "BenchModbusServer.h"
+
+namespace {
+
+struct Config
+{
+    int durationS = 10;
+    int warmupS = 2;
+    int periodMs = 100;
+    int groups = 10;
+    int tags = 10;          // holding registers per poll group
+    int qos = 0;
+    int maxInFlight = MqttWorker::DefaultMaxInFlight;
+    int publishers = 1;
+    bool reportByException = false;
+    int queuePackets = MessageQueue::DefaultCapacity;
+    int queueKBytes = int(MessageQueue::DefaultMaxBytes / 1024);
+    int policy = MessageQueue::DropNewest;
+    quint16 modbusPort = 15020;
+    quint16 mqttPort = 11883;
+    QString output;
+};
+
+// Reads the sequence number from the first two values of a full snapshot
+bool parseSeq(const QByteArray &payload, quint32 &seq)
+{
+    const qsizetype pos = payload.indexOf("\"values\":[");
+    if (pos < 0)
+        return false;
+
+    const char *p = payload.constData() + pos + 10;
+    const char *end = payload.constData() + payload.size();
+    quint32 words[2] = { 0, 0 };
+
+    for (quint32 &word : words) {
+        if (p >= end || *p < '0' || *p > '9')
+            return false;
+        while (p < end && *p >= '0' && *p <= '9')
+            word = word * 10 + quint32(*p++ - '0');
+        if (p < end && *p == ',')
+            ++p;
+    }
+
+    seq = words[0] | (words[1] << 16);
+    return true;
+}
+
+qint64 percentile(const std::vector<qint64> &sorted, double q)
+{
+    if (sorted.empty())
+        return 0;
+    const size_t i = std::min(sorted.size() - 1, size_t(q * double(sorted.size())));
+    return sorted[i];
+}
+
+// Broker-thread side of the measurement
+struct Receiver
+{
+    const BenchModbusServer *server = nullptr;
+    std::atomic<bool> measuring { false };
+    quint64 received = 0;
+    quint64 unmatched = 0;
+    std::vector<qint64> latenciesNs;
+
+    void onPublish(const QByteArray &topic, const QByteArray &payload)
+    {
+        const qint64 now = BenchModbusServer::nowNs();
+        if (!measuring.load(std::memory_order_acquire) || topic != "modbus/holding")
+            return;
+
+        ++received;
+        quint32 seq = 0;
+        const qint64 stamp = parseSeq(payload, seq) ? server->stampOf(seq) : 0;
+        if (stamp > 0)
+            latenciesNs.push_back(now - stamp);
+        else
+            ++unmatched;
+    }
+};
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("gateway_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Modbus -> MQTT gateway throughput/latency benchmark");
+    parser.addHelpOption();
+
+    Config cfg;
+    const QCommandLineOption durationOpt("duration", "Measured seconds.", "s", QString::number(cfg.durationS));
+    const QCommandLineOption warmupOpt("warmup", "Warm-up seconds.", "s", QString::number(cfg.warmupS));
+    const QCommandLineOption periodOpt("period", "Poll period per group, ms.", "ms", QString::number(cfg.periodMs));
+    const QCommandLineOption groupsOpt("groups", "Number of poll groups (one message each).", "n", QString::number(cfg.groups));
+    const QCommandLineOption tagsOpt("tags", "Holding registers per group (>= 2).", "n", QString::number(cfg.tags));
+    const QCommandLineOption qosOpt("qos", "MQTT QoS 0..2.", "qos", QString::number(cfg.qos));
+    const QCommandLineOption inFlightOpt("max-inflight", "MQTT publish window.", "n", QString::number(cfg.maxInFlight));
+    const QCommandLineOption publishersOpt("publishers", "MQTT publisher connections (1..16).", "n", QString::number(cfg.publishers));
+    const QCommandLineOption rbeOpt("rbe", "Enable report-by-exception.");
+    const QCommandLineOption queuePacketsOpt("queue-packets", "MessageQueue packet limit.", "n", QString::number(cfg.queuePackets));
+    const QCommandLineOption queueKBytesOpt("queue-kb", "MessageQueue byte limit, KiB.", "kb", QString::number(cfg.queueKBytes));
+    const QCommandLineOption policyOpt("policy", "Overflow policy: 0 drop newest, 1 drop oldest, 2 block.", "p", QString::number(cfg.policy));
+    const QCommandLineOption coalesceOpt("coalesce", "Enable MessageQueue coalescing mode.");
+    const QCommandLineOption verboseOpt("verbose", "Print gateway log messages to stderr.");
+    const QCommandLineOption modbusPortOpt("modbus-port", "Loopback Modbus port.", "port", QString::number(cfg.modbusPort));
+    const QCommandLineOption mqttPortOpt("mqtt-port", "Loopback MQTT port.", "port", QString::number(cfg.mqttPort));
+    const QCommandLineOption outputOpt("output", "Write JSON result to file instead of stdout.", "file");
+
+    parser.addOptions({ durationOpt, warmupOpt, periodOpt, groupsOpt, tagsOpt, qosOpt,
+                        inFlightOpt, publishersOpt, rbeOpt, queuePacketsOpt, queueKBytesOpt, policyOpt, coalesceOpt, verboseOpt, modbusPortOpt, mqttPortOpt, outputOpt });
+    parser.process(app);
+
+    cfg.durationS = qMax(1, parser.value(durationOpt).toInt());
+    cfg.warmupS = qMax(0, parser.value(warmupOpt).toInt());
+    cfg.periodMs = qMax(1, parser.value(periodOpt).toInt());
+    cfg.groups = qMax(1, parser.value(groupsOpt).toInt());
+    cfg.tags = qBound(2, parser.value(tagsOpt).toInt(), 125);
+    cfg.qos = qBound(0, parser.value(qosOpt).toInt(), 2);
+    cfg.maxInFlight = qMax(1, parser.value(inFlightOpt).toInt());
+    cfg.publishers = qBound(1, parser.value(publishersOpt).toInt(), MqttPublisherPool::MaxShards);
+    cfg.reportByException = parser.isSet(rbeOpt);
+    cfg.queuePackets = qMax(1, parser.value(queuePacketsOpt).toInt());
+    cfg.queueKBytes = parser.value(queueKBytesOpt).toInt();
+    cfg.policy = qBound(0, parser.value(policyOpt).toInt(), 2);
+    cfg.modbusPort = quint16(parser.value(modbusPortOpt).toUInt());
+    cfg.mqttPort = quint16(parser.value(mqttPortOpt).toUInt());
+    cfg.output = parser.value(outputOpt);
+
+    QTextStream err(stderr);
+
+    // A backlog left over from an earlier run would skew the numbers
+    QDir(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+         + "/queue").removeRecursively();
+
+    // Modbus side (main thread)
+    BenchModbusServer server(cfg.groups * cfg.tags, cfg.tags);
+    if (!server.listen(cfg.modbusPort)) {
+        err << "cannot listen on Modbus port " << cfg.modbusPort << Qt::endl;
+        return 1;
+    }
+
+    // Broker side (own thread, so receipt time is not delayed by the server)
+    Receiver receiver;
+    receiver.server = &server;
+    receiver.latenciesNs.reserve(size_t(cfg.durationS) * cfg.groups * 1000 / cfg.periodMs + 1024);
+
+    QThread brokerThread;
+    auto *broker = new BenchBroker([&receiver](const QByteArray &topic, const QByteArray &payload) {
+        receiver.onPublish(topic, payload);
+    });
+    broker->moveToThread(&brokerThread);
+    QObject::connect(&brokerThread, &QThread::finished, broker, &QObject::deleteLater);
+    brokerThread.start();
+
+    bool listening = false;
+    QMetaObject::invokeMethod(broker, [&]() { listening = broker->listen(cfg.mqttPort); },
+                              Qt::BlockingQueuedConnection);
+    if (!listening) {
+        err << "cannot listen on MQTT port " << cfg.mqttPort << Qt::endl;
+        brokerThread.quit();
+        brokerThread.wait();
+        return 1;
+    }
+
+    // Gateway under test
+    AppService service;
+    if (parser.isSet(verboseOpt)) {
+        QObject::connect(&service, &AppService::logMessage, &app, [&err](const QString &msg) {
+            err << msg << Qt::endl;
+        });
+    }
+
+    service.setReportByException(cfg.reportByException);
+    service.setQueueLimits(cfg.queuePackets, cfg.queueKBytes, cfg.policy);
+    service.setCoalescing(parser.isSet(coalesceOpt));
+    service.setPublisherCount(cfg.publishers);
+    service.connectMqtt(QString("tcp://127.0.0.1:%1").arg(cfg.mqttPort), cfg.mqttPort,
+                        cfg.qos, cfg.maxInFlight);
+    service.connectModbus("127.0.0.1", cfg.modbusPort, 1);
+    for (int g = 0; g < cfg.groups; ++g)
+        service.addPollGroup(3, g * cfg.tags, cfg.tags, 1, cfg.periodMs);
+    service.startPolling();
+
+    quint64 repliesAtStart = 0;
+    QTimer::singleShot(cfg.warmupS * 1000, &app, [&]() {
+        repliesAtStart = server.replies();
+        receiver.measuring.store(true, std::memory_order_release);
+    });
+
+    QTimer::singleShot((cfg.warmupS + cfg.durationS) * 1000, &app, [&]() {
+        receiver.measuring.store(false, std::memory_order_release);
+        service.stopPolling();
+        app.quit();
+    });
+
+    app.exec();
+
+    const quint64 replies = server.replies() - repliesAtStart;
+    const QVariantMap pollStats = service.pollStats();
+    const QVariantMap plannerStats = service.plannerStats();
+    const QVariantMap pipelineStats = service.pipelineStats();
+    const QVariantMap queueStats = service.queueStats();
+    const QVariantList publisherStats = service.publisherStats();
+
+    brokerThread.quit();
+    brokerThread.wait();
+
+    std::vector<qint64> &lat = receiver.latenciesNs;
+    std::sort(lat.begin(), lat.end());
+    double meanNs = 0;
+    for (qint64 ns : lat)
+        meanNs += double(ns);
+    if (!lat.empty())
+        meanNs /= double(lat.size());
+
+    auto us = [](double ns) { return ns / 1000.0; };
+
+    QJsonObject config {
+        { "duration_s", cfg.durationS },
+        { "warmup_s", cfg.warmupS },
+        { "period_ms", cfg.periodMs },
+        { "groups", cfg.groups },
+        { "tags", cfg.tags },
+        { "qos", cfg.qos },
+        { "max_inflight", cfg.maxInFlight },
+        { "publishers", cfg.publishers },
+        { "rbe", cfg.reportByException },
+        { "queue_packets", cfg.queuePackets },
+        { "queue_kb", cfg.queueKBytes },
+        { "policy", cfg.policy },
+        { "coalesce", parser.isSet(coalesceOpt) },
+        { "target_msgs_per_s", cfg.groups * 1000.0 / cfg.periodMs },
+    };
+
+    QJsonObject latency {
+        { "samples", qint64(lat.size()) },
+        { "mean", us(meanNs) },
+        { "p50", us(double(percentile(lat, 0.50))) },
+        { "p99", us(double(percentile(lat, 0.99))) },
+        { "p999", us(double(percentile(lat, 0.999))) },
+        { "max", us(double(lat.empty() ? 0 : lat.back())) },
+    };
+
+    QJsonObject result {
+        { "config", config },
+        { "modbus_replies", qint64(replies) },
+        { "received", qint64(receiver.received) },
+        { "unmatched", qint64(receiver.unmatched) },
+        { "msgs_per_s", double(receiver.received) / cfg.durationS },
+        { "latency_us", latency },
+        { "poll", QJsonObject::fromVariantMap(pollStats) },
+        { "planner", QJsonObject::fromVariantMap(plannerStats) },
+        { "pipeline_us", QJsonObject::fromVariantMap(pipelineStats) },
+        { "queue", QJsonObject::fromVariantMap(queueStats) },
+        { "publishers", QJsonArray::fromVariantList(publisherStats) },
+    };
+
+    const QByteArray json = QJsonDocument(result).toJson(QJsonDocument::Indented);
+    if (cfg.output.isEmpty()) {
+        QTextStream(stdout) << json;
+    } else {
+        QFile file(cfg.output);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            err << "cannot write " << cfg.output << Qt::endl;
+            return 1;
+        }
+        file.write(json);
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Historian ingest cost and disk use: N tags sampled at 1 Hz, a given share
+// of samples changing value, everything else steady. The weekly figure is
+// extrapolated from the encoded size plus block headers; a short run also
+// carries one partly filled block per series, shown in disk bytes/sample.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include "Historian.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Historian ingest/query benchmark");
+    parser.addHelpOption();
+    const QCommandLineOption tagsOpt("tags", "Series sampled every second.", "n", "5000");
+    const QCommandLineOption hoursOpt("hours", "Simulated hours of data.", "h", "6");
+    const QCommandLineOption changeOpt("change", "Percent of samples with a new value.", "pct", "2");
+    const QCommandLineOption dirOpt("dir", "Store directory (default: temporary).", "path");
+    parser.addOptions({ tagsOpt, hoursOpt, changeOpt, dirOpt });
+    parser.process(app);
+
+    const int tags = qMax(1, parser.value(tagsOpt).toInt());
+    const int seconds = qMax(1, parser.value(hoursOpt).toInt()) * 3600;
+    const int change = qBound(0, parser.value(changeOpt).toInt(), 100);
+
+    QTemporaryDir temp;
+    const QString dir = parser.isSet(dirOpt) ? parser.value(dirOpt) : temp.path();
+
+    Historian historian;
+    if (!historian.open(dir))
+        return 1;
+
+    QVector<int> ids(tags);
+    QVector<double> values(tags);
+    for (int i = 0; i < tags; ++i)
+        ids[i] = historian.series(QString("bench/hr%1").arg(i));
+
+    // Which samples change is decided up front, outside the timed loop
+    QRandomGenerator rng(42);
+    QVector<quint8> changes(tags * 64);
+    for (quint8 &c : changes)
+        c = rng.bounded(100) < quint32(change);
+
+    const qint64 t0 = 1700000000000LL;
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int s = 0; s < seconds; ++s) {
+        const qint64 ts = t0 + qint64(s) * 1000;
+        const quint8 *changed = changes.constData() + (s % 64) * tags;
+        for (int i = 0; i < tags; ++i) {
+            if (changed[i])
+                values[i] += 1.0;
+            historian.append(ids[i], ts, values[i]);
+        }
+    }
+
+    const qint64 ingestNs = timer.nsecsElapsed();
+    const HistorianStats stats = historian.stats();
+    const double samples = double(stats.samples);
+    const double bytesPerSample = double(stats.blocks) * Historian::BlockSize / samples;
+    const double fullBlockBytes = stats.encodedBits / samples / 8 * Historian::BlockSize
+                                  / (Historian::BlockSize - int(sizeof(BlockHeader)));
+
+    QTextStream out(stdout);
+    out << "samples " << stats.samples << ", series " << stats.series << Qt::endl
+        << "ingest ns/sample " << QString::number(ingestNs / samples, 'f', 1) << Qt::endl
+        << "encoded bits/sample " << QString::number(stats.encodedBits / samples, 'f', 2)
+        << ", disk bytes/sample " << QString::number(bytesPerSample, 'f', 3) << Qt::endl
+        << "one week of " << tags << " tags at 1 Hz: "
+        << QString::number(fullBlockBytes * tags * 7 * 86400 / (1024 * 1024), 'f', 0)
+        << " MiB" << Qt::endl;
+
+    const qint64 end = t0 + qint64(seconds - 1) * 1000;
+    QVector<HistorySample> raw;
+    timer.restart();
+    historian.query(ids[0], end - 3600 * 1000, end, 1 << 30, &raw);
+    out << "raw query, last hour: " << raw.size() << " samples in "
+        << QString::number(timer.nsecsElapsed() / 1e6, 'f', 2) << " ms" << Qt::endl;
+
+    QVector<HistoryBucket> buckets;
+    timer.restart();
+    historian.queryDownsampled(ids[0], t0, end, 60 * 1000, &buckets);
+    out << "downsampled query, all: " << buckets.size() << " one-minute buckets in "
+        << QString::number(timer.nsecsElapsed() / 1e6, 'f', 2) << " ms" << Qt::endl;
+    return 0;
+}
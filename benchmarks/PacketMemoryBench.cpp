@@ -0,0 +1,131 @@
+// Memory per queued packet: the struct as it was (UUID string id, QString
+// topic, its own QByteArray payload) vs. MqttPacket with a sequence id, an
+// interned topic id and a pooled payload block. Heap use is read from the
+// allocator, so Qt's malloc()-based containers are counted too.
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QUuid>
+#include <QDateTime>
+#include <QTextStream>
+
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "MessageQueue.h"
+
+namespace {
+
+// The struct as it was before topics were interned and payloads pooled
+struct LegacyPacket
+{
+    QString id;
+    qint64 timestamp;
+    QString topic;
+    QByteArray payload;
+    int retryCount = 0;
+    quint64 seq = 0;
+    PacketTrace trace;
+    quint64 coalesceKey = 0;
+    quint64 routeKey = 0;
+
+    LegacyPacket(const QString& t, const QByteArray& p)
+        : id(QUuid::createUuid().toString(QUuid::WithoutBraces)),
+        timestamp(QDateTime::currentMSecsSinceEpoch()),
+        topic(t),
+        payload(p)
+    {}
+};
+
+const char* const Topics[] = { "modbus/holding", "modbus/coils", "modbus/tags" };
+
+// Bytes currently allocated from the heap; -1 where it cannot be read
+qint64 heapInUse()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return qint64(mallinfo2().uordblks);
+#else
+    return -1;
+#endif
+}
+
+QString perPacket(qint64 bytes, int packets)
+{
+    return bytes < 0 ? QStringLiteral("n/a")
+                     : QString::number(double(bytes) / packets, 'f', 1);
+}
+
+template <typename Packet, typename F>
+void run(QTextStream& out, const char* name, int packets, F&& make)
+{
+    std::vector<Packet> backlog;
+    backlog.reserve(size_t(packets));
+
+    const qint64 heap0 = heapInUse();
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < packets; ++i)
+        backlog.push_back(make(i));
+
+    const qint64 ns = timer.nsecsElapsed();
+    const qint64 heap = heap0 < 0 ? -1 : heapInUse() - heap0;
+
+    out << qSetFieldWidth(8) << name << qSetFieldWidth(0)
+        << "  sizeof " << sizeof(Packet)
+        << "  new heap/packet " << perPacket(heap, packets)
+        << "  total/packet " << perPacket(heap < 0 ? -1 : heap + qint64(sizeof(Packet)) * packets, packets)
+        << "  ns/packet " << QString::number(double(ns) / packets, 'f', 0) << Qt::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const int packets = argc > 1 ? QByteArray(argv[1]).toInt() : 100000;
+    QTextStream out(stdout);
+
+    quint32 topicIds[3];
+    for (int i = 0; i < 3; ++i)
+        topicIds[i] = TopicTable::intern(QString::fromLatin1(Topics[i]));
+
+    for (int registers : { 1, 10, 125 }) {
+        // A holding-register message as AppService formats it
+        QByteArray json = "{\"type\":\"holding_registers\",\"device\":\"127.0.0.1:502/1\","
+                          "\"start\":0,\"values\":[";
+        for (int i = 0; i < registers; ++i)
+            json += (i ? "," : "") + QByteArray::number(i * 37);
+        json += "]}";
+
+        out << "registers per message: " << registers
+            << " (" << json.size() << " payload bytes)" << Qt::endl;
+
+        // Each packet got its own topic string and payload copy
+        run<LegacyPacket>(out, "legacy", packets, [&](int i) {
+            return LegacyPacket(QString::fromLatin1(Topics[i % 3]),
+                                QByteArray(json.constData(), json.size()));
+        });
+
+        const PayloadPoolStats before = PacketPayload::poolStats();
+        run<MqttPacket>(out, "compact", packets, [&](int i) {
+            return MqttPacket(topicIds[i % 3], json);
+        });
+
+        // Blocks of the previous round came back to the pool: a second
+        // round of the same size carves no new slabs
+        const quint64 warm = PacketPayload::poolStats().slabBytes;
+        run<MqttPacket>(out, "reused", packets, [&](int i) {
+            return MqttPacket(topicIds[i % 3], json);
+        });
+
+        out << "  pool slabs " << (warm - before.slabBytes) / 1024 << " KiB, "
+            << (PacketPayload::poolStats().slabBytes - warm) / 1024
+            << " KiB more on reuse" << Qt::endl;
+    }
+    return 0;
+}
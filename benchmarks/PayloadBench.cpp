@@ -0,0 +1,186 @@
+// Allocations per published message: old QJson/QString path vs. JsonWriter
+// and byte payloads. The paho side is modelled as the std::string buffers
+// make_message() ends up owning, which is the same for both variants.
+//
+// QByteArray / QString allocate with malloc, not operator new, so the
+// counters hook malloc itself (glibc; elsewhere they print n/a).
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QUuid>
+#include <QDateTime>
+#include <QTextStream>
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+
+#include "MessageQueue.h"
+#include "JsonWriter.h"
+
+namespace {
+
+std::atomic<quint64> g_allocs { 0 };
+std::atomic<quint64> g_bytes { 0 };
+
+#if defined(__GLIBC__)
+const bool g_counting = true;
+
+void counted(size_t size)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+#else
+const bool g_counting = false;
+#endif
+
+// The struct as it was before payloads became bytes
+struct LegacyPacket
+{
+    QString id;
+    qint64 timestamp;
+    QString topic;
+    QString payload;
+    int retryCount = 0;
+
+    LegacyPacket(const QString& t, const QString& p)
+        : id(QUuid::createUuid().toString(QUuid::WithoutBraces)),
+        timestamp(QDateTime::currentMSecsSinceEpoch()),
+        topic(t),
+        payload(p)
+    {}
+};
+
+quint64 legacyPath(const QVector<quint16>& values, int start)
+{
+    QJsonArray arr;
+    for (auto v : values)
+        arr.append(int(v));
+
+    QJsonObject obj;
+    obj["type"] = "holding_registers";
+    obj["device"] = "127.0.0.1:502/1";
+    obj["start"] = start;
+    obj["values"] = arr;
+
+    QJsonDocument doc(obj);
+    LegacyPacket packet("modbus/holding", doc.toJson(QJsonDocument::Compact));
+
+    // publishPacket()
+    const std::string topic = packet.topic.toStdString();
+    const std::string body = packet.payload.toStdString();
+    return topic.size() + body.size();
+}
+
+quint64 writerPath(JsonWriter& writer, const QVector<quint16>& values, int start)
+{
+    writer.reset();
+    writer.beginObject()
+        .key("type").value("holding_registers")
+        .key("device").value("127.0.0.1:502/1")
+        .key("start").value(start)
+        .key("values").beginArray();
+    for (auto v : values)
+        writer.value(int(v));
+    writer.endArray().endObject();
+
+    static const quint32 topicId = TopicTable::intern("modbus/holding");
+    MqttPacket packet(topicId, writer.view());
+
+    // publishPacket()
+    const std::string topic = TopicTable::utf8(packet.topicId);
+    const std::string body(packet.payload.data(), size_t(packet.payload.size()));
+    return topic.size() + body.size();
+}
+
+template <typename F>
+void run(QTextStream& out, const char* name, int messages, F&& fn)
+{
+    quint64 sink = 0;
+    for (int i = 0; i < 1000; ++i)      // warm-up
+        sink += fn(i);
+
+    const quint64 allocs0 = g_allocs.load();
+    const quint64 bytes0 = g_bytes.load();
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < messages; ++i)
+        sink += fn(i);
+
+    const qint64 ns = timer.nsecsElapsed();
+    const double allocs = double(g_allocs.load() - allocs0) / messages;
+    const double bytes = double(g_bytes.load() - bytes0) / messages;
+
+    out << qSetFieldWidth(10) << name << qSetFieldWidth(0)
+        << "  allocs/msg " << (g_counting ? QString::number(allocs, 'f', 2) : QStringLiteral("n/a"))
+        << "  bytes/msg " << (g_counting ? QString::number(bytes, 'f', 0) : QStringLiteral("n/a"))
+        << "  ns/msg " << QString::number(double(ns) / messages, 'f', 0)
+        << "  (" << sink % 7 << ")" << Qt::endl;
+}
+
+} // namespace
+
+#if defined(__GLIBC__)
+// Interposed for the whole process (Qt included); operator new ends up
+// here as well. realloc() counts as one allocation of the new size.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+void *malloc(size_t size)
+{
+    counted(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    counted(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    counted(size);
+    return __libc_realloc(p, size);
+}
+
+void free(void *p)
+{
+    __libc_free(p);
+}
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const int messages = argc > 1 ? QByteArray(argv[1]).toInt() : 100000;
+    QTextStream out(stdout);
+
+    for (int count : { 1, 10, 125 }) {
+        QVector<quint16> values(count);
+        for (int i = 0; i < count; ++i)
+            values[i] = quint16(i * 37);
+
+        out << "registers per message: " << count << Qt::endl;
+
+        run(out, "legacy", messages, [&](int i) {
+            return legacyPath(values, i & 0xFFFF);
+        });
+
+        JsonWriter writer;
+        run(out, "writer", messages, [&](int i) {
+            return writerPath(writer, values, i & 0xFFFF);
+        });
+    }
+    return 0;
+}
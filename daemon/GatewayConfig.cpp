@@ -0,0 +1,212 @@
+#include "GatewayConfig.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "AppService.h"
+
+namespace {
+
+int policyFromString(const QString &name)
+{
+    if (name == "drop-oldest")
+        return MessageQueue::DropOldest;
+    if (name == "block")
+        return MessageQueue::Block;
+    if (name == "drop-newest")
+        return MessageQueue::DropNewest;
+    return -1;
+}
+
+} // namespace
+
+bool GatewayConfig::load(const QString &path, QString *error)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("cannot open %1: %2").arg(path, file.errorString());
+        return false;
+    }
+
+    QJsonParseError parseError;
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!doc.isObject()) {
+        *error = QString("%1: %2 at offset %3")
+                     .arg(path, parseError.errorString()).arg(parseError.offset);
+        return false;
+    }
+    const QJsonObject root = doc.object();
+
+    const QJsonObject mqtt = root["mqtt"].toObject();
+    mqttUri = mqtt["uri"].toString();
+    qos = qBound(0, mqtt["qos"].toInt(qos), 2);
+    maxInFlight = qMax(1, mqtt["maxInFlight"].toInt(maxInFlight));
+    maxRetries = qMax(0, mqtt["retries"].toInt(maxRetries));
+    retryBaseMs = qMax(1, mqtt["retryBaseMs"].toInt(retryBaseMs));
+    retryMaxMs = qMax(retryBaseMs, mqtt["retryMaxMs"].toInt(retryMaxMs));
+    publishers = qBound(1, mqtt["publishers"].toInt(publishers), MqttPublisherPool::MaxShards);
+    commandTopics.clear();
+    for (const QJsonValue &topic : mqtt["commandTopics"].toArray())
+        if (!topic.toString().isEmpty())
+            commandTopics.append(topic.toString());
+    if (mqttUri.isEmpty()) {
+        *error = "mqtt.uri is missing";
+        return false;
+    }
+
+    const QJsonObject queue = root["queue"].toObject();
+    queuePackets = qMax(1, queue["maxPackets"].toInt(queuePackets));
+    queueKBytes = qMax(1, queue["maxKBytes"].toInt(queueKBytes));
+    if (queue.contains("policy")) {
+        policy = policyFromString(queue["policy"].toString());
+        if (policy < 0) {
+            *error = "queue.policy must be drop-newest, drop-oldest or block";
+            return false;
+        }
+    }
+    blockTimeoutMs = qMax(0, queue["blockTimeoutMs"].toInt(blockTimeoutMs));
+    coalescing = queue["coalescing"].toBool(coalescing);
+    backpressureSlowdown = qMax(1, queue["slowdown"].toInt(backpressureSlowdown));
+
+    const QJsonObject batch = root["batch"].toObject();
+    batchWindowMs = qMax(0, batch["windowMs"].toInt(batchWindowMs));
+    batchMaxSamples = qMax(0, batch["maxSamples"].toInt(batchMaxSamples));
+    batchCompressAbove = qMax(0, batch["compressAbove"].toInt(batchCompressAbove));
+
+    const QJsonObject historian = root["historian"].toObject();
+    historianPath = historian["path"].toString(historianPath);
+    historianRetentionDays = qMax(0, historian["retentionDays"].toInt(historianRetentionDays));
+    historianRegisters = historian["registers"].toBool(historianRegisters);
+    historianTags = historian["tags"].toBool(historianTags);
+
+    const QJsonObject rbe = root["reportByException"].toObject();
+    reportByException = rbe["enabled"].toBool(reportByException);
+    heartbeatMs = qMax(0, rbe["heartbeatMs"].toInt(heartbeatMs));
+    deadband = qMax(0.0, rbe["deadband"].toDouble(deadband));
+    deadbandPercent = rbe["percent"].toBool(deadbandPercent);
+
+    const QJsonObject gap = root["readGap"].toObject();
+    registerGap = qMax(0, gap["registers"].toInt(registerGap));
+    coilGap = qMax(0, gap["coils"].toInt(coilGap));
+
+    const QJsonObject writes = root["writes"].toObject();
+    writeWindowMs = qBound(0, writes["windowMs"].toInt(writeWindowMs), 1000);
+
+    const QJsonObject stats = root["stats"].toObject();
+    statsIntervalMs = qMax(0, stats["intervalMs"].toInt(statsIntervalMs));
+    publishStats = stats["publish"].toBool(publishStats);
+
+    const QJsonObject log = root["log"].toObject();
+    if (log.contains("level")) {
+        logLevel = Logger::levelFromString(log["level"].toString(), Logger::Off);
+        if (logLevel == Logger::Off && log["level"].toString().compare("off", Qt::CaseInsensitive) != 0) {
+            *error = "log.level must be trace, debug, info, warning, error or off";
+            return false;
+        }
+    }
+    logFile = log["file"].toString(logFile);
+    logConsole = log["console"].toBool(logConsole);
+
+    devices.clear();
+    const QJsonArray deviceArray = root["devices"].toArray();
+    for (int i = 0; i < deviceArray.size(); ++i) {
+        const QJsonObject obj = deviceArray[i].toObject();
+
+        Device device;
+        device.host = obj["host"].toString();
+        device.port = obj["port"].toInt(device.port);
+        device.unitId = obj["unitId"].toInt(device.unitId);
+        device.maxOutstanding = qMax(1, obj["maxOutstanding"].toInt(device.maxOutstanding));
+        if (device.host.isEmpty() || device.port <= 0 || device.port > 65535
+            || device.unitId < 0 || device.unitId > 255) {
+            *error = QString("devices[%1]: host, port or unitId invalid").arg(i);
+            return false;
+        }
+
+        for (const QJsonValue &value : obj["pollGroups"].toArray()) {
+            const QJsonObject groupObj = value.toObject();
+
+            PollGroup group;
+            group.functionCode = groupObj["function"].toInt(group.functionCode);
+            group.start = groupObj["start"].toInt(group.start);
+            group.count = groupObj["count"].toInt(group.count);
+            group.periodMs = groupObj["periodMs"].toInt(group.periodMs);
+
+            const int maxCount = group.functionCode == 1 ? 2000 : 125;
+            if ((group.functionCode != 1 && group.functionCode != 3)
+                || group.start < 0 || group.count < 1 || group.count > maxCount
+                || group.periodMs < 1) {
+                *error = QString("devices[%1]: invalid poll group").arg(i);
+                return false;
+            }
+            device.pollGroups.append(group);
+        }
+
+        for (const QJsonValue &value : obj["tags"].toArray()) {
+            const QJsonObject tagObj = value.toObject();
+
+            Tag tag;
+            tag.name = tagObj["name"].toString();
+            tag.address = tagObj["address"].toInt(-1);
+            tag.type = tagObj["type"].toString();
+            tag.order = tagObj["order"].toString(tag.order);
+            tag.scale = tagObj["scale"].toDouble(tag.scale);
+            tag.offset = tagObj["offset"].toDouble(tag.offset);
+
+            TagDefinition::Type type;
+            TagDefinition::Order order;
+            if (tag.name.isEmpty() || tag.address < 0
+                || !TagDefinition::typeFromString(tag.type, &type)
+                || !TagDefinition::orderFromString(tag.order, &order)) {
+                *error = QString("devices[%1]: invalid tag \"%2\"").arg(i).arg(tag.name);
+                return false;
+            }
+            device.tags.append(tag);
+        }
+
+        devices.append(device);
+    }
+
+    if (devices.isEmpty()) {
+        *error = "no devices configured";
+        return false;
+    }
+
+    return true;
+}
+
+void GatewayConfig::apply(AppService &service) const
+{
+    service.setLogLevel(logLevel);
+    Logger::instance().setConsole(logConsole);
+
+    service.setRetryPolicy(maxRetries, retryBaseMs, retryMaxMs);
+    service.setPublisherCount(publishers);
+    service.setCommandTopics(commandTopics);
+    service.setQueueLimits(queuePackets, queueKBytes, policy, blockTimeoutMs);
+    service.setCoalescing(coalescing);
+    service.setBackpressureSlowdown(backpressureSlowdown);
+    service.setBatching(batchWindowMs, batchMaxSamples, batchCompressAbove);
+    if (!historianPath.isEmpty())
+        service.setHistorian(historianPath, historianRetentionDays,
+                             historianRegisters, historianTags);
+
+    service.setReportByException(reportByException, heartbeatMs);
+    service.setDefaultDeadband(deadband, deadbandPercent);
+    service.setReadGap(registerGap, coilGap);
+    service.setWriteWindow(writeWindowMs);
+    service.setStatsInterval(statsIntervalMs, publishStats);
+
+    for (const Device &device : devices) {
+        const int deviceId = service.addDevice(device.host, device.port,
+                                               device.unitId, device.maxOutstanding);
+        for (const PollGroup &group : device.pollGroups)
+            service.addDevicePollGroup(deviceId, group.functionCode,
+                                       group.start, group.count, group.periodMs);
+        for (const Tag &tag : device.tags)
+            service.addTag(deviceId, tag.name, tag.address, tag.type, tag.order,
+                           tag.scale, tag.offset);
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef __GATEWAYCONFIG_H__
+#define __GATEWAYCONFIG_H__
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "Logger.h"
+#include "MessageQueue.h"
+#include "MqttPublisherPool.h"
+#include "MqttWorker.h"
+#include "ModbusController.h"
+#include "ModbusDevicePool.h"
+#include "TagDecoder.h"
+
+class AppService;
+
+// Daemon configuration, read from a JSON file:
+//
+// {
+//   "mqtt":   { "uri": "tcp://broker:1883", "qos": 1, "maxInFlight": 32,
+//               "retries": 3, "retryBaseMs": 200, "retryMaxMs": 30000,
+//               "publishers": 1, "commandTopics": [ "gateway/cmd" ] },
+//   "queue":  { "maxPackets": 4096, "maxKBytes": 16384, "policy": "drop-newest",
+//               "blockTimeoutMs": 1000, "coalescing": false, "slowdown": 4 },
+//   "reportByException": { "enabled": true, "heartbeatMs": 60000,
+//                          "deadband": 0, "percent": false },
+//   "batch":  { "windowMs": 100, "maxSamples": 0, "compressAbove": 4096 },
+//   "historian": { "path": "/var/lib/iotgateway/history", "retentionDays": 30,
+//                  "registers": true, "tags": true },
+//   "readGap": { "registers": 8, "coils": 64 },
+//   "writes":  { "windowMs": 5 },
+//   "stats":   { "intervalMs": 10000, "publish": true },
+//   "log":     { "level": "info", "file": "/var/log/iotgateway.log", "console": false },
+//   "devices": [
+//     { "host": "10.0.0.5", "port": 502, "unitId": 1, "maxOutstanding": 4,
+//       "pollGroups": [ { "function": 3, "start": 0, "count": 20, "periodMs": 500 } ],
+//       "tags": [ { "name": "flow", "address": 4, "type": "float32", "order": "CDAB",
+//                   "scale": 1.0, "offset": 0.0 } ] }
+//   ]
+// }
+//
+// Everything except "mqtt.uri" and "devices" is optional.
+struct GatewayConfig
+{
+    struct PollGroup
+    {
+        int functionCode = 3;   // 1 = coils, 3 = holding registers
+        int start = 0;
+        int count = 1;
+        int periodMs = 1000;
+    };
+
+    struct Tag
+    {
+        QString name;
+        int address = 0;
+        QString type;
+        QString order = "ABCD";
+        double scale = 1.0;
+        double offset = 0.0;
+    };
+
+    struct Device
+    {
+        QString host;
+        int port = 502;
+        int unitId = 1;
+        int maxOutstanding = ModbusDevicePool::DefaultMaxOutstanding;
+        QVector<PollGroup> pollGroups;
+        QVector<Tag> tags;
+    };
+
+    // MQTT
+    QString mqttUri;
+    int qos = 1;
+    int maxInFlight = MqttWorker::DefaultMaxInFlight;
+    int publishers = 1;
+    QStringList commandTopics;              // JSON write commands, see ModbusCommand
+    int maxRetries = MqttWorker::DefaultRetryLimit;
+    int retryBaseMs = MqttWorker::DefaultRetryBaseMs;
+    int retryMaxMs = MqttWorker::DefaultRetryMaxMs;
+
+    // Backlog
+    int queuePackets = MessageQueue::DefaultCapacity;
+    int queueKBytes = int(MessageQueue::DefaultMaxBytes / 1024);
+    int policy = MessageQueue::DropNewest;
+    int blockTimeoutMs = 1000;
+    bool coalescing = false;
+    int backpressureSlowdown = 4;
+
+    // Batch envelopes (windowMs 0 = off)
+    int batchWindowMs = 0;
+    int batchMaxSamples = 0;
+    int batchCompressAbove = 0;
+
+    // Local history (empty path = off)
+    QString historianPath;
+    int historianRetentionDays = 0;
+    bool historianRegisters = true;
+    bool historianTags = true;
+
+    // Report-by-exception
+    bool reportByException = false;
+    int heartbeatMs = 0;
+    double deadband = 0;
+    bool deadbandPercent = false;
+
+    // Read planner: largest hole read through when merging ranges
+    int registerGap = 8;
+    int coilGap = 64;
+
+    // Writes within this window are merged into multi-write requests
+    int writeWindowMs = ModbusController::DefaultWriteWindowMs;
+
+    // Pipeline stats
+    int statsIntervalMs = 0;
+    bool publishStats = false;
+
+    // Logging
+    int logLevel = Logger::Info;
+    QString logFile;
+    bool logConsole = false;
+
+    QVector<Device> devices;
+
+    // Returns false and sets error on unreadable files or invalid values
+    bool load(const QString &path, QString *error);
+
+    // Configures service, registers devices and poll groups; does not connect
+    void apply(AppService &service) const;
+};
+
+#endif // __GATEWAYCONFIG_H__
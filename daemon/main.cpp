@@ -0,0 +1,106 @@
+// Headless gateway: AppService on a QCoreApplication, configured from a
+// JSON file, no QtQuick. Stops cleanly on SIGTERM / SIGINT.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+#include "AppService.h"
+#include "GatewayConfig.h"
+
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+// Self-pipe: the handler only writes a byte, the event loop does the rest
+int g_signalFd[2] = { -1, -1 };
+
+void onSignal(int)
+{
+    const char byte = 1;
+    [[maybe_unused]] const ssize_t n = ::write(g_signalFd[0], &byte, 1);
+}
+
+bool installSignalHandlers(QCoreApplication &app)
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, g_signalFd) != 0)
+        return false;
+
+    auto *notifier = new QSocketNotifier(g_signalFd[1], QSocketNotifier::Read, &app);
+    QObject::connect(notifier, &QSocketNotifier::activated, &app, [notifier]() {
+        notifier->setEnabled(false);
+        char byte = 0;
+        [[maybe_unused]] const ssize_t n = ::read(g_signalFd[1], &byte, 1);
+        QCoreApplication::quit();
+    });
+
+    struct sigaction action {};
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    return ::sigaction(SIGTERM, &action, nullptr) == 0
+           && ::sigaction(SIGINT, &action, nullptr) == 0;
+}
+
+} // namespace
+#endif
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("iotgatewayd");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless Modbus -> MQTT gateway");
+    parser.addHelpOption();
+    parser.addPositionalArgument("config", "JSON configuration file.");
+    const QCommandLineOption verboseOpt("verbose", "Print gateway log messages to stderr (overrides log.console).");
+    parser.addOption(verboseOpt);
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(1);
+
+    GatewayConfig config;
+    QString error;
+    if (!config.load(parser.positionalArguments().first(), &error)) {
+        err << "config: " << error << Qt::endl;
+        return 1;
+    }
+
+#ifdef Q_OS_UNIX
+    if (!installSignalHandlers(app)) {
+        err << "cannot install signal handlers" << Qt::endl;
+        return 1;
+    }
+#endif
+
+    AppService service;
+    config.apply(service);
+    if (parser.isSet(verboseOpt))
+        Logger::instance().setConsole(true);
+    if (!config.logFile.isEmpty() && !service.setLogFile(config.logFile)) {
+        err << "cannot open log file " << config.logFile << Qt::endl;
+        return 1;
+    }
+
+    service.connectMqtt(config.mqttUri, 0, config.qos, config.maxInFlight);
+    service.connectDevices();
+    service.startPolling();
+
+    const int rc = app.exec();
+
+    // Stop producing before ~AppService tears down the MQTT worker;
+    // whatever is still queued stays in the write-ahead log
+    service.stopPolling();
+    service.disconnectDevices();
+    Logger::instance().flush();
+    return rc;
+}
@@ -16,6 +16,14 @@ int main(int argc, char *argv[])
         "Modbus", 1, 0, "ModbusTypes",
         "Enum holder"
     );
+    qmlRegisterUncreatableType<LogModel>(
+        "Gateway", 1, 0, "LogModel",
+        "Owned by AppService"
+    );
+    qmlRegisterUncreatableType<ValueTableModel>(
+        "Gateway", 1, 0, "ValueTableModel",
+        "Owned by AppService"
+    );
 
 
     engine.rootContext()->setContextProperty("app", &service);
@@ -1,80 +1,455 @@
 #include "AppService.h"
-#include <QJsonArray>
+#include <QStandardPaths>
 #include <QJsonObject>
 #include <QJsonDocument>
 
 AppService::AppService(QObject *parent) : QObject(parent)
 {
-    m_modbus = new ModbusController(this);
+    m_logSink = Logger::instance().addSink([this](Logger::Level, qint64, const QString &text) {
+        m_log.append(text);
+        emit logMessage(text);
+    });
 
-    // Пробрасываем сигналы Modbus наружу
-    connect(m_modbus, &ModbusController::logMessage,
-            this, &AppService::logMessage);
+    // Called on whichever thread pushed or popped; handled on ours
+    m_publishers.setBackpressureHandler([this](bool active) {
+        QMetaObject::invokeMethod(this, [this, active]() { onBackpressure(active); },
+                                  Qt::QueuedConnection);
+    });
+
+    // Write-ahead log for the MQTT backlog, replayed on startup
+    m_publishers.enablePersistence(
+        QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)
+        + "/queue");
+    m_publishers.loadFromDisk();
+
+    m_modbus = new ModbusController;
+    m_modbus->moveToThread(&m_modbusThread);
+    connect(&m_modbusThread, &QThread::finished,
+            m_modbus, &QObject::deleteLater);
+
+    // Пробрасываем сигналы Modbus наружу (queued: m_modbus lives in its own thread)
     // connect(m_modbus, &ModbusController::ConnectionState,
     //         this, &AppService::stateChanged);
+    connect(m_modbus, &ModbusController::stateChanged,
+            this, [this](ModbusTypes::ConnectionState newState) {
+                m_modbusState = newState;
+                emit stateChanged(newState);
+            });
+
+    // Filtering, encoding and enqueueing stay on the acquisition thread;
+    // the table models take the values from there and refresh once per frame
+    connect(m_modbus, &ModbusController::writeCompleted,
+            this, &AppService::writeCompleted);
+
+    // MQTT commands go from the paho thread to the acquisition thread
+    // without passing through this (GUI) thread
+    m_commandInbox.setWaker([this]() {
+        QMetaObject::invokeMethod(m_modbus, [this]() { drainCommands(); },
+                                  Qt::QueuedConnection);
+    });
+
     connect(m_modbus, &ModbusController::holdingRegistersRead,
-            this, &AppService::onRegisters);
+            this, &AppService::onRegisters, Qt::DirectConnection);
     connect(m_modbus, &ModbusController::coilsRead,
-            this, &AppService::onCoils);
-    connect(m_modbus, &ModbusController::stateChanged,
-            this, &AppService::stateChanged);
+            this, &AppService::onCoils, Qt::DirectConnection);
+
+    connect(&m_statsTimer, &QTimer::timeout,
+            this, &AppService::onStatsTimer);
+
+    m_modbusThread.setObjectName("modbus");
+    m_modbusThread.start(QThread::HighPriority);
+}
+
+AppService::~AppService()
+{
+    // No command callback may post to m_modbus once it is gone
+    m_publishers.close();
+    // Open batches go to the backlog (and its log)
+    call([this](ModbusController *) {
+        flushBatches(true);
+        m_historian.close();
+        return 0;
+    });
+
+    // m_modbus is deleted in its own thread on finished()
+    m_modbusThread.quit();
+    m_modbusThread.wait();
+
+    // Nothing reaches m_log / logMessage after this
+    Logger::instance().removeSink(m_logSink);
+}
+
+void AppService::post(Command command)
+{
+    bool first = false;
+    {
+        QMutexLocker locker(&m_commandMutex);
+        first = m_commands.isEmpty();
+        m_commands.append(std::move(command));
+    }
+
+    if (first)
+        QMetaObject::invokeMethod(m_modbus, [this]() { runCommands(); },
+                                  Qt::QueuedConnection);
+}
+
+void AppService::runCommands()
+{
+    QVector<Command> batch;
+    {
+        QMutexLocker locker(&m_commandMutex);
+        batch.swap(m_commands);
+    }
+
+    for (const Command &command : std::as_const(batch))
+        command(m_modbus);
 }
 
 // MODBUS
 void AppService::connectModbus(const QString &host, int port, int unitId)
 {
-    m_modbus->connectToServer(host, port, unitId);
+    post([=](ModbusController *modbus) { modbus->connectToServer(host, port, unitId); });
 }
 
 void AppService::disconnectModbus()
 {
-    m_modbus->disconnectFromServer();
+    post([](ModbusController *modbus) { modbus->disconnectFromServer(); });
+}
+
+int AppService::addDevice(const QString &host, int port, int unitId, int maxOutstanding)
+{
+    return call([=](ModbusController *modbus) {
+        return modbus->addDevice(host, port, unitId, maxOutstanding);
+    });
+}
+
+void AppService::removeDevice(int deviceId)
+{
+    post([=](ModbusController *modbus) {
+        modbus->removeDevice(deviceId);
+        m_tags.removeDevice(deviceId);
+        m_historyRanges.clear();
+    });
+}
+
+void AppService::connectDevices()
+{
+    post([](ModbusController *modbus) { modbus->connectDevices(); });
+}
+
+void AppService::disconnectDevices()
+{
+    post([](ModbusController *modbus) { modbus->disconnectDevices(); });
+}
+
+QVariantList AppService::deviceStats() const
+{
+    return call([](ModbusController *modbus) { return modbus->deviceStats(); });
 }
 
 void AppService::readRegisters(int start, int count)
 {
-    m_modbus->readHoldingRegisters(start, count);
+    post([=](ModbusController *modbus) { modbus->readHoldingRegisters(start, count); });
 }
 
 void AppService::writeRegister(int address, int value)
 {
-    m_modbus->writeHoldingRegister(address, value);
+    post([=](ModbusController *modbus) { modbus->writeHoldingRegister(address, value); });
 }
 
 void AppService::readCoils(int start, int count)
 {
-    m_modbus->readCoils(start, count);
+    post([=](ModbusController *modbus) { modbus->readCoils(start, count); });
 }
 
 void AppService::writeCoil(int address, bool value)
 {
-    m_modbus->writeSingleCoil(address, value);
+    post([=](ModbusController *modbus) { modbus->writeSingleCoil(address, value); });
 }
 
-// MQTT
-void AppService::connectMqtt(const QString &host, int port, int qos)
+// Ids are handed out here so the caller gets one without waiting
+// for the acquisition thread
+int AppService::nextWriteId()
+{
+    int id;
+    do {
+        id = m_nextWriteId.fetch_add(1, std::memory_order_relaxed) & 0x7fffffff;
+    } while (id == 0);
+    return id;
+}
+
+int AppService::writeRegisters(int deviceId, int start, const QVariantList &values)
 {
-    if (m_mqtt) {
-        m_mqtt->stop();
-        m_mqtt->reset();
+    QVector<quint16> words;
+    words.reserve(values.size());
+    for (const QVariant &v : values)
+        words.append(quint16(v.toInt()));
+
+    const int id = nextWriteId();
+    post([=](ModbusController *modbus) { modbus->writeRegisters(id, deviceId, start, words); });
+    return id;
+}
+
+int AppService::writeCoils(int deviceId, int start, const QVariantList &values)
+{
+    QVector<bool> bits;
+    bits.reserve(values.size());
+    for (const QVariant &v : values)
+        bits.append(v.toBool());
+
+    const int id = nextWriteId();
+    post([=](ModbusController *modbus) { modbus->writeCoils(id, deviceId, start, bits); });
+    return id;
+}
+
+void AppService::setWriteWindow(int ms)
+{
+    post([=](ModbusController *modbus) { modbus->setWriteWindow(ms); });
+}
+
+QVariantMap AppService::writeStats() const
+{
+    return call([](ModbusController *modbus) { return modbus->writeStats(); });
+}
+
+// POLLING
+int AppService::addPollGroup(int functionCode, int start, int count,
+                             int unitId, int periodMs)
+{
+    return call([=](ModbusController *modbus) {
+        return modbus->addPollGroup(functionCode, start, count, unitId, periodMs);
+    });
+}
+
+int AppService::addDevicePollGroup(int deviceId, int functionCode,
+                                   int start, int count, int periodMs)
+{
+    return call([=](ModbusController *modbus) {
+        return modbus->addDevicePollGroup(deviceId, functionCode, start, count, periodMs);
+    });
+}
+
+void AppService::removePollGroup(int id)
+{
+    post([=](ModbusController *modbus) { modbus->removePollGroup(id); });
+}
+
+void AppService::startPolling()
+{
+    post([](ModbusController *modbus) { modbus->startPolling(); });
+}
+
+void AppService::stopPolling()
+{
+    post([](ModbusController *modbus) { modbus->stopPolling(); });
+}
+
+QVariantMap AppService::pollStats() const
+{
+    return call([](ModbusController *modbus) { return modbus->pollStats(); });
+}
+
+void AppService::setReadGap(int registers, int coils)
+{
+    post([=](ModbusController *modbus) { modbus->setReadGap(registers, coils); });
+}
+
+QVariantMap AppService::plannerStats() const
+{
+    return call([](ModbusController *modbus) { return modbus->plannerStats(); });
+}
+
+// REPORT-BY-EXCEPTION
+// The filter is consulted on the acquisition thread, so it is configured there too
+void AppService::setReportByException(bool enabled, int heartbeatMs)
+{
+    post([=](ModbusController *) {
+        m_filter.setEnabled(enabled);
+        m_filter.setHeartbeatInterval(heartbeatMs);
+        m_filter.reset();
+    });
+}
+
+void AppService::setDefaultDeadband(double value, bool percent)
+{
+    post([=](ModbusController *) {
+        m_filter.setDefaultDeadband(percent ? ReportFilter::Percent : ReportFilter::Absolute, value);
+    });
+}
+
+void AppService::setDeadband(int deviceId, int address, double value, bool percent)
+{
+    post([=](ModbusController *) {
+        m_filter.setDeadband(deviceId, address,
+                             percent ? ReportFilter::Percent : ReportFilter::Absolute, value);
+    });
+}
+
+// TAGS
+bool AppService::addTag(int deviceId, const QString &name, int address, const QString &type,
+                        const QString &order, double scale, double offset)
+{
+    TagDefinition tag;
+    tag.name = name.toUtf8();
+    tag.address = address;
+    tag.scale = scale;
+    tag.offset = offset;
+    if (name.isEmpty() || address < 0
+        || !TagDefinition::typeFromString(type, &tag.type)
+        || !TagDefinition::orderFromString(order, &tag.order)) {
+        GW_WARN("Invalid tag %1: type %2, order %3", name, type, order);
+        return false;
     }
 
-    QString clientId = "QtClient_" + QString::number(QDateTime::currentMSecsSinceEpoch());
+    post([=](ModbusController *) {
+        m_tags.addTag(deviceId, tag);
+        m_historyRanges.clear();
+    });
+    return true;
+}
 
-    m_mqtt = std::make_unique<MqttWorker>(
-        host,
-        clientId,
-        qos,
-        &m_queue,
-        this
-        );
+void AppService::clearTags()
+{
+    post([this](ModbusController *) {
+        m_tags.clear();
+        m_historyRanges.clear();
+    });
+}
+
+// HISTORIAN
+
+bool AppService::setHistorian(const QString &path, int retentionDays, bool registers, bool tags)
+{
+    return call([=](ModbusController *modbus) {
+        m_historyRanges.clear();
+        m_historyRegisters = registers;
+        m_historyTags = tags;
+        m_historian.setRetention(qint64(qMax(0, retentionDays)) * 24 * 3600 * 1000);
+
+        if (path.isEmpty()) {
+            m_historian.close();
+            if (m_historyTimer)
+                m_historyTimer->stop();
+            return true;
+        }
+
+        if (path != m_historian.path() && !m_historian.open(path))
+            return false;
+
+        if (!m_historyTimer) {
+            m_historyTimer = new QTimer(modbus);
+            connect(m_historyTimer, &QTimer::timeout, modbus, [this]() {
+                m_historian.sync();
+                m_historian.prune(QDateTime::currentMSecsSinceEpoch());
+            });
+        }
+        // Mapped pages reach the disk at least this often
+        m_historyTimer->start(10000);
+        m_historian.prune(QDateTime::currentMSecsSinceEpoch());
+        return true;
+    });
+}
+
+QStringList AppService::historySeries() const
+{
+    return m_historian.seriesNames();
+}
+
+// Queries run on the caller's thread, not behind Modbus I/O: the historian
+// lets them read a copy of its block index while recording goes on
+QVariantMap AppService::queryHistory(const QString &series, qint64 fromMs, qint64 toMs,
+                                     int maxSamples) const
+{
+    QVector<HistorySample> samples;
+    m_historian.query(m_historian.findSeries(series), fromMs, toMs, maxSamples, &samples);
+
+    QVariantList ts, values;
+    ts.reserve(samples.size());
+    values.reserve(samples.size());
+    for (const HistorySample &sample : std::as_const(samples)) {
+        ts.append(sample.timestamp);
+        values.append(sample.value);
+    }
+
+    QVariantMap map;
+    map["series"] = series;
+    map["ts"] = ts;
+    map["values"] = values;
+    return map;
+}
+
+QVariantMap AppService::queryHistoryDownsampled(const QString &series, qint64 fromMs,
+                                                qint64 toMs, qint64 bucketMs) const
+{
+    const qint64 maxBuckets = 10000;
+    const qint64 span = qMax<qint64>(0, toMs - fromMs);
+    bucketMs = qMax(bucketMs, span / (maxBuckets - 1) + 1);
+
+    QVector<HistoryBucket> buckets;
+    m_historian.queryDownsampled(m_historian.findSeries(series), fromMs, toMs, bucketMs,
+                                 &buckets);
 
-    // Push LOG
-    connect(m_mqtt.get(), &MqttWorker::logMessage,
-            this, &AppService::logMessage);
+    QVariantList ts, min, max, mean, last, count;
+    for (const HistoryBucket &bucket : std::as_const(buckets)) {
+        ts.append(bucket.timestamp);
+        min.append(bucket.min);
+        max.append(bucket.max);
+        mean.append(bucket.mean);
+        last.append(bucket.last);
+        count.append(bucket.count);
+    }
 
-    m_queue.reset();
-    m_mqtt->start();
+    QVariantMap map;
+    map["series"] = series;
+    map["bucketMs"] = bucketMs;
+    map["ts"] = ts;
+    map["min"] = min;
+    map["max"] = max;
+    map["mean"] = mean;
+    map["last"] = last;
+    map["count"] = count;
+    return map;
+}
+
+QVariantMap AppService::historianStats() const
+{
+    return call([this](ModbusController *) {
+        const HistorianStats stats = m_historian.stats();
+
+        QVariantMap map;
+        map["open"] = m_historian.isOpen();
+        map["path"] = m_historian.path();
+        map["series"] = stats.series;
+        map["segments"] = stats.segments;
+        map["blocks"] = stats.blocks;
+        map["diskBytes"] = stats.diskBytes;
+        map["samples"] = stats.samples;
+        map["rejected"] = stats.rejected;
+        map["bitsPerSample"] = stats.samples ? double(stats.encodedBits) / stats.samples : 0.0;
+        map["prunedSegments"] = stats.prunedSegments;
+        return map;
+    });
+}
+
+QVariantMap AppService::reportStats() const
+{
+    return call([this](ModbusController *) {
+        QVariantMap map;
+        map["enabled"] = m_filter.isEnabled();
+        map["published"] = m_filter.publishedCount();
+        map["suppressed"] = m_filter.suppressedCount();
+        return map;
+    });
+}
+
+// MQTT
+void AppService::connectMqtt(const QString &host, int port, int qos, int maxInFlight)
+{
+    QString clientId = "QtClient_" + QString::number(QDateTime::currentMSecsSinceEpoch());
+
+    // Restarts every publisher, keeping whatever was recovered from the log
+    m_publishers.start(host, clientId, qos, maxInFlight,
+                       m_maxRetries, m_retryBaseMs, m_retryMaxMs, &m_metrics);
 
     m_mqttConnected = true;
     emit mqttConnectedChanged();
@@ -82,50 +457,507 @@ void AppService::connectMqtt(const QString &host, int port, int qos)
 
 void AppService::disconnectMqtt()
 {
-    if (m_mqtt) {
-        m_mqtt->stop();
-        m_mqtt->reset();
-    }
+    m_publishers.stop();
 
     m_mqttConnected = false;
     emit mqttConnectedChanged();
 }
 
-// ROUTING
-void AppService::onRegisters(int start, const QVector<quint16>& values)
+void AppService::clearQueue()
+{
+    m_publishers.clear();
+    GW_INFO("MQTT backlog cleared");
+}
+
+void AppService::setPublisherCount(int count)
+{
+    if (m_mqttConnected) {
+        GW_WARN("Disconnect MQTT before changing the publisher count");
+        return;
+    }
+    m_publishers.setShardCount(count);
+
+    // One envelope per topic and shard
+    const int buckets = m_publishers.shardCount();
+    post([=](ModbusController *) {
+        flushBatches(true);
+        m_batcher.setRouteBuckets(buckets);
+    });
+}
+
+QVariantList AppService::publisherStats() const
+{
+    return m_publishers.shardStats();
+}
+
+void AppService::setCommandTopics(const QStringList &topics)
+{
+    m_commandTopics = topics;
+    if (topics.isEmpty())
+        m_publishers.setSubscriptions({}, nullptr);
+    else
+        m_publishers.setSubscriptions(topics, [this](QByteArrayView topic, QByteArrayView payload) {
+            onCommand(topic, payload);
+        });
+}
+
+QVariantMap AppService::commandStats() const
+{
+    QVariantMap map;
+    map["topics"] = m_commandTopics;
+    map["accepted"] = m_commandInbox.accepted();
+    map["rejected"] = m_commandInbox.rejected();
+    map["dropped"] = m_commandInbox.dropped();
+    map["dispatched"] = m_commandInbox.dispatched();
+    map["queued"] = m_commandInbox.size();
+    map["latencyUs"] = m_commandLatency.snapshot();
+    return map;
+}
+
+// Paho callback thread: parse into a fixed-size record and hand it over
+void AppService::onCommand(QByteArrayView topic, QByteArrayView payload)
+{
+    ModbusCommand command;
+    command.receivedNs = PacketTrace::now();
+
+    const char *error = nullptr;
+    if (!ModbusCommand::parse(payload, &command, &error)) {
+        m_commandInbox.reject();
+        GW_WARN("Command on %1 rejected: %2", topic.toByteArray(), error);
+        return;
+    }
+
+    command.writeId = nextWriteId();
+    if (!m_commandInbox.push(command))
+        GW_WARN("Command inbox full, write to %1 dropped", command.address);
+}
+
+// Acquisition thread. Commands skip the write window: the ones that
+// arrived together are merged and sent right away.
+void AppService::drainCommands()
+{
+    m_commandStamps.clear();
+    m_commandInbox.drain([this](const ModbusCommand &command) {
+        if (command.coils) {
+            QVector<bool> bits(command.count);
+            for (int i = 0; i < command.count; ++i)
+                bits[i] = command.values[i] != 0;
+            m_modbus->writeCoils(command.writeId, command.deviceId, command.address, bits);
+        } else {
+            m_modbus->writeRegisters(command.writeId, command.deviceId, command.address,
+                                     QVector<quint16>(command.values,
+                                                      command.values + command.count));
+        }
+        m_commandStamps.append(command.receivedNs);
+    });
+
+    if (m_commandStamps.isEmpty())
+        return;
+
+    m_modbus->flushWrites();
+
+    // Arrival on the paho thread -> request handed to the device pool
+    const qint64 now = PacketTrace::now();
+    for (qint64 receivedNs : std::as_const(m_commandStamps))
+        m_commandLatency.record((now - receivedNs) / 1000);
+}
+
+// BATCHING
+void AppService::setBatching(int windowMs, int maxSamples, int compressAboveBytes)
+{
+    const int buckets = m_publishers.shardCount();
+    post([=](ModbusController *modbus) {
+        flushBatches(true);
+        m_batcher.setWindow(windowMs, maxSamples);
+        m_batcher.setCompression(compressAboveBytes);
+        m_batcher.setRouteBuckets(buckets);
+
+        if (!m_batchTimer) {
+            m_batchTimer = new QTimer(modbus);
+            m_batchTimer->setSingleShot(true);
+            connect(m_batchTimer, &QTimer::timeout, modbus, [this]() { flushBatches(false); });
+        }
+    });
+}
+
+QVariantMap AppService::batchStats() const
+{
+    return call([this](ModbusController *) {
+        const BatchStats &stats = m_batcher.stats();
+
+        QVariantMap map;
+        map["enabled"] = m_batcher.isEnabled();
+        map["windowMs"] = m_batcher.windowMs();
+        map["routeBuckets"] = m_batcher.routeBuckets();
+        map["samples"] = stats.samples;
+        map["envelopes"] = stats.envelopes;
+        map["compressed"] = stats.compressed;
+        map["bytesIn"] = stats.bytesIn;
+        map["bytesOut"] = stats.bytesOut;
+        return map;
+    });
+}
+
+// Acquisition thread: into the backlog, or into the topic's open envelope.
+// False when the backlog refused the packet; the caller makes the filter
+// forget what it carried
+bool AppService::enqueue(const MqttPacket &packet)
+{
+    if (!m_batcher.isEnabled()) {
+        if (m_publishers.push(packet))
+            return true;
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    m_batcher.add(packet, PacketTrace::now() / 1000000, &m_batchReady);
+    pushBatches();
+    return true;
+}
+
+void AppService::flushBatches(bool all)
+{
+    if (all)
+        m_batcher.takeAll(&m_batchReady);
+    else
+        m_batcher.takeDue(PacketTrace::now() / 1000000, &m_batchReady);
+    pushBatches();
+}
+
+void AppService::pushBatches()
+{
+    bool lost = false;
+    for (const MqttPacket &envelope : std::as_const(m_batchReady)) {
+        if (!m_publishers.push(envelope)) {
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+            lost = true;
+        }
+    }
+    m_batchReady.clear();
+
+    // An envelope mixes many ranges: republish everything in full
+    if (lost)
+        m_filter.reset();
+
+    // One timer for the earliest open window
+    const qint64 due = m_batcher.nextDueMs();
+    if (due >= 0 && m_batchTimer && !m_batchTimer->isActive())
+        m_batchTimer->start(int(qMax<qint64>(0, due - PacketTrace::now() / 1000000)));
+}
+
+void AppService::setRetryPolicy(int maxRetries, int baseMs, int maxMs)
+{
+    m_maxRetries = qMax(0, maxRetries);
+    m_retryBaseMs = qMax(1, baseMs);
+    m_retryMaxMs = qMax(m_retryBaseMs, maxMs);
+}
+
+// BACKLOG LIMITS
+void AppService::setQueueLimits(int maxPackets, int maxKBytes, int policy, int blockTimeoutMs)
+{
+    m_publishers.setLimits(maxPackets, qint64(maxKBytes) * 1024);
+    m_publishers.setOverflowPolicy(MessageQueue::OverflowPolicy(qBound(0, policy, 2)),
+                                   blockTimeoutMs);
+}
+
+void AppService::setBackpressureSlowdown(int factor)
+{
+    m_backpressureSlowdown = qMax(1, factor);
+    if (m_backpressure)
+        post([factor = m_backpressureSlowdown](ModbusController *modbus) {
+            modbus->setPollSlowdown(factor);
+        });
+}
+
+QVariantMap AppService::queueStats() const
+{
+    const MessageQueueStats stats = m_publishers.queueStats();
+
+    QVariantMap map;
+    map["size"] = stats.size;
+    map["bytes"] = stats.bytes;
+    map["droppedOldest"] = stats.droppedOldest;
+    map["droppedNewest"] = stats.droppedNewest;
+    map["blockTimeouts"] = stats.blockTimeouts;
+    map["backpressure"] = stats.backpressure;
+    map["coalescing"] = m_publishers.isCoalescing();
+    map["coalesced"] = stats.coalesced;
+    map["rejected"] = m_rejected.load(std::memory_order_relaxed);
+    map["publishers"] = m_publishers.shardCount();
+
+    const PayloadPoolStats pool = PacketPayload::poolStats();
+    map["payloadBlocks"] = pool.blocksInUse;
+    map["payloadPoolBytes"] = pool.slabBytes;
+    map["topics"] = TopicTable::size();
+
+    if (m_mqttConnected) {
+        const MqttWorkerStats retry = m_publishers.workerStats();
+        map["brokerConnected"] = retry.connected;
+        map["published"] = retry.published;
+        map["inFlight"] = retry.inFlight;
+        map["pendingRetries"] = retry.pendingRetries;
+        map["retried"] = retry.retried;
+        map["retryDropped"] = retry.retryDropped;
+        map["retrySuperseded"] = retry.superseded;
+        map["retryHeldBack"] = retry.heldBack;
+        map["connectFailures"] = retry.connectFailures;
+    }
+    return map;
+}
+
+void AppService::setCoalescing(bool enabled)
+{
+    m_publishers.setCoalescing(enabled);
+}
+
+void AppService::onBackpressure(bool active)
+{
+    if (m_backpressure == active)
+        return;
+
+    m_backpressure = active;
+    if (active)
+        GW_WARN("MQTT backlog above high watermark, slowing acquisition");
+    else
+        GW_INFO("MQTT backlog drained, acquisition back to normal");
+    emit backpressureChanged(active);
+
+    post([factor = active ? m_backpressureSlowdown : 1](ModbusController *modbus) {
+        modbus->setPollSlowdown(factor);
+    });
+}
+
+// PIPELINE STATS
+void AppService::setStatsInterval(int intervalMs, bool publish)
+{
+    m_publishStats = publish;
+    if (intervalMs > 0)
+        m_statsTimer.start(intervalMs);
+    else
+        m_statsTimer.stop();
+}
+
+void AppService::resetPipelineStats()
+{
+    m_metrics.reset();
+    m_commandLatency.reset();
+    emit pipelineStatsChanged();
+}
+
+void AppService::onStatsTimer()
+{
+    emit pipelineStatsChanged();
+
+    if (!m_publishStats || !m_mqttConnected)
+        return;
+
+    const QByteArray json = QJsonDocument(QJsonObject::fromVariantMap(m_metrics.snapshot()))
+                                .toJson(QJsonDocument::Compact);
+    static const quint32 topic = TopicTable::intern("$gateway/stats");
+    MqttPacket packet(topic, json);
+    packet.coalesceKey = MessageQueue::coalesceKey(topic, 0, 0, 0);
+    m_publishers.push(packet);
+}
+
+// LOGGING
+void AppService::setLogLevel(int level)
 {
+    Logger::setLevel(Logger::Level(qBound(int(Logger::Trace), level, int(Logger::Off))));
+}
+
+int AppService::logLevel() const
+{
+    return Logger::level();
+}
+
+bool AppService::setLogFile(const QString &path)
+{
+    return Logger::instance().setFile(path);
+}
+
+// ROUTING (acquisition thread)
+// With report-by-exception a read becomes either a full snapshot
+// {start, values} or a delta {addresses, values}; unchanged reads are dropped.
+void AppService::onRegisters(int deviceId, int start, const QVector<quint16>& values,
+                             qint64 sentNs, qint64 receivedNs)
+{
+    m_registerModel.update(deviceId, start, values);
     emit registersUpdated(start, values);
 
-    QJsonArray arr;
-    for (auto v : values)
-        arr.append(int(v));
+    if (m_historian.isOpen())
+        recordHistory(deviceId, start, values);
+
+    QVector<int> changed;
+    const bool full = !m_filter.isEnabled()
+                      || m_filter.filterRegisters(deviceId, start, values, changed);
+    if (!full && changed.isEmpty())
+        return;
+
+    m_writer.reset();
+    m_writer.beginObject()
+        .key("type").value("holding_registers")
+        .key("device").value(deviceName(deviceId));
+
+    if (full) {
+        m_writer.key("start").value(start)
+                .key("values").beginArray();
+        for (auto v : values)
+            m_writer.value(int(v));
+        m_writer.endArray();
+    } else {
+        m_writer.key("addresses").beginArray();
+        for (int i : changed)
+            m_writer.value(start + i);
+        m_writer.endArray()
+                .key("values").beginArray();
+        for (int i : changed)
+            m_writer.value(int(values[i]));
+        m_writer.endArray();
+    }
+    m_writer.endObject();
+
+    static const quint32 topic = TopicTable::intern("modbus/holding");
+    MqttPacket packet(topic, m_writer.view());
+    if (full)
+        packet.coalesceKey = MessageQueue::coalesceKey(topic, deviceId,
+                                                       start, values.size());
+    // One stream per device and range: same publisher, same order
+    packet.routeKey = MessageQueue::coalesceKey(topic, deviceId, start, 0);
+    packet.trace.requestSentNs = sentNs;
+    packet.trace.replyReceivedNs = receivedNs;
+    if (!enqueue(packet))
+        m_filter.forgetRegisters(deviceId, start, values.size());
+
+    if (!m_tags.isEmpty())
+        publishTags(deviceId, start, values, full, sentNs, receivedNs);
+}
+
+// Typed values of the tags inside the block, decoded in one pass
+void AppService::publishTags(int deviceId, int start, const QVector<quint16>& values,
+                             bool full, qint64 sentNs, qint64 receivedNs)
+{
+    const TagDecodePlan &plan = m_tags.plan(deviceId, start, values.size());
+    if (plan.isEmpty())
+        return;
 
-    QJsonObject obj;
-    obj["type"] = "holding_registers";
-    obj["start"] = start;
-    obj["values"] = arr;
+    m_tagValues.resize(plan.size());
+    plan.decode(values.constData(), m_tagValues.data());
 
-    QJsonDocument doc(obj);
+    m_writer.reset();
+    m_writer.beginObject()
+        .key("type").value("tags")
+        .key("device").value(deviceName(deviceId))
+        .key("values").beginObject();
+    const QVector<QByteArray> &names = plan.names();
+    for (int i = 0; i < names.size(); ++i)
+        m_writer.key(names[i]).value(m_tagValues[i]);
+    m_writer.endObject()
+        .endObject();
 
-    m_queue.push(MqttPacket("modbus/holding",
-                            doc.toJson(QJsonDocument::Compact)));
+    static const quint32 topic = TopicTable::intern("modbus/tags");
+    MqttPacket packet(topic, m_writer.view());
+    if (full)
+        packet.coalesceKey = MessageQueue::coalesceKey(topic, deviceId,
+                                                       start, values.size());
+    packet.routeKey = MessageQueue::coalesceKey(topic, deviceId, start, 0);
+    packet.trace.requestSentNs = sentNs;
+    packet.trace.replyReceivedNs = receivedNs;
+    // Tags follow their registers: a full block brings them back
+    if (!enqueue(packet))
+        m_filter.forgetRegisters(deviceId, start, values.size());
 }
 
-void AppService::onCoils(int start, const QVector<bool>& values)
+void AppService::onCoils(int deviceId, int start, const QVector<bool>& values,
+                         qint64 sentNs, qint64 receivedNs)
 {
+    m_coilModel.update(deviceId, start, values);
     emit coilsUpdated(start, values);
 
-    QJsonArray arr;
-    for (bool v : values)
-        arr.append(v);
+    QVector<int> changed;
+    const bool full = !m_filter.isEnabled()
+                      || m_filter.filterCoils(deviceId, start, values, changed);
+    if (!full && changed.isEmpty())
+        return;
+
+    m_writer.reset();
+    m_writer.beginObject()
+        .key("type").value("coils")
+        .key("device").value(deviceName(deviceId));
 
-    QJsonObject obj;
-    obj["type"] = "coils";
-    obj["start"] = start;
-    obj["values"] = arr;
+    if (full) {
+        m_writer.key("start").value(start)
+                .key("values").beginArray();
+        for (bool v : values)
+            m_writer.value(v);
+        m_writer.endArray();
+    } else {
+        m_writer.key("addresses").beginArray();
+        for (int i : changed)
+            m_writer.value(start + i);
+        m_writer.endArray()
+                .key("values").beginArray();
+        for (int i : changed)
+            m_writer.value(bool(values[i]));
+        m_writer.endArray();
+    }
+    m_writer.endObject();
+
+    static const quint32 topic = TopicTable::intern("modbus/coils");
+    MqttPacket packet(topic, m_writer.view());
+    if (full)
+        packet.coalesceKey = MessageQueue::coalesceKey(topic, deviceId,
+                                                       start, values.size());
+    // One stream per device and range: same publisher, same order
+    packet.routeKey = MessageQueue::coalesceKey(topic, deviceId, start, 0);
+    packet.trace.requestSentNs = sentNs;
+    packet.trace.replyReceivedNs = receivedNs;
+    if (!enqueue(packet))
+        m_filter.forgetCoils(deviceId, start, values.size());
+}
 
-    QJsonDocument doc(obj);
+// Acquisition thread: m_modbus may be called directly
+// Every polled block, ahead of report-by-exception filtering
+void AppService::recordHistory(int deviceId, int start, const QVector<quint16>& values)
+{
+    const quint64 key = (quint64(quint32(deviceId)) << 32)
+                        | (quint64(quint16(start)) << 16)
+                        | quint64(quint16(values.size()));
 
-    m_queue.push(MqttPacket("modbus/coils",
-                            doc.toJson(QJsonDocument::Compact)));
+    auto it = m_historyRanges.find(key);
+    if (it == m_historyRanges.end()) {
+        // Series are looked up by name once per block layout
+        HistoryRange range;
+        const QString device = QString::fromUtf8(deviceName(deviceId));
+        if (m_historyRegisters) {
+            range.registers.reserve(values.size());
+            for (int i = 0; i < values.size(); ++i)
+                range.registers.append(m_historian.series(device + "/hr" + QString::number(start + i)));
+        }
+        if (m_historyTags && !m_tags.isEmpty()) {
+            for (const QByteArray &name : m_tags.plan(deviceId, start, values.size()).names())
+                range.tags.append(m_historian.series(device + '/' + QString::fromUtf8(name)));
+        }
+        it = m_historyRanges.insert(key, range);
+    }
+
+    const HistoryRange &range = it.value();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (int i = 0; i < range.registers.size(); ++i)
+        m_historian.append(range.registers[i], now, values[i]);
+
+    if (!range.tags.isEmpty()) {
+        const TagDecodePlan &plan = m_tags.plan(deviceId, start, values.size());
+        m_tagValues.resize(plan.size());
+        plan.decode(values.constData(), m_tagValues.data());
+        for (int i = 0; i < range.tags.size(); ++i)
+            m_historian.append(range.tags[i], now, m_tagValues[i]);
+    }
+}
+
+const QByteArray &AppService::deviceName(int deviceId)
+{
+    auto it = m_deviceNames.find(deviceId);
+    if (it == m_deviceNames.end())
+        it = m_deviceNames.insert(deviceId, m_modbus->deviceName(deviceId).toUtf8());
+    return it.value();
 }
@@ -2,11 +2,29 @@
 #define __APPSERVICE_H__
 
 #include <QObject>
+#include <QTimer>
+#include <QThread>
+#include <QMutex>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
 #include <memory>
 
+#include "BatchAggregator.h"
+#include "CommandInbox.h"
+#include "Historian.h"
+#include "LogModel.h"
+#include "Logger.h"
 #include "ModbusController.h"
+#include "MqttPublisherPool.h"
 #include "MqttWorker.h"
 #include "MessageQueue.h"
+#include "ReportFilter.h"
+#include "TagDecoder.h"
+#include "JsonWriter.h"
+#include "PipelineMetrics.h"
+#include "ValueTableModel.h"
 
 #include "ModbusTypes.h"
 
@@ -20,29 +38,152 @@ class AppService : public QObject
     // MQTT state exposed to QML
     Q_PROPERTY(bool mqttConnected READ mqttConnected NOTIFY mqttConnectedChanged)
 
+    // MessageQueue above its high watermark; polling is slowed down meanwhile
+    Q_PROPERTY(bool backpressure READ backpressure NOTIFY backpressureChanged)
+
+    // Stage/topic latency histograms (us), refreshed every stats interval
+    Q_PROPERTY(QVariantMap pipelineStats READ pipelineStats NOTIFY pipelineStatsChanged)
+
+    // Bounded log view, fed by the logging thread
+    Q_PROPERTY(LogModel *log READ logModel CONSTANT)
+
+    // One row per address, refreshed in place at most once per frame
+    Q_PROPERTY(ValueTableModel *registers READ registerModel CONSTANT)
+    Q_PROPERTY(ValueTableModel *coils READ coilModel CONSTANT)
+
 public:
     explicit AppService(QObject *parent = nullptr);
+    ~AppService() override;
 
     // Getter for QML
     bool mqttConnected() const { return m_mqttConnected; }
+    QVariantMap pipelineStats() const { return m_metrics.snapshot(); }
+    bool backpressure() const { return m_backpressure; }
+    LogModel *logModel() { return &m_log; }
+    ValueTableModel *registerModel() { return &m_registerModel; }
+    ValueTableModel *coilModel() { return &m_coilModel; }
 
     // Modbus API
     Q_INVOKABLE void connectModbus(const QString &host, int port, int unitId);
     Q_INVOKABLE void disconnectModbus();
+    // maxOutstanding 0 keeps the limit of an already registered device
+    // (ModbusDevicePool::DefaultMaxOutstanding for a new one)
+    Q_INVOKABLE int addDevice(const QString &host, int port, int unitId,
+                              int maxOutstanding = 0);
+    Q_INVOKABLE void removeDevice(int deviceId);
+    Q_INVOKABLE void connectDevices();
+    Q_INVOKABLE void disconnectDevices();
+    Q_INVOKABLE QVariantList deviceStats() const;
     Q_INVOKABLE void readRegisters(int start, int count);
     Q_INVOKABLE void writeRegister(int address, int value);
     Q_INVOKABLE void readCoils(int start, int count);
     Q_INVOKABLE void writeCoil(int address, bool value);
+    // Batched writes (deviceId 0 = default connection): everything written
+    // within the write window goes out as few FC15/FC16 requests, the last
+    // value per address wins. Returns the id later passed to writeCompleted.
+    Q_INVOKABLE int writeRegisters(int deviceId, int start, const QVariantList &values);
+    Q_INVOKABLE int writeCoils(int deviceId, int start, const QVariantList &values);
+    Q_INVOKABLE void setWriteWindow(int ms);
+    Q_INVOKABLE QVariantMap writeStats() const;
+
+    // Continuous acquisition (function code 1 = coils, 3 = holding registers)
+    Q_INVOKABLE int addPollGroup(int functionCode, int start, int count,
+                                 int unitId, int periodMs);
+    Q_INVOKABLE int addDevicePollGroup(int deviceId, int functionCode,
+                                       int start, int count, int periodMs);
+    Q_INVOKABLE void removePollGroup(int id);
+    Q_INVOKABLE void startPolling();
+    Q_INVOKABLE void stopPolling();
+    Q_INVOKABLE QVariantMap pollStats() const;
+    Q_INVOKABLE void setReadGap(int registers, int coils);
+    Q_INVOKABLE QVariantMap plannerStats() const;
 
     ModbusTypes::ConnectionState state() const {
-        return m_modbus->state(); }
+        return m_modbusState; }
+
+    // Report-by-exception: publish only values that moved past their deadband
+    Q_INVOKABLE void setReportByException(bool enabled, int heartbeatMs = 0);
+    Q_INVOKABLE void setDefaultDeadband(double value, bool percent = false);
+    Q_INVOKABLE void setDeadband(int deviceId, int address, double value, bool percent = false);
+    Q_INVOKABLE QVariantMap reportStats() const;
+
+    // Typed tags over holding registers, published to modbus/tags as
+    // {"name": value} whenever their block is published.
+    // type: uint16, int16, uint32, int32, float32, float64;
+    // order: ABCD, CDAB, BADC, DCBA; value = raw * scale + offset
+    Q_INVOKABLE bool addTag(int deviceId, const QString &name, int address,
+                            const QString &type, const QString &order = "ABCD",
+                            double scale = 1.0, double offset = 0.0);
+    Q_INVOKABLE void clearTags();
+
+    // Local history of every polled holding register ("<device>/hr<address>")
+    // and tag ("<device>/<tag>"), stored compressed under path; empty path
+    // closes it. Samples older than retentionDays (0 = keep all) are dropped
+    // a segment at a time.
+    Q_INVOKABLE bool setHistorian(const QString &path, int retentionDays = 0,
+                                  bool registers = true, bool tags = true);
+    Q_INVOKABLE QStringList historySeries() const;
+    // {"ts": [...], "values": [...]}, oldest first
+    Q_INVOKABLE QVariantMap queryHistory(const QString &series, qint64 fromMs, qint64 toMs,
+                                         int maxSamples = 10000) const;
+    // Per non-empty bucket of bucketMs: {"ts", "min", "max", "mean", "last", "count"}
+    // lists; bucketMs is raised so that at most 10000 buckets come back
+    Q_INVOKABLE QVariantMap queryHistoryDownsampled(const QString &series, qint64 fromMs,
+                                                    qint64 toMs, qint64 bucketMs) const;
+    Q_INVOKABLE QVariantMap historianStats() const;
 
     // MQTT API
-    Q_INVOKABLE void connectMqtt(const QString &host, int port, int qos);
+    Q_INVOKABLE void connectMqtt(const QString &host, int port, int qos,
+                                 int maxInFlight = MqttWorker::DefaultMaxInFlight);
+    // Keeps the backlog (and its log) for the next connectMqtt()
     Q_INVOKABLE void disconnectMqtt();
+    // Drops every packet still waiting to be published
+    Q_INVOKABLE void clearQueue();
+    // Number of publisher connections (1..16), each with its own backlog;
+    // only while MQTT is disconnected
+    Q_INVOKABLE void setPublisherCount(int count);
+    // Per publisher: backlog, in-flight, retries and msgs/s since the last call
+    Q_INVOKABLE QVariantList publisherStats() const;
+    // MQTT topic filters carrying write commands (see ModbusCommand), subscribed
+    // from the next connectMqtt(); empty = no subscription
+    Q_INVOKABLE void setCommandTopics(const QStringList &topics);
+    // Accepted/rejected/dropped counts and arrival -> Modbus request latency
+    Q_INVOKABLE QVariantMap commandStats() const;
+    // Failed publishes: up to maxRetries attempts with exponential backoff
+    // (baseMs doubling up to maxMs, jittered); applies from the next connectMqtt()
+    Q_INVOKABLE void setRetryPolicy(int maxRetries, int baseMs, int maxMs);
+
+    // MQTT backlog limits. policy: 0 = drop newest, 1 = drop oldest,
+    // 2 = block the acquisition thread up to blockTimeoutMs, then drop newest
+    Q_INVOKABLE void setQueueLimits(int maxPackets, int maxKBytes, int policy = 0,
+                                    int blockTimeoutMs = 1000);
+    // Poll period multiplier while backpressure is on (1 = keep polling rate)
+    Q_INVOKABLE void setBackpressureSlowdown(int factor);
+    Q_INVOKABLE QVariantMap queueStats() const;
+    // Pack every data packet of a topic within windowMs (or maxSamples, 0 = no
+    // limit) into one <topic>/batch envelope; envelopes above compressAboveBytes
+    // go to <topic>/batchz, qCompress()ed (0 = never). windowMs 0 = off.
+    Q_INVOKABLE void setBatching(int windowMs, int maxSamples = 0, int compressAboveBytes = 0);
+    Q_INVOKABLE QVariantMap batchStats() const;
+    // Keep only the newest snapshot per topic and register range in the
+    // backlog (report-by-exception deltas are never coalesced)
+    Q_INVOKABLE void setCoalescing(bool enabled);
+
+    // Pipeline latency: refresh pipelineStats every intervalMs (0 = off),
+    // optionally publishing the snapshot to $gateway/stats as well
+    Q_INVOKABLE void setStatsInterval(int intervalMs, bool publish = false);
+    Q_INVOKABLE void resetPipelineStats();
+
+    // Logging: 0 trace, 1 debug, 2 info, 3 warning, 4 error, 5 off.
+    // Levels below IOTGW_LOG_LEVEL are compiled out regardless.
+    Q_INVOKABLE void setLogLevel(int level);
+    Q_INVOKABLE int logLevel() const;
+    // Also write the log to path (empty = stop)
+    Q_INVOKABLE bool setLogFile(const QString &path);
 
 signals:
     // Signals exposed to QML
+    // Emitted on the logging thread for every record at or above logLevel()
     void logMessage(const QString &msg);
     void registersUpdated(int start, const QVector<quint16> &values);
     void coilsUpdated(int start, const QVector<bool> &values);
@@ -51,17 +192,106 @@ signals:
     void stateChanged(ModbusTypes::ConnectionState newState);
     // MQTT state changed
     void mqttConnectedChanged();
+    void pipelineStatsChanged();
+    void backpressureChanged(bool active);
+    void writeCompleted(int writeId, bool ok, const QString &error);
 
 private slots:
-    void onRegisters(int start, const QVector<quint16>& values);
-    void onCoils(int start, const QVector<bool>& values);
+    void onRegisters(int deviceId, int start, const QVector<quint16>& values,
+                     qint64 sentNs, qint64 receivedNs);
+    void onCoils(int deviceId, int start, const QVector<bool>& values,
+                 qint64 sentNs, qint64 receivedNs);
+    void onStatsTimer();
+    void onBackpressure(bool active);
 
 private:
-    ModbusController* m_modbus = nullptr;
-    MessageQueue m_queue;
-    std::unique_ptr<MqttWorker> m_mqtt;
+    using Command = std::function<void(ModbusController *)>;
+
+    // Fire-and-forget call on the acquisition thread. Calls made before
+    // that thread gets around to them travel in one queued event.
+    void post(Command command);
+    void runCommands();
+
+    // Synchronous call on the acquisition thread (ids, statistics)
+    template <typename F>
+    auto call(F &&f) const -> decltype(f(std::declval<ModbusController *>()))
+    {
+        using R = decltype(f(std::declval<ModbusController *>()));
+        if (QThread::currentThread() == &m_modbusThread)
+            return f(m_modbus);
+
+        R result {};
+        QMetaObject::invokeMethod(m_modbus, [&]() { result = f(m_modbus); },
+                                  Qt::BlockingQueuedConnection);
+        return result;
+    }
+
+    const QByteArray &deviceName(int deviceId);
+    int nextWriteId();
+    void onCommand(QByteArrayView topic, QByteArrayView payload);
+    bool enqueue(const MqttPacket &packet);
+    void flushBatches(bool all);
+    void pushBatches();
+    void drainCommands();
+    void publishTags(int deviceId, int start, const QVector<quint16>& values,
+                     bool full, qint64 sentNs, qint64 receivedNs);
+    void recordHistory(int deviceId, int start, const QVector<quint16>& values);
+
+    // Modbus I/O, report filtering and payload encoding run here,
+    // away from QML rendering
+    QThread m_modbusThread;
+    ModbusController* m_modbus = nullptr;   // lives in m_modbusThread
+    ModbusTypes::ConnectionState m_modbusState = ModbusTypes::Disconnected;
+
+    QMutex m_commandMutex;
+    QVector<Command> m_commands;
+    std::atomic<int> m_nextWriteId { 1 };
+
+    // Used on the acquisition thread only
+    ReportFilter m_filter;
+    JsonWriter m_writer;                    // reused payload buffer
+    TagMap m_tags;
+    BatchAggregator m_batcher;
+    QVector<MqttPacket> m_batchReady;       // reused
+    QTimer *m_batchTimer = nullptr;         // owned by m_modbus
+    QVector<double> m_tagValues;            // reused decode output
+    std::atomic<quint64> m_rejected { 0 };  // packets the backlog refused
+    QHash<int, QByteArray> m_deviceNames;   // device id -> "host:port/unit"
+
+    struct HistoryRange
+    {
+        QVector<int> registers;             // series per register, empty = not recorded
+        QVector<int> tags;                  // series per tag, in plan order
+    };
+    Historian m_historian;
+    QHash<quint64, HistoryRange> m_historyRanges;   // by device, start and count
+    bool m_historyRegisters = true;
+    bool m_historyTags = true;
+    QTimer *m_historyTimer = nullptr;       // sync and retention, owned by m_modbus
+
+    // Declared before m_publishers: their callbacks record here until it is destroyed
+    LogModel m_log;
+    int m_logSink = 0;                      // Logger sink feeding m_log
+    ValueTableModel m_registerModel { ValueTableModel::Registers };
+    ValueTableModel m_coilModel { ValueTableModel::Coils };
+    PipelineMetrics m_metrics;
+    QTimer m_statsTimer;
+    bool m_publishStats = false;
+
+    // Written from the paho thread, so it outlives m_publishers
+    CommandInbox m_commandInbox;
+    LatencyHistogram m_commandLatency;
+    QStringList m_commandTopics;
+    QVector<qint64> m_commandStamps;        // acquisition thread, reused
+
+    MqttPublisherPool m_publishers;
 
     bool m_mqttConnected = false;
+    int m_maxRetries = MqttWorker::DefaultRetryLimit;
+    int m_retryBaseMs = MqttWorker::DefaultRetryBaseMs;
+    int m_retryMaxMs = MqttWorker::DefaultRetryMaxMs;
+    bool m_backpressure = false;
+    int m_backpressureSlowdown = 4;
 };
 
 #endif // __APPSERVICE_H__
@@ -0,0 +1,120 @@
+#include "BatchAggregator.h"
+
+void BatchAggregator::setWindow(int windowMs, int maxSamples)
+{
+    m_windowMs = qMax(0, windowMs);
+    m_maxSamples = qMax(0, maxSamples);
+}
+
+void BatchAggregator::setCompression(int thresholdBytes, int level)
+{
+    m_compressAbove = qMax(0, thresholdBytes);
+    m_compressLevel = qBound(-1, level, 9);
+}
+
+void BatchAggregator::setRouteBuckets(int buckets)
+{
+    m_buckets = qMax(1, buckets);
+}
+
+void BatchAggregator::add(const MqttPacket &packet, qint64 nowMs, QVector<MqttPacket> *ready)
+{
+    ++m_stats.samples;
+    m_stats.bytesIn += packet.payload.size();
+
+    const quint64 routeKey = (quint64(packet.topicId) << 32)
+                             | quint32(packet.routeKey % quint64(m_buckets));
+    auto it = m_open.find(routeKey);
+    if (it == m_open.end()) {
+        std::shared_ptr<Batch> batch;
+        if (m_spare.isEmpty()) {
+            batch = std::make_shared<Batch>();
+        } else {
+            batch = m_spare.takeLast();
+        }
+
+        batch->writer.reset();
+        batch->writer.beginObject()
+            .key("samples").beginArray();
+        batch->dueMs = nowMs + m_windowMs;
+        batch->count = 0;
+        batch->trace = packet.trace;
+        batch->routeKey = routeKey;
+        if (batch->topicId != packet.topicId || !batch->plainId) {
+            batch->topicId = packet.topicId;
+            batch->plainId = TopicTable::intern(packet.topic() + "/batch");
+            batch->compressedId = TopicTable::intern(packet.topic() + "/batchz");
+        }
+        it = m_open.insert(routeKey, batch);
+    }
+
+    Batch &batch = *it.value();
+    batch.writer.beginObject()
+        .key("ts").value(packet.timestamp)
+        .key("data").raw(packet.payload.view())
+        .endObject();
+    ++batch.count;
+
+    if ((m_maxSamples && batch.count >= m_maxSamples)
+        || batch.writer.view().size() >= MaxEnvelopeBytes) {
+        ready->append(close(batch));
+        m_spare.append(it.value());
+        m_open.erase(it);
+    }
+}
+
+void BatchAggregator::takeDue(qint64 nowMs, QVector<MqttPacket> *ready)
+{
+    for (auto it = m_open.begin(); it != m_open.end();) {
+        if (it.value()->dueMs > nowMs) {
+            ++it;
+            continue;
+        }
+        ready->append(close(*it.value()));
+        m_spare.append(it.value());
+        it = m_open.erase(it);
+    }
+}
+
+void BatchAggregator::takeAll(QVector<MqttPacket> *ready)
+{
+    for (auto it = m_open.begin(); it != m_open.end(); ++it) {
+        ready->append(close(*it.value()));
+        m_spare.append(it.value());
+    }
+    m_open.clear();
+}
+
+qint64 BatchAggregator::nextDueMs() const
+{
+    qint64 due = -1;
+    for (const auto &batch : m_open)
+        if (due < 0 || batch->dueMs < due)
+            due = batch->dueMs;
+    return due;
+}
+
+MqttPacket BatchAggregator::close(Batch &batch)
+{
+    batch.writer.endArray()
+        .key("count").value(batch.count)
+        .endObject();
+
+    const QByteArrayView json = batch.writer.view();
+    MqttPacket packet;
+    if (m_compressAbove && json.size() > m_compressAbove) {
+        const QByteArray compressed = qCompress(reinterpret_cast<const uchar *>(json.data()),
+                                                int(json.size()), m_compressLevel);
+        packet = MqttPacket(batch.compressedId, compressed);
+        ++m_stats.compressed;
+    } else {
+        packet = MqttPacket(batch.plainId, json);
+    }
+
+    ++m_stats.envelopes;
+    m_stats.bytesOut += packet.payload.size();
+
+    packet.routeKey = batch.routeKey;
+    packet.trace = batch.trace;
+    return packet;
+}
@@ -0,0 +1,85 @@
+#ifndef __BATCHAGGREGATOR_H__
+#define __BATCHAGGREGATOR_H__
+
+#include <QHash>
+#include <QVector>
+
+#include <memory>
+
+#include "JsonWriter.h"
+#include "MessageQueue.h"
+
+struct BatchStats
+{
+    quint64 samples = 0;        // packets taken in
+    quint64 envelopes = 0;      // packets handed out
+    quint64 compressed = 0;     // envelopes sent compressed
+    quint64 bytesIn = 0;        // sample payload bytes
+    quint64 bytesOut = 0;       // envelope payload bytes
+};
+
+// Packs the packets of one topic into one envelope per time window:
+//   <topic>/batch   {"count": n, "samples": [{"ts": ms, "data": <payload>}, ...]}
+//   <topic>/batchz  the same, qCompress()ed (4-byte big-endian size + zlib)
+// A window closes after windowMs, at maxSamples samples or at MaxEnvelopeBytes.
+// A topic's sources are split into route buckets (source routeKey % buckets,
+// usually the publisher count), each with its own envelope and a fixed
+// routeKey (topic id, bucket): one source always travels on one route, so its
+// samples stay in order, while the buckets spread over the publisher shards.
+// Sample payloads must be JSON. Not thread-safe; owned by a single thread.
+class BatchAggregator
+{
+public:
+    static constexpr int MaxEnvelopeBytes = 256 * 1024;
+
+    // windowMs 0 turns batching off; maxSamples 0 = no count limit
+    void setWindow(int windowMs, int maxSamples);
+    bool isEnabled() const { return m_windowMs > 0; }
+    int windowMs() const { return m_windowMs; }
+
+    // Envelopes larger than thresholdBytes are compressed (0 = never)
+    void setCompression(int thresholdBytes, int level = -1);
+
+    // Take everything open first: samples would change buckets
+    void setRouteBuckets(int buckets);
+    int routeBuckets() const { return m_buckets; }
+
+    // Envelopes that closed on size or count are appended to ready
+    void add(const MqttPacket &packet, qint64 nowMs, QVector<MqttPacket> *ready);
+    // Envelopes whose window has elapsed
+    void takeDue(qint64 nowMs, QVector<MqttPacket> *ready);
+    void takeAll(QVector<MqttPacket> *ready);
+
+    bool isEmpty() const { return m_open.isEmpty(); }
+    // Earliest window end, or -1 when nothing is open
+    qint64 nextDueMs() const;
+
+    const BatchStats &stats() const { return m_stats; }
+
+private:
+    struct Batch
+    {
+        JsonWriter writer;
+        qint64 dueMs = 0;
+        int count = 0;
+        PacketTrace trace;      // of the oldest sample
+        quint64 routeKey = 0;   // (source topic id, bucket)
+        quint32 topicId = 0;    // envelope topics, interned when the source changes
+        quint32 plainId = 0;
+        quint32 compressedId = 0;
+    };
+
+    MqttPacket close(Batch &batch);
+
+    int m_windowMs = 0;
+    int m_maxSamples = 0;
+    int m_compressAbove = 0;
+    int m_compressLevel = -1;
+    int m_buckets = 1;
+
+    QHash<quint64, std::shared_ptr<Batch>> m_open;   // by route key
+    QVector<std::shared_ptr<Batch>> m_spare;   // writers keep their capacity
+    BatchStats m_stats;
+};
+
+#endif // __BATCHAGGREGATOR_H__
@@ -0,0 +1,19 @@
+#include "CommandInbox.h"
+
+CommandInbox::CommandInbox(int capacity)
+    : m_ring(capacity)
+{
+}
+
+bool CommandInbox::push(const ModbusCommand &command)
+{
+    if (!m_ring.tryPush(command)) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    m_accepted.fetch_add(1, std::memory_order_relaxed);
+
+    if (!m_wakePending.exchange(true, std::memory_order_acq_rel) && m_waker)
+        m_waker();
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef __COMMANDINBOX_H__
+#define __COMMANDINBOX_H__
+
+#include <atomic>
+#include <functional>
+
+#include "ModbusCommand.h"
+#include "RingBuffer.h"
+
+// Lock-free handoff of parsed commands from the MQTT callback thread to the
+// acquisition thread. push() calls the waker only when no drain is pending,
+// so a burst of commands costs a single wake-up.
+class CommandInbox
+{
+public:
+    static constexpr int DefaultCapacity = 1024;
+
+    // Called on the pushing thread; must schedule drain() on the consumer
+    using Waker = std::function<void()>;
+
+    explicit CommandInbox(int capacity = DefaultCapacity);
+
+    // Set before the first push()
+    void setWaker(Waker waker) { m_waker = std::move(waker); }
+
+    // Any thread; false when the inbox is full
+    bool push(const ModbusCommand &command);
+
+    // Consumer thread: calls f for every queued command, returns how many
+    template <typename F>
+    int drain(F &&f)
+    {
+        // Cleared first: a push racing with the loop below either lands
+        // in it or schedules the next drain. An exchange, not a store, so
+        // it synchronizes with the push that set the flag.
+        m_wakePending.exchange(false, std::memory_order_acq_rel);
+
+        int count = 0;
+        ModbusCommand command;
+        while (m_ring.tryPop(command)) {
+            f(command);
+            ++count;
+        }
+        m_dispatched.fetch_add(quint64(count), std::memory_order_relaxed);
+        return count;
+    }
+
+    // Parse failures are counted here for the stats
+    void reject() { m_rejected.fetch_add(1, std::memory_order_relaxed); }
+
+    quint64 accepted() const { return m_accepted.load(std::memory_order_relaxed); }
+    quint64 rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+    quint64 dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    quint64 dispatched() const { return m_dispatched.load(std::memory_order_relaxed); }
+    int size() const { return m_ring.size(); }
+
+private:
+    RingBuffer<ModbusCommand> m_ring;
+    Waker m_waker;
+    std::atomic<bool> m_wakePending { false };
+
+    std::atomic<quint64> m_accepted { 0 };
+    std::atomic<quint64> m_rejected { 0 };
+    std::atomic<quint64> m_dropped { 0 };
+    std::atomic<quint64> m_dispatched { 0 };
+};
+
+#endif // __COMMANDINBOX_H__
@@ -0,0 +1,198 @@
+#include "ModbusCommand.h"
+
+namespace {
+
+// Just enough JSON for a flat object of integers, booleans, short
+// strings and one array of integers or booleans; no DOM, no allocation
+class Scanner
+{
+public:
+    explicit Scanner(QByteArrayView text)
+        : m_p(text.data()), m_end(text.data() + text.size()) {}
+
+    bool atEnd()
+    {
+        skipSpace();
+        return m_p == m_end;
+    }
+
+    bool consume(char c)
+    {
+        skipSpace();
+        if (m_p == m_end || *m_p != c)
+            return false;
+        ++m_p;
+        return true;
+    }
+
+    // No escapes: keys and type names are plain ASCII
+    bool string(QByteArrayView *out)
+    {
+        if (!consume('"'))
+            return false;
+
+        const char *begin = m_p;
+        while (m_p != m_end && *m_p != '"') {
+            if (*m_p == '\\')
+                return false;
+            ++m_p;
+        }
+        if (m_p == m_end)
+            return false;
+
+        *out = QByteArrayView(begin, m_p - begin);
+        ++m_p;
+        return true;
+    }
+
+    // Integer, true or false
+    bool integer(qint64 *out)
+    {
+        skipSpace();
+        if (literal("true")) {
+            *out = 1;
+            return true;
+        }
+        if (literal("false")) {
+            *out = 0;
+            return true;
+        }
+
+        const bool negative = m_p != m_end && *m_p == '-';
+        if (negative)
+            ++m_p;
+
+        const char *digits = m_p;
+        qint64 value = 0;
+        while (m_p != m_end && *m_p >= '0' && *m_p <= '9') {
+            value = value * 10 + (*m_p - '0');
+            if (value > 0xFFFFFFFFLL)
+                return false;
+            ++m_p;
+        }
+        if (m_p == digits)
+            return false;
+
+        *out = negative ? -value : value;
+        return true;
+    }
+
+private:
+    void skipSpace()
+    {
+        while (m_p != m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\n' || *m_p == '\r'))
+            ++m_p;
+    }
+
+    bool literal(QByteArrayView word)
+    {
+        if (m_end - m_p < word.size() || QByteArrayView(m_p, word.size()) != word)
+            return false;
+        m_p += word.size();
+        return true;
+    }
+
+    const char *m_p;
+    const char *m_end;
+};
+
+} // namespace
+
+bool ModbusCommand::parse(QByteArrayView payload, ModbusCommand *command, const char **error)
+{
+    Scanner in(payload);
+    qint64 raw[MaxValues];
+    int count = 0;
+    bool haveAddress = false;
+
+    *error = "malformed JSON";
+    if (!in.consume('{'))
+        return false;
+
+    if (!in.consume('}')) {
+        do {
+            QByteArrayView key;
+            if (!in.string(&key) || !in.consume(':'))
+                return false;
+
+            qint64 number = 0;
+            if (key == "type") {
+                QByteArrayView type;
+                if (!in.string(&type))
+                    return false;
+                if (type == "coils") {
+                    command->coils = true;
+                } else if (type == "registers") {
+                    command->coils = false;
+                } else {
+                    *error = "type must be registers or coils";
+                    return false;
+                }
+            } else if (key == "device") {
+                if (!in.integer(&number))
+                    return false;
+                command->deviceId = int(number);
+            } else if (key == "address") {
+                if (!in.integer(&number))
+                    return false;
+                if (number < 0 || number > 65535) {
+                    *error = "address out of range";
+                    return false;
+                }
+                command->address = int(number);
+                haveAddress = true;
+            } else if (key == "value") {
+                if (!in.integer(&raw[0]))
+                    return false;
+                count = 1;
+            } else if (key == "values") {
+                if (!in.consume('['))
+                    return false;
+                count = 0;
+                if (!in.consume(']')) {
+                    do {
+                        if (count == MaxValues) {
+                            *error = "too many values";
+                            return false;
+                        }
+                        if (!in.integer(&raw[count++]))
+                            return false;
+                    } while (in.consume(','));
+                    if (!in.consume(']'))
+                        return false;
+                }
+            } else {
+                *error = "unknown key";
+                return false;
+            }
+        } while (in.consume(','));
+
+        if (!in.consume('}'))
+            return false;
+    }
+    if (!in.atEnd())
+        return false;
+
+    if (!haveAddress || count == 0) {
+        *error = "address and value(s) are required";
+        return false;
+    }
+    if (command->address + count > 65536) {
+        *error = "address out of range";
+        return false;
+    }
+
+    const qint64 min = command->coils ? 0 : -32768;
+    const qint64 max = command->coils ? 1 : 65535;
+    for (int i = 0; i < count; ++i) {
+        if (raw[i] < min || raw[i] > max) {
+            *error = "value out of range";
+            return false;
+        }
+        command->values[i] = quint16(raw[i]);
+    }
+    command->count = count;
+
+    *error = nullptr;
+    return true;
+}
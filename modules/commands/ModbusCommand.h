@@ -0,0 +1,28 @@
+#ifndef __MODBUSCOMMAND_H__
+#define __MODBUSCOMMAND_H__
+
+#include <QByteArrayView>
+
+// One inbound write, parsed from an MQTT command message:
+//   {"device": 1, "type": "registers", "address": 100, "values": [1, 2]}
+// "value": x may replace "values" for a single value. "type" is "registers"
+// (default) or "coils", "device" defaults to 0 (the default connection).
+// Registers take -32768..65535, coils true/false or 0/1.
+// Fixed size, so it travels through a ring without allocating.
+struct ModbusCommand
+{
+    static constexpr int MaxValues = 32;
+
+    qint64 receivedNs = 0;      // PacketTrace clock, on arrival
+    int writeId = 0;
+    int deviceId = 0;
+    int address = 0;
+    int count = 0;
+    bool coils = false;
+    quint16 values[MaxValues] = {};
+
+    // Flat JSON object as above; on failure error points to a static message
+    static bool parse(QByteArrayView payload, ModbusCommand *command, const char **error);
+};
+
+#endif // __MODBUSCOMMAND_H__
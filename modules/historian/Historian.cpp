@@ -0,0 +1,484 @@
+#include "Historian.h"
+#include "Logger.h"
+
+#include <QDir>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const qint64 SegmentBytes = qint64(Historian::BlockSize) * Historian::SegmentBlocks;
+
+bool fsyncHandle(int handle)
+{
+#ifdef Q_OS_WIN
+    return _commit(handle) == 0;
+#else
+    return ::fsync(handle) == 0;
+#endif
+}
+
+} // namespace
+
+Historian::~Historian()
+{
+    close();
+}
+
+Historian::Segment::~Segment()
+{
+    if (base)
+        file.unmap(base);
+    file.close();
+    if (expired && !file.remove())
+        GW_WARN("Historian: cannot remove %1", file.fileName());
+}
+
+bool Historian::open(const QString &dir)
+{
+    close();
+
+    if (!QDir().mkpath(dir)) {
+        GW_ERROR("Historian: cannot create %1", dir);
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_dir = dir;
+
+    if (!loadCatalog()) {
+        locker.unlock();
+        close();
+        return false;
+    }
+
+    const QStringList files = QDir(dir).entryList({ "segment-*.dat" }, QDir::Files, QDir::Name);
+    for (const QString &file : files) {
+        bool ok = false;
+        const int index = file.mid(8, 6).toInt(&ok);
+        if (ok)
+            scanSegment(index);
+    }
+
+    GW_INFO("Historian: %1 series, %2 segments in %3",
+            m_series.size(), int(m_segments.size()), dir);
+    return true;
+}
+
+void Historian::close()
+{
+    if (!isOpen())
+        return;
+
+    sync();
+
+    QMutexLocker locker(&m_mutex);
+    // Unmapped here, or when a running query lets go
+    m_segments.clear();
+    m_catalog.close();
+    m_series.clear();
+    m_ids.clear();
+    m_nextBlock = 0;
+    m_stats = HistorianStats();
+    m_dir.clear();
+}
+
+int Historian::series(const QString &name)
+{
+    const auto it = m_ids.constFind(name);
+    if (it != m_ids.constEnd())
+        return it.value();
+
+    if (!isOpen() || name.isEmpty() || name.contains('\n') || name.contains('\t'))
+        return -1;
+
+    QMutexLocker locker(&m_mutex);
+    const int id = m_series.size();
+    const QByteArray line = QByteArray::number(id) + '\t' + name.toUtf8() + '\n';
+    if (m_catalog.write(line) != line.size() || !m_catalog.flush()) {
+        GW_ERROR("Historian: cannot write %1", m_catalog.fileName());
+        return -1;
+    }
+
+    Series series;
+    series.name = name;
+    m_series.append(series);
+    m_ids.insert(name, id);
+    return id;
+}
+
+int Historian::findSeries(const QString &name) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_ids.value(name, -1);
+}
+
+QStringList Historian::seriesNames() const
+{
+    QMutexLocker locker(&m_mutex);
+    QStringList names;
+    names.reserve(m_series.size());
+    for (const Series &series : m_series)
+        names.append(series.name);
+    return names;
+}
+
+bool Historian::append(int seriesId, qint64 timestampMs, double value)
+{
+    if (seriesId < 0 || seriesId >= m_series.size())
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    Series &series = m_series[seriesId];
+    if (BlockHeader *open = series.open) {
+        if (timestampMs < open->lastTs) {
+            ++m_stats.rejected;
+            return false;
+        }
+
+        const quint32 bits = open->bits;
+        if (SeriesEncoder(open, payload(open), PayloadBits).append(timestampMs, value)) {
+            ++m_stats.samples;
+            m_stats.encodedBits += open->bits - bits;
+            return true;
+        }
+
+        // Full: the next sample starts a new block
+        open->flags |= BlockHeader::Closed;
+        series.open = nullptr;
+    } else if (!series.blocks.isEmpty() && timestampMs < header(series.blocks.last())->lastTs) {
+        ++m_stats.rejected;
+        return false;
+    }
+
+    const quint32 block = allocate(seriesId);
+    if (block == NoBlock)
+        return false;
+
+    BlockHeader *open = header(block);
+    SeriesEncoder(open, payload(open), PayloadBits).start(timestampMs, value);
+    series.blocks.append(block);
+    series.open = open;
+
+    ++m_stats.samples;
+    m_stats.encodedBits += open->bits;
+    return true;
+}
+
+// Any thread: the index is read under m_mutex, the samples decoded without it
+template <typename F>
+void Historian::forEachSample(int seriesId, qint64 fromMs, qint64 toMs, F &&f) const
+{
+    QVector<const BlockHeader *> headers;
+    std::vector<std::shared_ptr<Segment>> mapped;   // kept mapped while decoding
+    std::vector<quint64> tail;                      // copy of the block taking appends
+    {
+        QMutexLocker locker(&m_mutex);
+        if (seriesId < 0 || seriesId >= m_series.size() || fromMs > toMs)
+            return;
+
+        // First block whose samples reach fromMs
+        const Series &series = m_series[seriesId];
+        auto it = std::partition_point(series.blocks.begin(), series.blocks.end(),
+                                       [&](quint32 block) {
+            return header(block)->lastTs < fromMs;
+        });
+
+        for (; it != series.blocks.end(); ++it) {
+            BlockHeader *h = header(*it);
+            if (h->firstTs > toMs)
+                break;
+
+            if (h == series.open) {
+                tail.resize(BlockSize / sizeof(quint64));
+                std::memcpy(tail.data(), h, BlockSize);
+                continue;
+            }
+
+            headers.append(h);
+            const std::shared_ptr<Segment> &segment = m_segments.at(int(*it / SegmentBlocks));
+            if (mapped.empty() || mapped.back() != segment)
+                mapped.push_back(segment);
+        }
+    }
+    // The open block is always the series' last
+    if (!tail.empty())
+        headers.append(reinterpret_cast<const BlockHeader *>(tail.data()));
+
+    for (const BlockHeader *h : std::as_const(headers)) {
+        if (h->firstTs > toMs)
+            return;
+
+        SeriesDecoder decoder(h, reinterpret_cast<const uchar *>(h) + sizeof(BlockHeader));
+        qint64 timestamp;
+        double value;
+        while (decoder.next(&timestamp, &value)) {
+            if (timestamp < fromMs)
+                continue;
+            if (timestamp > toMs || !f(timestamp, value))
+                return;
+        }
+    }
+}
+
+int Historian::query(int seriesId, qint64 fromMs, qint64 toMs, int maxSamples,
+                     QVector<HistorySample> *out) const
+{
+    int count = 0;
+    if (maxSamples <= 0)
+        return count;
+
+    forEachSample(seriesId, fromMs, toMs, [&](qint64 timestamp, double value) {
+        out->append({ timestamp, value });
+        return ++count < maxSamples;
+    });
+    return count;
+}
+
+int Historian::queryDownsampled(int seriesId, qint64 fromMs, qint64 toMs, qint64 bucketMs,
+                                QVector<HistoryBucket> *out) const
+{
+    if (bucketMs <= 0)
+        return 0;
+
+    const int first = out->size();
+    qint64 index = -1;
+    double sum = 0;
+
+    forEachSample(seriesId, fromMs, toMs, [&](qint64 timestamp, double value) {
+        const qint64 at = (timestamp - fromMs) / bucketMs;
+        if (at != index) {
+            if (index >= 0)
+                out->last().mean = sum / out->last().count;
+            out->append({ fromMs + at * bucketMs, value, value, value, value, 0 });
+            index = at;
+            sum = 0;
+        }
+
+        HistoryBucket &bucket = out->last();
+        bucket.min = qMin(bucket.min, value);
+        bucket.max = qMax(bucket.max, value);
+        bucket.last = value;
+        ++bucket.count;
+        sum += value;
+        return true;
+    });
+
+    if (index >= 0)
+        out->last().mean = sum / out->last().count;
+    return out->size() - first;
+}
+
+void Historian::sync()
+{
+    for (auto &entry : m_segments) {
+        if (!fsyncHandle(entry.second->file.handle()))
+            GW_ERROR("Historian: fsync failed on %1", entry.second->file.fileName());
+    }
+}
+
+void Historian::prune(qint64 nowMs)
+{
+    if (!isOpen() || m_retentionMs == 0)
+        return;
+
+    const qint64 cutoff = nowMs - m_retentionMs;
+    QMutexLocker locker(&m_mutex);
+
+    // Oldest first, never the segment new blocks are carved from
+    while (!m_segments.empty()) {
+        const int index = m_segments.begin()->first;
+        if (m_nextBlock == 0 || index >= int((m_nextBlock - 1) / SegmentBlocks))
+            break;
+
+        uchar *base = m_segments.begin()->second->base;
+        const auto blockAt = [base](int i) {
+            return reinterpret_cast<BlockHeader *>(base + qint64(i) * BlockSize);
+        };
+
+        bool expired = true;
+        for (int i = 0; i < SegmentBlocks && expired; ++i) {
+            const BlockHeader *h = blockAt(i);
+            if (h->magic == BlockHeader::Magic && h->count && (h->flags & BlockHeader::Closed))
+                expired = h->lastTs < cutoff;
+        }
+        if (!expired)
+            break;
+
+        // Blocks still taking appends: stale ones are closed, live ones move
+        for (int i = 0; i < SegmentBlocks; ++i) {
+            BlockHeader *h = blockAt(i);
+            if (h->magic != BlockHeader::Magic || (h->flags & BlockHeader::Closed)
+                || int(h->seriesId) >= m_series.size())
+                continue;
+
+            Series &series = m_series[h->seriesId];
+            if (series.open != h)
+                continue;
+
+            series.open = nullptr;
+            if (h->lastTs < cutoff)
+                continue;
+
+            const quint32 moved = allocate(int(h->seriesId));
+            if (moved == NoBlock)
+                return;
+            std::memcpy(header(moved), h, BlockSize);
+            series.blocks.last() = moved;
+            series.open = header(moved);
+        }
+
+        const quint32 end = quint32(index + 1) * SegmentBlocks;
+        for (Series &series : m_series) {
+            int expiredBlocks = 0;
+            while (expiredBlocks < series.blocks.size() && series.blocks[expiredBlocks] < end)
+                ++expiredBlocks;
+            series.blocks.remove(0, expiredBlocks);
+        }
+
+        // Unmapped and removed now, or when a running query lets go
+        m_segments.begin()->second->expired = true;
+        m_segments.erase(m_segments.begin());
+        ++m_stats.prunedSegments;
+    }
+}
+
+HistorianStats Historian::stats() const
+{
+    HistorianStats stats = m_stats;
+    stats.series = m_series.size();
+    stats.segments = int(m_segments.size());
+    stats.diskBytes = qint64(m_segments.size()) * SegmentBytes;
+    for (const Series &series : m_series)
+        stats.blocks += quint64(series.blocks.size());
+    return stats;
+}
+
+BlockHeader *Historian::header(quint32 block) const
+{
+    const auto it = m_segments.find(int(block / SegmentBlocks));
+    Q_ASSERT(it != m_segments.end());
+    return reinterpret_cast<BlockHeader *>(it->second->base
+                                           + qint64(block % SegmentBlocks) * BlockSize);
+}
+
+quint32 Historian::allocate(int seriesId)
+{
+    const quint32 block = m_nextBlock;
+    if (!mapSegment(int(block / SegmentBlocks), true))
+        return NoBlock;
+
+    BlockHeader *h = header(block);
+    std::memset(h, 0, sizeof(BlockHeader));
+    h->seriesId = quint32(seriesId);
+    h->magic = BlockHeader::Magic;
+
+    ++m_nextBlock;
+    return block;
+}
+
+Historian::Segment *Historian::mapSegment(int index, bool create)
+{
+    const auto it = m_segments.find(index);
+    if (it != m_segments.end())
+        return it->second.get();
+
+    auto segment = std::make_shared<Segment>();
+    segment->file.setFileName(segmentPath(index));
+    if (!create && segment->file.size() != SegmentBytes) {
+        GW_WARN("Historian: ignoring %1, unexpected size", segment->file.fileName());
+        return nullptr;
+    }
+
+    // resize() leaves a sparse file; pages are allocated as blocks fill
+    if (!segment->file.open(QIODevice::ReadWrite)
+        || (create && !segment->file.resize(SegmentBytes))) {
+        GW_ERROR("Historian: cannot open segment %1", segment->file.fileName());
+        return nullptr;
+    }
+
+    segment->base = segment->file.map(0, SegmentBytes);
+    if (!segment->base) {
+        GW_ERROR("Historian: cannot map segment %1", segment->file.fileName());
+        return nullptr;
+    }
+
+    Segment *result = segment.get();
+    m_segments.emplace(index, std::move(segment));
+    return result;
+}
+
+QString Historian::segmentPath(int index) const
+{
+    return m_dir + QString("/segment-%1.dat").arg(index, 6, 10, QChar('0'));
+}
+
+bool Historian::loadCatalog()
+{
+    m_catalog.setFileName(m_dir + "/series.txt");
+    if (!m_catalog.open(QIODevice::ReadWrite | QIODevice::Append)) {
+        GW_ERROR("Historian: cannot open %1", m_catalog.fileName());
+        return false;
+    }
+
+    m_catalog.seek(0);
+    while (!m_catalog.atEnd()) {
+        const qint64 pos = m_catalog.pos();
+        const QByteArray line = m_catalog.readLine();
+        const int tab = line.indexOf('\t');
+        bool ok = false;
+        const int id = line.left(tab).toInt(&ok);
+        if (!line.endsWith('\n') || tab <= 0 || !ok || id != m_series.size()) {
+            // A torn last line; cut it off so new entries start clean
+            GW_WARN("Historian: catalog ends at series %1", m_series.size());
+            m_catalog.resize(pos);
+            break;
+        }
+
+        Series series;
+        series.name = QString::fromUtf8(line.mid(tab + 1).chopped(1));
+        m_ids.insert(series.name, id);
+        m_series.append(series);
+    }
+    return true;
+}
+
+// Blocks are carved in order, so a scan in segment order rebuilds every
+// series' block list in time order
+void Historian::scanSegment(int index)
+{
+    Segment *segment = mapSegment(index, false);
+    if (!segment)
+        return;
+
+    m_nextBlock = qMax(m_nextBlock, quint32(index) * SegmentBlocks);
+
+    for (int i = 0; i < SegmentBlocks; ++i) {
+        BlockHeader *h = reinterpret_cast<BlockHeader *>(segment->base + qint64(i) * BlockSize);
+        if (h->magic != BlockHeader::Magic)
+            continue;
+
+        const quint32 block = quint32(index) * SegmentBlocks + quint32(i);
+        m_nextBlock = qMax(m_nextBlock, block + 1);
+
+        // Allocated but never written, or of a series the catalog lost
+        if (h->count == 0 || int(h->seriesId) >= m_series.size())
+            continue;
+
+        Series &series = m_series[h->seriesId];
+        if (!(h->flags & BlockHeader::Closed)) {
+            if (series.open)
+                series.open->flags |= BlockHeader::Closed;
+            series.open = h;
+        }
+        series.blocks.append(block);
+    }
+}
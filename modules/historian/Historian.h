@@ -0,0 +1,150 @@
+#ifndef __HISTORIAN_H__
+#define __HISTORIAN_H__
+
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <map>
+#include <memory>
+
+#include "SeriesCodec.h"
+
+struct HistorySample
+{
+    qint64 timestamp;       // ms since epoch
+    double value;
+};
+
+struct HistoryBucket
+{
+    qint64 timestamp;       // bucket start
+    double min;
+    double max;
+    double mean;
+    double last;
+    int count;
+};
+
+struct HistorianStats
+{
+    int series = 0;
+    int segments = 0;
+    quint64 blocks = 0;
+    qint64 diskBytes = 0;
+    quint64 samples = 0;        // appended since open()
+    quint64 rejected = 0;       // older than the series' last sample
+    quint64 encodedBits = 0;    // of the samples above
+    quint64 prunedSegments = 0;
+};
+
+// On-disk time series store, one series per register or tag.
+// Samples are compressed (SeriesCodec) into fixed-size blocks; blocks are
+// carved in order from memory-mapped segment files, so an append is a few
+// bit writes into the page cache and a restart loses nothing but what the
+// OS had not written back. Each series keeps an in-memory index of its
+// blocks in time order, rebuilt on open() from the block headers.
+//
+//   <dir>/series.txt            "<id>\t<name>" per line, append-only
+//   <dir>/segment-NNNNNN.dat    SegmentBlocks blocks of BlockSize bytes
+//
+// Retention drops whole segments, oldest first. Owned by a single thread,
+// except for findSeries(), seriesNames() and the queries, which may be
+// called from any thread: they copy the slice of the block index they need
+// (and the block still taking appends) under m_mutex, then decode without
+// it. Closed blocks never change, and the copy keeps their segments mapped.
+class Historian
+{
+public:
+    static constexpr int BlockSize = 4096;
+    static constexpr int SegmentBlocks = 4096;      // 16 MiB per segment
+    static constexpr quint32 NoBlock = 0xFFFFFFFF;
+
+    Historian() = default;
+    ~Historian();
+    Historian(const Historian &) = delete;
+    Historian &operator=(const Historian &) = delete;
+
+    bool open(const QString &dir);
+    void close();
+    bool isOpen() const { return !m_dir.isEmpty(); }
+    QString path() const { return m_dir; }
+
+    // Id of the named series, created if needed; -1 if the name is unusable
+    int series(const QString &name);
+    int findSeries(const QString &name) const;
+    QStringList seriesNames() const;
+
+    // Timestamps must not go back within a series; such samples are rejected
+    bool append(int seriesId, qint64 timestampMs, double value);
+
+    // Samples in [fromMs, toMs], oldest first, at most maxSamples.
+    // Returns the number appended to out.
+    int query(int seriesId, qint64 fromMs, qint64 toMs, int maxSamples,
+              QVector<HistorySample> *out) const;
+    // Non-empty buckets of bucketMs starting at fromMs
+    int queryDownsampled(int seriesId, qint64 fromMs, qint64 toMs, qint64 bucketMs,
+                         QVector<HistoryBucket> *out) const;
+
+    // Keep at least retentionMs of history (0 = keep everything)
+    void setRetention(qint64 retentionMs) { m_retentionMs = qMax<qint64>(0, retentionMs); }
+    // Flush the mapped segments to disk
+    void sync();
+    // Drop segments that hold only samples older than the retention
+    void prune(qint64 nowMs);
+
+    HistorianStats stats() const;
+
+private:
+    static constexpr int PayloadBits = (BlockSize - int(sizeof(BlockHeader))) * 8;
+
+    struct Segment
+    {
+        ~Segment();
+
+        QFile file;
+        uchar *base = nullptr;
+        bool expired = false;       // removed once the last reader lets go
+    };
+
+    struct Series
+    {
+        QString name;
+        QVector<quint32> blocks;            // ascending block number == time order
+        BlockHeader *open = nullptr;        // block taking appends
+    };
+
+    BlockHeader *header(quint32 block) const;
+    static uchar *payload(BlockHeader *header)
+    {
+        return reinterpret_cast<uchar *>(header) + sizeof(BlockHeader);
+    }
+
+    quint32 allocate(int seriesId);
+    Segment *mapSegment(int index, bool create);
+    QString segmentPath(int index) const;
+    bool loadCatalog();
+    void scanSegment(int index);
+
+    // Calls f(timestamp, value) for the samples in [fromMs, toMs] until it returns false
+    template <typename F>
+    void forEachSample(int seriesId, qint64 fromMs, qint64 toMs, F &&f) const;
+
+    QString m_dir;
+    QFile m_catalog;
+    QVector<Series> m_series;
+    QHash<QString, int> m_ids;
+    std::map<int, std::shared_ptr<Segment>> m_segments;
+    quint32 m_nextBlock = 0;
+    qint64 m_retentionMs = 0;
+    HistorianStats m_stats;
+
+    // Held by the owner while it changes the index or the open blocks,
+    // by other threads while they read them
+    mutable QMutex m_mutex;
+};
+
+#endif // __HISTORIAN_H__
@@ -0,0 +1,201 @@
+#include "SeriesCodec.h"
+
+#include <cstring>
+
+namespace {
+
+quint64 bitsOf(double value)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    return bits;
+}
+
+double valueOf(quint64 bits)
+{
+    double value;
+    std::memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+bool fits(qint64 value, int bits)
+{
+    const qint64 limit = qint64(1) << (bits - 1);
+    return value >= -limit && value < limit;
+}
+
+} // namespace
+
+void SeriesEncoder::start(qint64 timestampMs, double value)
+{
+    m_header->firstTs = timestampMs;
+    m_header->lastTs = timestampMs;
+    m_header->lastDelta = 0;
+    m_header->lastValue = bitsOf(value);
+    m_header->leading = 0xFF;       // no window yet
+    m_header->trailing = 0;
+
+    m_pos = 0;
+    write(m_header->lastValue, 64);
+    m_header->bits = m_pos;
+    m_header->count = 1;
+}
+
+bool SeriesEncoder::append(qint64 timestampMs, double value)
+{
+    if (int(m_header->bits) + MaxSampleBits > m_capacity)
+        return false;
+
+    const qint64 delta = timestampMs - m_header->lastTs;
+    const qint64 dod = delta - m_header->lastDelta;
+    const quint64 bits = bitsOf(value);
+    const quint64 x = bits ^ m_header->lastValue;
+    m_pos = m_header->bits;
+    quint8 windowLeading = m_header->leading;
+    quint8 windowTrailing = m_header->trailing;
+
+    if (dod == 0 && x == 0) {
+        write(0, 1);
+    } else {
+        write(1, 1);
+
+        if (dod == 0)
+            write(0b0, 1);
+        else if (fits(dod, 7))
+            write((quint64(0b10) << 7) | (quint64(dod) & 0x7F), 2 + 7);
+        else if (fits(dod, 9))
+            write((quint64(0b110) << 9) | (quint64(dod) & 0x1FF), 3 + 9);
+        else if (fits(dod, 12))
+            write((quint64(0b1110) << 12) | (quint64(dod) & 0xFFF), 4 + 12);
+        else {
+            write(0b1111, 4);
+            write(quint64(dod), 64);
+        }
+
+        if (x == 0) {
+            write(0b0, 1);
+        } else {
+            const int leading = qCountLeadingZeroBits(x);
+            const int trailing = qCountTrailingZeroBits(x);
+            if (windowLeading != 0xFF
+                && leading >= windowLeading && trailing >= windowTrailing) {
+                const int length = 64 - windowLeading - windowTrailing;
+                write(0b10, 2);
+                write(x >> windowTrailing, length);
+            } else {
+                const int length = 64 - leading - trailing;
+                write(0b11, 2);
+                write(quint64(leading), 6);
+                write(quint64(length - 1), 6);
+                write(x >> trailing, length);
+                windowLeading = quint8(leading);
+                windowTrailing = quint8(trailing);
+            }
+        }
+    }
+
+    // State after the bits: a crash mid-sample leaves the previous one intact
+    m_header->bits = m_pos;
+    m_header->leading = windowLeading;
+    m_header->trailing = windowTrailing;
+    m_header->lastTs = timestampMs;
+    m_header->lastDelta = delta;
+    m_header->lastValue = bits;
+    ++m_header->count;
+    return true;
+}
+
+// MSB first. Everything past the write position is cleared on entry: the
+// block may hold stale bits of a sample that was never committed.
+void SeriesEncoder::write(quint64 value, int bits)
+{
+    quint32 pos = m_pos;
+    while (bits > 0) {
+        uchar &byte = m_data[pos >> 3];
+        const int used = int(pos & 7);
+        byte &= uchar(0xFF00 >> used);
+
+        const int take = qMin(8 - used, bits);
+        const uchar chunk = uchar((value >> (bits - take)) & ((1u << take) - 1));
+        byte |= uchar(chunk << (8 - used - take));
+
+        pos += quint32(take);
+        bits -= take;
+    }
+    m_pos = pos;
+}
+
+SeriesDecoder::SeriesDecoder(const BlockHeader *header, const uchar *data)
+    : m_data(data),
+    m_left(header->count),
+    m_ts(header->firstTs)
+{
+}
+
+bool SeriesDecoder::next(qint64 *timestampMs, double *value)
+{
+    if (m_left == 0)
+        return false;
+    --m_left;
+
+    if (m_first) {
+        m_first = false;
+        m_value = read(64);
+        *timestampMs = m_ts;
+        *value = valueOf(m_value);
+        return true;
+    }
+
+    if (read(1)) {
+        qint64 dod = 0;
+        if (!read(1))
+            dod = 0;
+        else if (!read(1))
+            dod = readSigned(7);
+        else if (!read(1))
+            dod = readSigned(9);
+        else if (!read(1))
+            dod = readSigned(12);
+        else
+            dod = qint64(read(64));
+        m_delta += dod;
+
+        if (read(1)) {
+            if (read(1)) {
+                m_leading = int(read(6));
+                const int length = int(read(6)) + 1;
+                m_trailing = 64 - m_leading - length;
+                m_value ^= read(length) << m_trailing;
+            } else {
+                m_value ^= read(64 - m_leading - m_trailing) << m_trailing;
+            }
+        }
+    }
+
+    m_ts += m_delta;
+    *timestampMs = m_ts;
+    *value = valueOf(m_value);
+    return true;
+}
+
+quint64 SeriesDecoder::read(int bits)
+{
+    quint64 value = 0;
+    while (bits > 0) {
+        const int used = int(m_pos & 7);
+        const int take = qMin(8 - used, bits);
+        const uint chunk = (uint(m_data[m_pos >> 3]) >> (8 - used - take)) & ((1u << take) - 1);
+        value = (value << take) | chunk;
+
+        m_pos += quint32(take);
+        bits -= take;
+    }
+    return value;
+}
+
+qint64 SeriesDecoder::readSigned(int bits)
+{
+    const quint64 raw = read(bits);
+    const quint64 sign = quint64(1) << (bits - 1);
+    return qint64(raw ^ sign) - qint64(sign);
+}
@@ -0,0 +1,84 @@
+#ifndef __SERIESCODEC_H__
+#define __SERIESCODEC_H__
+
+#include <QtGlobal>
+
+// Fixed-size history block: a header followed by the encoded samples.
+// Host byte order - the files are not meant to move between machines.
+struct BlockHeader
+{
+    static constexpr quint32 Magic = 0x4B4C4248;   // "HBLK"
+    static constexpr quint8 Closed = 0x01;
+
+    quint32 magic;
+    quint32 seriesId;
+    qint64 firstTs;         // ms since epoch
+    qint64 lastTs;
+    // Encoder state after the last sample, so appends resume after a restart
+    qint64 lastDelta;
+    quint64 lastValue;      // bit pattern of the double
+    quint32 count;
+    quint32 bits;           // encoded bits after the header
+    quint8 leading;         // XOR window of the last value change
+    quint8 trailing;
+    quint8 flags;
+    quint8 reserved[13];
+};
+
+static_assert(sizeof(BlockHeader) == 64, "block header layout");
+
+// Per sample, after the first (whose value is stored raw):
+//   0                       same timestamp delta, same value
+//   1 <timestamp> <value>   otherwise
+// timestamp, as delta-of-delta in ms:
+//   0 | 10 +7 bits | 110 +9 bits | 1110 +12 bits | 1111 +64 bits
+// value, XOR with the previous one:
+//   0 | 10 +bits inside the previous window | 11 +6 leading +6 length-1 +bits
+// A steady value polled at a steady period costs one bit per sample.
+class SeriesEncoder
+{
+public:
+    // Worst case for one sample, in bits
+    static constexpr int MaxSampleBits = 1 + 4 + 64 + 2 + 12 + 64;
+
+    // data: the block payload, capacityBits long; header is kept up to date
+    SeriesEncoder(BlockHeader *header, uchar *data, int capacityBits)
+        : m_header(header), m_data(data), m_capacity(capacityBits) {}
+
+    void start(qint64 timestampMs, double value);
+    // false when the block may not hold the sample; the caller starts a new one
+    bool append(qint64 timestampMs, double value);
+
+private:
+    void write(quint64 value, int bits);
+
+    BlockHeader *m_header;
+    uchar *m_data;
+    int m_capacity;
+    quint32 m_pos = 0;      // write position, committed to the header per sample
+};
+
+class SeriesDecoder
+{
+public:
+    SeriesDecoder(const BlockHeader *header, const uchar *data);
+
+    // Next sample; false after header->count samples
+    bool next(qint64 *timestampMs, double *value);
+
+private:
+    quint64 read(int bits);
+    qint64 readSigned(int bits);
+
+    const uchar *m_data;
+    quint32 m_left;
+    quint32 m_pos = 0;
+    bool m_first = true;
+    qint64 m_ts;
+    qint64 m_delta = 0;
+    quint64 m_value = 0;
+    int m_leading = 0;
+    int m_trailing = 0;
+};
+
+#endif // __SERIESCODEC_H__
@@ -0,0 +1,295 @@
+#include "Logger.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QThread>
+
+#include <algorithm>
+#include <cstdio>
+
+std::atomic<int> Logger::s_level { Logger::Info };
+
+QString LogArg::toString() const
+{
+    switch (m_type) {
+    case Bool:
+        return m_int ? QStringLiteral("true") : QStringLiteral("false");
+    case Int:
+        return QString::number(m_int);
+    case UInt:
+        return QString::number(m_uint);
+    case Double:
+        return QString::number(m_double);
+    case String:
+        return m_string;
+    case Bytes:
+        return QString::fromUtf8(m_bytes);
+    case None:
+        break;
+    }
+    return QString();
+}
+
+QString Logger::Record::text() const
+{
+    const QString pattern = QString::fromUtf8(format);
+    switch (argc) {
+    case 1:
+        return pattern.arg(args[0].toString());
+    case 2:
+        return pattern.arg(args[0].toString(), args[1].toString());
+    case 3:
+        return pattern.arg(args[0].toString(), args[1].toString(), args[2].toString());
+    case 4:
+        return pattern.arg(args[0].toString(), args[1].toString(),
+                           args[2].toString(), args[3].toString());
+    default:
+        return pattern;
+    }
+}
+
+// Single-producer (owning thread) / single-consumer (logging thread) ring
+struct Logger::ThreadBuffer
+{
+    std::unique_ptr<Record[]> records { new Record[ThreadBufferSize] };
+    std::atomic<size_t> head { 0 };     // next record to drain
+    std::atomic<size_t> tail { 0 };     // next free slot
+    std::atomic<bool> retired { false };
+};
+
+// Marks the buffer when its thread exits; the logging thread frees it
+// once it is drained
+struct Logger::BufferHolder
+{
+    std::shared_ptr<ThreadBuffer> buffer;
+
+    ~BufferHolder()
+    {
+        if (buffer)
+            buffer->retired.store(true, std::memory_order_release);
+    }
+};
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+{
+    m_thread = QThread::create([this]() { drainLoop(); });
+    m_thread->setObjectName("logger");
+    m_thread->start(QThread::LowPriority);
+}
+
+Logger::~Logger()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+void Logger::setLevel(Level level)
+{
+    s_level.store(int(level), std::memory_order_relaxed);
+}
+
+Logger::Level Logger::level()
+{
+    return Level(s_level.load(std::memory_order_relaxed));
+}
+
+Logger::Level Logger::levelFromString(const QString &name, Level fallback)
+{
+    for (int i = Trace; i <= Off; ++i) {
+        if (name.compare(QLatin1String(levelName(Level(i))), Qt::CaseInsensitive) == 0)
+            return Level(i);
+    }
+    return fallback;
+}
+
+const char *Logger::levelName(Level level)
+{
+    switch (level) {
+    case Trace:   return "trace";
+    case Debug:   return "debug";
+    case Info:    return "info";
+    case Warning: return "warning";
+    case Error:   return "error";
+    case Off:     return "off";
+    }
+    return "?";
+}
+
+void Logger::setConsole(bool enabled)
+{
+    QMutexLocker locker(&m_sinkMutex);
+    m_console = enabled;
+}
+
+bool Logger::setFile(const QString &path)
+{
+    QMutexLocker locker(&m_sinkMutex);
+    m_file.reset();
+    if (path.isEmpty())
+        return true;
+
+    auto file = std::make_unique<QFile>(path);
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+        return false;
+
+    m_file = std::move(file);
+    return true;
+}
+
+int Logger::addSink(Sink sink)
+{
+    QMutexLocker locker(&m_sinkMutex);
+    const int id = m_nextSinkId++;
+    m_sinks.append({ id, std::move(sink) });
+    return id;
+}
+
+void Logger::removeSink(int id)
+{
+    // Waits for a drain in progress, so the sink is not called afterwards
+    QMutexLocker locker(&m_sinkMutex);
+    m_sinks.erase(std::remove_if(m_sinks.begin(), m_sinks.end(),
+                                 [id](const QPair<int, Sink> &s) { return s.first == id; }),
+                  m_sinks.end());
+}
+
+void Logger::flush()
+{
+    if (QThread::currentThread() == m_thread)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    // The next cycle may already be past some rings, the one after is not
+    const quint64 target = m_cycles + 2;
+    while (m_cycles < target && !m_stopping) {
+        m_wake.wakeAll();
+        m_drained.wait(&m_mutex);
+    }
+}
+
+Logger::ThreadBuffer *Logger::threadBuffer()
+{
+    thread_local BufferHolder holder;
+
+    if (!holder.buffer) {
+        holder.buffer = std::make_shared<ThreadBuffer>();
+        QMutexLocker locker(&m_buffersMutex);
+        m_buffers.append(holder.buffer);
+    }
+    return holder.buffer.get();
+}
+
+void Logger::push(Record &&record)
+{
+    ThreadBuffer *buffer = threadBuffer();
+
+    const size_t tail = buffer->tail.load(std::memory_order_relaxed);
+    if (tail - buffer->head.load(std::memory_order_acquire) >= size_t(ThreadBufferSize)) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    record.timeMs = QDateTime::currentMSecsSinceEpoch();
+    buffer->records[tail & (ThreadBufferSize - 1)] = std::move(record);
+    buffer->tail.store(tail + 1, std::memory_order_release);
+}
+
+void Logger::drainLoop()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (;;) {
+        const bool stopping = m_stopping;
+        locker.unlock();
+
+        drain();
+
+        locker.relock();
+        ++m_cycles;
+        m_drained.wakeAll();
+        if (stopping)
+            break;
+        if (!m_stopping)
+            m_wake.wait(&m_mutex, DrainIntervalMs);
+    }
+}
+
+void Logger::drain()
+{
+    QVector<std::shared_ptr<ThreadBuffer>> buffers;
+    {
+        QMutexLocker locker(&m_buffersMutex);
+        buffers = m_buffers;
+    }
+
+    QVector<Record> batch;
+    for (const auto &buffer : std::as_const(buffers)) {
+        const size_t tail = buffer->tail.load(std::memory_order_acquire);
+        size_t head = buffer->head.load(std::memory_order_relaxed);
+        for (; head != tail; ++head) {
+            Record &record = buffer->records[head & (ThreadBufferSize - 1)];
+            batch.append(std::move(record));
+            record = Record();
+        }
+        buffer->head.store(head, std::memory_order_release);
+    }
+
+    // Retired and empty: the owning thread is gone
+    {
+        QMutexLocker locker(&m_buffersMutex);
+        m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(),
+                                       [](const std::shared_ptr<ThreadBuffer> &b) {
+                                           return b->retired.load(std::memory_order_acquire)
+                                                  && b->head.load(std::memory_order_relaxed)
+                                                         == b->tail.load(std::memory_order_acquire);
+                                       }),
+                        m_buffers.end());
+    }
+
+    if (batch.isEmpty())
+        return;
+
+    // Rings are drained one after another; restore the global order
+    std::stable_sort(batch.begin(), batch.end(), [](const Record &a, const Record &b) {
+        return a.timeMs < b.timeMs;
+    });
+
+    QMutexLocker locker(&m_sinkMutex);
+    const bool lines = m_console || m_file;
+
+    for (const Record &record : std::as_const(batch)) {
+        const QString text = record.text();
+
+        if (lines) {
+            const QByteArray line = QDateTime::fromMSecsSinceEpoch(record.timeMs)
+                                        .toString("yyyy-MM-dd hh:mm:ss.zzz ").toUtf8()
+                                    + QByteArray(levelName(record.level)).toUpper()
+                                    + ' ' + text.toUtf8() + '\n';
+            if (m_console)
+                std::fwrite(line.constData(), 1, size_t(line.size()), stderr);
+            if (m_file)
+                m_file->write(line);
+        }
+
+        for (const auto &sink : std::as_const(m_sinks))
+            sink.second(record.level, record.timeMs, text);
+    }
+
+    if (m_console)
+        std::fflush(stderr);
+    if (m_file)
+        m_file->flush();
+}
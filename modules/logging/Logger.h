@@ -0,0 +1,191 @@
+#ifndef __LOGGER_H__
+#define __LOGGER_H__
+
+#include <QByteArray>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <type_traits>
+
+// Compile-time floor (Logger::Level): GW_* calls below it generate no code
+#ifndef IOTGW_LOG_LEVEL
+#define IOTGW_LOG_LEVEL 0
+#endif
+
+#define GW_LOG(level, ...)                                          \
+    do {                                                            \
+        if constexpr (int(level) >= IOTGW_LOG_LEVEL) {              \
+            if (Logger::isEnabled(level))                           \
+                Logger::write(level, __VA_ARGS__);                  \
+        }                                                           \
+    } while (false)
+
+// GW_INFO("Device %1 connected", name): the format must be a string
+// literal; arguments are formatted on the logging thread
+#define GW_TRACE(...) GW_LOG(Logger::Trace, __VA_ARGS__)
+#define GW_DEBUG(...) GW_LOG(Logger::Debug, __VA_ARGS__)
+#define GW_INFO(...)  GW_LOG(Logger::Info, __VA_ARGS__)
+#define GW_WARN(...)  GW_LOG(Logger::Warning, __VA_ARGS__)
+#define GW_ERROR(...) GW_LOG(Logger::Error, __VA_ARGS__)
+
+class QFile;
+class QThread;
+
+// One argument of a deferred record. Numbers are stored as is, QString and
+// QByteArray are implicitly shared; a const char * is copied (e.what()).
+class LogArg
+{
+public:
+    LogArg() = default;
+
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    LogArg(T value)
+    {
+        if constexpr (std::is_same_v<T, bool>) {
+            m_type = Bool;
+            m_int = value;
+        } else if constexpr (std::is_signed_v<T>) {
+            m_type = Int;
+            m_int = qint64(value);
+        } else {
+            m_type = UInt;
+            m_uint = quint64(value);
+        }
+    }
+
+    LogArg(double value) : m_type(Double), m_double(value) {}
+    LogArg(const char *value) : m_type(Bytes), m_bytes(value) {}
+    LogArg(const QString &value) : m_type(String), m_string(value) {}
+    LogArg(const QByteArray &value) : m_type(Bytes), m_bytes(value) {}
+
+    QString toString() const;
+
+private:
+    enum Type { None, Bool, Int, UInt, Double, String, Bytes };
+
+    Type m_type = None;
+    union {
+        qint64 m_int = 0;
+        quint64 m_uint;
+        double m_double;
+    };
+    QString m_string;
+    QByteArray m_bytes;
+};
+
+// Leveled logging off the hot path. GW_* calls append a record (literal
+// format + up to MaxArgs arguments) to a lock-free per-thread ring; a
+// background thread drains the rings every DrainIntervalMs, formats the
+// records and hands them to the console, the log file and the sinks.
+// A full ring drops the record instead of blocking the caller.
+class Logger
+{
+public:
+    enum Level {
+        Trace,
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Off
+    };
+
+    static constexpr int MaxArgs = 4;
+    static constexpr int ThreadBufferSize = 1024;   // records, power of two
+    static constexpr int DrainIntervalMs = 20;
+
+    // Called on the logging thread with the formatted message
+    using Sink = std::function<void(Level level, qint64 timeMs, const QString &text)>;
+
+    static Logger &instance();
+
+    static bool isEnabled(Level level)
+    {
+        return int(level) >= s_level.load(std::memory_order_relaxed);
+    }
+    static void setLevel(Level level);
+    static Level level();
+    static Level levelFromString(const QString &name, Level fallback);
+    static const char *levelName(Level level);
+
+    template <typename... Args>
+    static void write(Level level, const char *format, const Args &...args)
+    {
+        static_assert(sizeof...(Args) <= MaxArgs, "too many log arguments");
+
+        Record record;
+        record.level = level;
+        record.format = format;
+        record.argc = int(sizeof...(Args));
+        int i = 0;
+        ((record.args[i++] = LogArg(args)), ...);
+        Q_UNUSED(i);    // no arguments
+        instance().push(std::move(record));
+    }
+
+    // Timestamped lines on stderr
+    void setConsole(bool enabled);
+    // Appends to path; an empty path closes the file
+    bool setFile(const QString &path);
+    // Returns an id for removeSink()
+    int addSink(Sink sink);
+    void removeSink(int id);
+
+    // Blocks until everything logged before the call has been written
+    void flush();
+
+    // Records lost to full thread rings
+    quint64 dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Record
+    {
+        qint64 timeMs = 0;
+        Level level = Info;
+        const char *format = nullptr;
+        int argc = 0;
+        LogArg args[MaxArgs];
+
+        QString text() const;
+    };
+
+    struct ThreadBuffer;
+    struct BufferHolder;
+
+    Logger();
+    ~Logger();
+
+    ThreadBuffer *threadBuffer();
+    void push(Record &&record);
+    void drainLoop();
+    void drain();
+
+    static std::atomic<int> s_level;
+
+    QMutex m_buffersMutex;
+    QVector<std::shared_ptr<ThreadBuffer>> m_buffers;
+    std::atomic<quint64> m_dropped { 0 };
+
+    // Drain thread state
+    QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_drained;
+    quint64 m_cycles = 0;
+    bool m_stopping = false;
+    QThread *m_thread = nullptr;
+
+    // Outputs (m_sinkMutex)
+    QMutex m_sinkMutex;
+    bool m_console = false;
+    std::unique_ptr<QFile> m_file;
+    QVector<QPair<int, Sink>> m_sinks;
+    int m_nextSinkId = 1;
+};
+
+#endif // __LOGGER_H__
@@ -0,0 +1,179 @@
+#include "LogModel.h"
+
+#include <QDateTime>
+
+LogModel::LogModel(int capacity, QObject *parent)
+    : QAbstractListModel(parent)
+{
+    capacity = qMax(1, capacity);
+    m_rows.resize(capacity);
+    m_pending.resize(capacity);
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FlushIntervalMs);
+    connect(&m_flushTimer, &QTimer::timeout, this, &LogModel::flush);
+}
+
+void LogModel::append(const QString &text)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const int capacity = int(m_pending.size());
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_hasLast && m_lastText == text) {
+        // The newest line is either the last pending one or the last row
+        if (m_pendingSize > 0) {
+            Entry &last = m_pending[(m_pendingFirst + m_pendingSize - 1) % capacity];
+            ++last.count;
+            last.timeMs = now;
+        } else {
+            ++m_lastRepeats;
+        }
+    } else {
+        if (m_pendingSize == capacity) {
+            m_pending[m_pendingFirst] = Entry();
+            m_pendingFirst = (m_pendingFirst + 1) % capacity;
+            --m_pendingSize;
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        Entry &entry = m_pending[(m_pendingFirst + m_pendingSize) % capacity];
+        entry.timeMs = now;
+        entry.text = text;
+        entry.count = 1;
+        ++m_pendingSize;
+        m_lastText = text;
+        m_hasLast = true;
+    }
+
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, [this]() { m_flushTimer.start(); },
+                                  Qt::QueuedConnection);
+    }
+}
+
+void LogModel::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (int i = 0; i < m_pendingSize; ++i)
+        m_pending[(m_pendingFirst + i) % m_pending.size()] = Entry();
+    m_pendingFirst = 0;
+    m_pendingSize = 0;
+    m_lastText.clear();
+    m_hasLast = false;
+    m_lastRepeats = 0;
+    m_clearPending = true;
+
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        QMetaObject::invokeMethod(this, [this]() { m_flushTimer.start(); },
+                                  Qt::QueuedConnection);
+    }
+}
+
+// GUI thread, at most once per FlushIntervalMs
+void LogModel::flush()
+{
+    const int capacity = int(m_rows.size());
+
+    QVector<Entry> batch;
+    int repeats = 0;
+    bool clearRows = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        batch.reserve(m_pendingSize);
+        for (int i = 0; i < m_pendingSize; ++i) {
+            Entry &entry = m_pending[(m_pendingFirst + i) % capacity];
+            batch.append(std::move(entry));
+            entry = Entry();
+        }
+        m_pendingFirst = 0;
+        m_pendingSize = 0;
+        repeats = m_lastRepeats;
+        m_lastRepeats = 0;
+        clearRows = m_clearPending;
+        m_clearPending = false;
+        m_flushScheduled = false;
+    }
+
+    if (clearRows) {
+        beginResetModel();
+        for (int i = 0; i < m_size; ++i)
+            m_rows[(m_first + i) % capacity] = Entry();
+        m_first = 0;
+        m_size = 0;
+        endResetModel();
+    }
+
+    if (repeats > 0 && m_size > 0) {
+        Entry &last = m_rows[(m_first + m_size - 1) % capacity];
+        last.count += repeats;
+        last.timeMs = QDateTime::currentMSecsSinceEpoch();
+        const QModelIndex idx = index(m_size - 1);
+        emit dataChanged(idx, idx, { TimeRole, CountRole });
+    }
+
+    const int n = int(batch.size());
+    if (n == capacity) {
+        beginResetModel();
+        for (int i = 0; i < n; ++i)
+            m_rows[i] = std::move(batch[i]);
+        m_first = 0;
+        m_size = n;
+        endResetModel();
+    } else if (n > 0) {
+        const int overflow = m_size + n - capacity;
+        if (overflow > 0) {
+            beginRemoveRows(QModelIndex(), 0, overflow - 1);
+            for (int i = 0; i < overflow; ++i)
+                m_rows[(m_first + i) % capacity] = Entry();
+            m_first = (m_first + overflow) % capacity;
+            m_size -= overflow;
+            endRemoveRows();
+        }
+
+        beginInsertRows(QModelIndex(), m_size, m_size + n - 1);
+        for (int i = 0; i < n; ++i)
+            m_rows[(m_first + m_size + i) % capacity] = std::move(batch[i]);
+        m_size += n;
+        endInsertRows();
+    }
+
+    if (clearRows || n > 0)
+        emit countChanged();
+}
+
+int LogModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_size;
+}
+
+QVariant LogModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_size)
+        return QVariant();
+
+    const Entry &entry = m_rows[(m_first + index.row()) % m_rows.size()];
+    switch (role) {
+    case TimeRole:
+        return QDateTime::fromMSecsSinceEpoch(entry.timeMs).toString("hh:mm:ss");
+    case Qt::DisplayRole:
+    case TextRole:
+        return entry.text;
+    case CountRole:
+        return entry.count;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> LogModel::roleNames() const
+{
+    return {
+        { TimeRole, "time" },
+        { TextRole, "text" },
+        { CountRole, "count" },
+    };
+}
@@ -0,0 +1,78 @@
+#ifndef __LOGMODEL_H__
+#define __LOGMODEL_H__
+
+#include <QAbstractListModel>
+#include <QMutex>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+#include <atomic>
+
+// Log view model: the newest 'capacity' lines in a fixed ring.
+// append() may be called from any thread. Lines are collected in a
+// bounded pending ring and handed to the view at most once per frame;
+// a line equal to the previous one only bumps its repeat counter.
+class LogModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+    // Lines lost because more than 'capacity' arrived within one frame
+    Q_PROPERTY(quint64 dropped READ dropped NOTIFY countChanged)
+
+public:
+    enum Roles {
+        TimeRole = Qt::UserRole + 1,    // "hh:mm:ss"
+        TextRole,
+        CountRole                       // >= 1
+    };
+
+    static constexpr int DefaultCapacity = 2000;
+    static constexpr int FlushIntervalMs = 16;
+
+    explicit LogModel(int capacity = DefaultCapacity, QObject *parent = nullptr);
+
+    Q_INVOKABLE void append(const QString &text);
+    Q_INVOKABLE void clear();
+
+    quint64 dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+signals:
+    void countChanged();
+
+private:
+    struct Entry
+    {
+        qint64 timeMs = 0;
+        QString text;
+        int count = 1;
+    };
+
+    void flush();
+
+    // Rows (GUI thread): m_rows[(m_first + i) % capacity]
+    QVector<Entry> m_rows;
+    int m_first = 0;
+    int m_size = 0;
+
+    // Pending lines (any thread, m_mutex)
+    QMutex m_mutex;
+    QVector<Entry> m_pending;
+    int m_pendingFirst = 0;
+    int m_pendingSize = 0;
+    QString m_lastText;                 // newest line, committed or pending
+    bool m_hasLast = false;
+    int m_lastRepeats = 0;              // repeats of the newest committed row
+    bool m_clearPending = false;
+    bool m_flushScheduled = false;
+
+    std::atomic<quint64> m_dropped { 0 };
+    QTimer m_flushTimer;
+};
+
+#endif // __LOGMODEL_H__
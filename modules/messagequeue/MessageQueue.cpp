@@ -1,122 +1,559 @@
 #include "MessageQueue.h"
-#include <QFile>
-#include <QJsonArray>
-#include <QJsonObject>
-#include <QJsonDocument>
+#include "Logger.h"
+#include <QDeadlineTimer>
 
-void MessageQueue::push(const MqttPacket& packet)
+MessageQueue::MessageQueue(int capacity)
+    : m_ring(capacity),
+    m_maxPackets(m_ring.capacity())
 {
-    QMutexLocker locker(&m_mutex);
+}
 
-    if (m_stopped)
-        return;
-    m_queue.append(packet);
-    m_wait.wakeOne();
+bool MessageQueue::push(const MqttPacket& packet)
+{
+    if (m_stopped.load(std::memory_order_acquire))
+        return false;
+
+    // While the list still holds packets everything goes there, so that
+    // nothing overtakes them through the ring
+    if (m_coalescing.load(std::memory_order_acquire)
+        || m_coalescedCount.load(std::memory_order_acquire) > 0)
+        return pushCoalesced(packet);
+
+    const qint64 bytes = packet.payload.size();
+    if (!reserve(bytes))
+        return false;
+
+    MqttPacket queued = packet;
+    queued.trace.enqueuedNs = PacketTrace::now();
+
+    bool pushed = false;
+    if (m_persistent.load(std::memory_order_acquire)) {
+        // Enqueue and log under one lock so ring order == log order; the
+        // record is written only once the ring took the packet
+        QMutexLocker locker(&m_persistMutex);
+        queued.seq = m_wal->reserveSeq();
+        pushed = m_ring.tryPush(queued);
+        if (pushed && queued.seq != 0)
+            m_wal->write(queued);
+    }
+    else {
+        pushed = m_ring.tryPush(std::move(queued));
+    }
+
+    if (!pushed) {
+        m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        m_droppedNewest.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    updateBackpressure();
+    wakeConsumer();
+    return true;
 }
 
 bool MessageQueue::waitAndPop(MqttPacket& packet)
 {
-    QMutexLocker locker(&m_mutex);
+    for (;;) {
+        if (m_stopped.load(std::memory_order_acquire))
+            return false;
+
+        if (tryPop(packet))
+            return true;
+
+        // Park only when there is nothing to take. The flag is raised under
+        // the mutex before re-checking, so a producer that sees it cannot
+        // signal before we are actually waiting.
+        QMutexLocker locker(&m_mutex);
+        m_sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
 
-    while (m_queue.isEmpty() && !m_stopped)
-        m_wait.wait(&m_mutex);
+        if (!m_stopped.load() && isEmpty())
+            m_wait.wait(&m_mutex);
+
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+}
 
-    if (m_stopped)
+bool MessageQueue::waitAndPop(MqttPacket& packet, int timeoutMs)
+{
+    if (m_stopped.load(std::memory_order_acquire))
         return false;
-    packet = m_queue.takeFirst();
-    return true;
+
+    if (tryPop(packet))
+        return true;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!m_stopped.load() && !m_interrupted && isEmpty())
+            m_wait.wait(&m_mutex, QDeadlineTimer(qMax(0, timeoutMs)));
+
+        m_interrupted = false;
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    return !m_stopped.load(std::memory_order_acquire) && tryPop(packet);
 }
 
-void MessageQueue::returnBack(const MqttPacket& packet)
+void MessageQueue::interrupt()
 {
     QMutexLocker locker(&m_mutex);
+    m_interrupted = true;
+    m_wait.wakeAll();
+}
 
-    if (m_stopped)
+void MessageQueue::returnBack(const MqttPacket& packet)
+{
+    if (m_stopped.load(std::memory_order_acquire))
         return;
 
-    m_queue.prepend(packet);
-    m_wait.wakeOne();
+    // Already admitted once: returned packets are not subject to the limits
+    m_bytes.fetch_add(packet.payload.size(), std::memory_order_relaxed);
+    {
+        QMutexLocker locker(&m_returnedMutex);
+        m_returned.prepend(packet);
+        m_returnedCount.fetch_add(1, std::memory_order_release);
+    }
+    updateBackpressure();
+    wakeConsumer();
+}
+
+bool MessageQueue::pushCoalesced(const MqttPacket& packet)
+{
+    const qint64 bytes = packet.payload.size();
+    bool reserved = false;
+
+    for (;;)
+    {
+        QMutexLocker locker(&m_coalesceMutex);
+
+        auto found = packet.coalesceKey ? m_coalesceIndex.find(packet.coalesceKey)
+                                        : m_coalesceIndex.end();
+        const bool replace = found != m_coalesceIndex.end()
+                             && found.value()->topicId == packet.topicId;
+
+        // Only a new entry needs room; reserve() may block, so not under the lock
+        if (!replace && !reserved) {
+            locker.unlock();
+            if (!reserve(bytes))
+                return false;
+            reserved = true;
+            continue;
+        }
+
+        MqttPacket queued = packet;
+        queued.trace.enqueuedNs = PacketTrace::now();
+
+        // Appended under the list lock: list order == log order
+        if (m_persistent.load(std::memory_order_acquire))
+            queued.seq = m_wal->append(queued);
+
+        qint64 superseded = -1;
+        if (replace) {
+            superseded = found.value()->payload.size();
+            m_coalesced.erase(found.value());
+            m_coalescedTotal.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            m_coalescedCount.fetch_add(1, std::memory_order_release);
+        }
+
+        m_coalesced.push_back(std::move(queued));
+        if (packet.coalesceKey)
+            m_coalesceIndex.insert(packet.coalesceKey, std::prev(m_coalesced.end()));
+
+        if (!reserved)
+            m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        locker.unlock();
+
+        if (superseded >= 0)
+            released(superseded);
+        break;
+    }
+
+    updateBackpressure();
+    wakeConsumer();
+    return true;
+}
+
+bool MessageQueue::popCoalesced(MqttPacket& packet)
+{
+    if (m_coalescedCount.load(std::memory_order_acquire) == 0)
+        return false;
+
+    QMutexLocker locker(&m_coalesceMutex);
+    if (m_coalesced.empty())
+        return false;
+
+    const auto head = m_coalesced.begin();
+    if (head->coalesceKey) {
+        auto it = m_coalesceIndex.find(head->coalesceKey);
+        if (it != m_coalesceIndex.end() && it.value() == head)
+            m_coalesceIndex.erase(it);
+    }
+
+    packet = std::move(*head);
+    m_coalesced.pop_front();
+    m_coalescedCount.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+void MessageQueue::setCoalescing(bool enabled)
+{
+    m_coalescing.store(enabled, std::memory_order_release);
+}
+
+quint64 MessageQueue::coalesceKey(quint32 topicId, int deviceId, int start, int count)
+{
+    static_assert(TopicTable::MaxTopics <= 0x8000, "topic id must fit in 15 bits");
+    return (quint64(1) << 63)
+           | (quint64(topicId & 0x7FFF) << 48)
+           | (quint64(quint16(deviceId)) << 32)
+           | (quint64(quint16(start)) << 16)
+           | quint64(quint16(count));
 }
 
 int MessageQueue::size() const
 {
-    QMutexLocker locker(&m_mutex);
-    return m_queue.size();
+    return m_ring.size() + m_returnedCount.load(std::memory_order_acquire)
+           + m_coalescedCount.load(std::memory_order_acquire);
+}
+
+int MessageQueue::capacity() const
+{
+    return m_ring.capacity();
+}
+
+void MessageQueue::setLimits(int maxPackets, qint64 maxBytes)
+{
+    m_maxPackets.store(qBound(1, maxPackets, capacity()), std::memory_order_relaxed);
+    m_maxBytes.store(maxBytes, std::memory_order_relaxed);
+
+    // Raised limits may let blocked producers through
+    {
+        QMutexLocker locker(&m_spaceMutex);
+        m_spaceCond.wakeAll();
+    }
+    updateBackpressure();
+}
+
+void MessageQueue::setOverflowPolicy(OverflowPolicy policy, int blockTimeoutMs)
+{
+    m_policy.store(policy, std::memory_order_relaxed);
+    m_blockTimeoutMs.store(qMax(0, blockTimeoutMs), std::memory_order_relaxed);
+}
+
+void MessageQueue::setBackpressureHandler(BackpressureHandler handler,
+                                          double high, double low)
+{
+    m_backpressureHandler = std::move(handler);
+    m_highWatermark = high;
+    m_lowWatermark = qMin(low, high);
+}
+
+MessageQueueStats MessageQueue::stats() const
+{
+    MessageQueueStats s;
+    s.size = size();
+    s.bytes = m_bytes.load(std::memory_order_relaxed);
+    s.droppedOldest = m_droppedOldest.load(std::memory_order_relaxed);
+    s.droppedNewest = m_droppedNewest.load(std::memory_order_relaxed);
+    s.blockTimeouts = m_blockTimeouts.load(std::memory_order_relaxed);
+    s.coalesced = m_coalescedTotal.load(std::memory_order_relaxed);
+    s.backpressure = m_backpressure.load(std::memory_order_relaxed);
+    return s;
 }
 
 void MessageQueue::stop()
 {
+    m_stopped.store(true);
+
+    {
+        QMutexLocker locker(&m_spaceMutex);
+        m_spaceCond.wakeAll();
+    }
+
     QMutexLocker locker(&m_mutex);
-    m_stopped = true;
     m_wait.wakeAll();
 }
 
-void MessageQueue::reset()
+void MessageQueue::resume()
 {
-    QMutexLocker locker(&m_mutex);
-    m_stopped = false;
-    m_queue.clear();
-    m_wait.wakeAll();
+    m_stopped.store(false);
 }
 
-void MessageQueue::enablePersistence(const QString& path)
+void MessageQueue::clear()
 {
-    QMutexLocker locker(&m_mutex);
-    m_persistenceEnabled = true;
-    m_persistPath = path;
+    drain();
+
+    if (m_persistent.load(std::memory_order_acquire)) {
+        QMutexLocker locker(&m_ackMutex);
+        m_outstanding.clear();
+        m_wal->acknowledgeAll();
+    }
 }
 
-void MessageQueue::saveToDisk()
+void MessageQueue::acknowledge(quint64 seq)
+{
+    if (seq == 0 || !m_persistent.load(std::memory_order_acquire))
+        return;
+
+    QMutexLocker locker(&m_ackMutex);
+    if (m_outstanding.erase(seq))
+        advanceCheckpoint();
+}
+
+// m_ackMutex held. Everything up to m_poppedSeq has left the queue, and of
+// that only m_outstanding is still waiting for delivery.
+void MessageQueue::advanceCheckpoint()
+{
+    quint64 done = m_poppedSeq;
+    if (!m_outstanding.empty())
+        done = qMin(done, *m_outstanding.begin() - 1);
+    m_wal->acknowledge(done);
+}
+
+bool MessageQueue::tryPop(MqttPacket& packet)
+{
+    if (m_returnedCount.load(std::memory_order_acquire) > 0) {
+        QMutexLocker locker(&m_returnedMutex);
+        if (!m_returned.isEmpty()) {
+            packet = m_returned.takeFirst();
+            m_returnedCount.fetch_sub(1, std::memory_order_release);
+            locker.unlock();
+            released(packet.payload.size());
+            // Its seq was never acknowledged, nothing to track again
+            return true;
+        }
+    }
+
+    if (!popQueued(packet, true))
+        return false;
+
+    released(packet.payload.size());
+    return true;
+}
+
+// The ring only holds packets from before coalescing was switched on.
+// Ring and list order is log order, so with persistence the pop and the
+// bookkeeping happen under one lock: m_poppedSeq never gets ahead of a
+// packet that left the queue but is not in m_outstanding yet.
+bool MessageQueue::popQueued(MqttPacket& packet, bool outstanding)
 {
-    if (!m_persistenceEnabled)
+    if (!m_persistent.load(std::memory_order_acquire))
+        return m_ring.tryPop(packet) || popCoalesced(packet);
+
+    QMutexLocker locker(&m_ackMutex);
+    if (!m_ring.tryPop(packet) && !popCoalesced(packet))
+        return false;
+
+    if (packet.seq != 0) {
+        m_poppedSeq = qMax(m_poppedSeq, packet.seq);
+        if (outstanding)
+            m_outstanding.insert(packet.seq);
+        advanceCheckpoint();
+    }
+    return true;
+}
+
+bool MessageQueue::isEmpty() const
+{
+    return m_ring.size() == 0
+           && m_returnedCount.load(std::memory_order_acquire) == 0
+           && m_coalescedCount.load(std::memory_order_acquire) == 0;
+}
+
+void MessageQueue::wakeConsumer()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!m_sleeping.load(std::memory_order_relaxed))
         return;
 
     QMutexLocker locker(&m_mutex);
+    m_wait.wakeOne();
+}
+
+bool MessageQueue::hasRoom(qint64 bytes) const
+{
+    const int count = size();
+    if (count >= m_maxPackets.load(std::memory_order_relaxed))
+        return false;
+
+    // A single packet bigger than the byte limit still fits into an empty queue
+    const qint64 maxBytes = m_maxBytes.load(std::memory_order_relaxed);
+    return maxBytes <= 0 || count == 0
+           || m_bytes.load(std::memory_order_relaxed) + bytes <= maxBytes;
+}
 
-    QJsonArray arr;
-    for (const auto& p : m_queue)
+bool MessageQueue::reserve(qint64 bytes)
+{
+    QDeadlineTimer deadline;
+    bool waiting = false;
+
+    for (;;)
     {
-        QJsonObject obj;
-        obj["id"] = p.id;
-        obj["timestamp"] = QString::number(p.timestamp);
-        obj["topic"] = p.topic;
-        obj["payload"] = p.payload;
-        obj["retryCount"] = p.retryCount;
-        arr.append(obj);
+        if (hasRoom(bytes)) {
+            m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+            return true;
+        }
+
+        const auto policy = OverflowPolicy(m_policy.load(std::memory_order_relaxed));
+
+        if (policy == DropOldest && dropOldest())
+            continue;
+
+        if (policy == Block) {
+            if (!waiting) {
+                deadline = QDeadlineTimer(m_blockTimeoutMs.load(std::memory_order_relaxed));
+                waiting = true;
+            }
+
+            // Same handshake as the consumer: announce, then re-check under the mutex
+            QMutexLocker locker(&m_spaceMutex);
+            m_blockedProducers.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            bool woken = true;
+            if (!m_stopped.load() && !hasRoom(bytes))
+                woken = m_spaceCond.wait(&m_spaceMutex, deadline);
+            m_blockedProducers.fetch_sub(1);
+
+            if (m_stopped.load())
+                return false;
+            if (woken || hasRoom(bytes))
+                continue;
+
+            m_blockTimeouts.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        m_droppedNewest.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
+}
 
-    QJsonDocument doc(arr);
-    QFile file(m_persistPath);
-    if (file.open(QIODevice::WriteOnly))
-        file.write(doc.toJson());
+bool MessageQueue::dropOldest()
+{
+    // Only queued packets are evicted; returned ones are mid-retry
+    MqttPacket oldest;
+    if (!popQueued(oldest, false))
+        return false;
+
+    m_droppedOldest.fetch_add(1, std::memory_order_relaxed);
+    released(oldest.payload.size());
+    return true;
 }
 
-void MessageQueue::loadFromDisk()
+void MessageQueue::released(qint64 bytes)
 {
-    if (!m_persistenceEnabled)
+    m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    updateBackpressure();
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_blockedProducers.load(std::memory_order_relaxed) == 0)
         return;
 
-    QMutexLocker locker(&m_mutex);
+    QMutexLocker locker(&m_spaceMutex);
+    m_spaceCond.wakeAll();
+}
 
-    QFile file(m_persistPath);
-    if (!file.open(QIODevice::ReadOnly))
+void MessageQueue::updateBackpressure()
+{
+    if (!m_backpressureHandler)
         return;
 
-    QByteArray data = file.readAll();
-    QJsonDocument doc = QJsonDocument::fromJson(data);
-    if (!doc.isArray())
+    const double packets = double(size())
+                           / qMax(1, m_maxPackets.load(std::memory_order_relaxed));
+    const qint64 maxBytes = m_maxBytes.load(std::memory_order_relaxed);
+    const double bytes = maxBytes > 0
+                         ? double(m_bytes.load(std::memory_order_relaxed)) / double(maxBytes)
+                         : 0.0;
+    const double fill = qMax(packets, bytes);
+
+    // Hysteresis; the CAS makes sure each transition is reported once
+    bool active = m_backpressure.load(std::memory_order_relaxed);
+    if (!active && fill >= m_highWatermark) {
+        if (m_backpressure.compare_exchange_strong(active, true))
+            m_backpressureHandler(true);
+    }
+    else if (active && fill <= m_lowWatermark) {
+        if (m_backpressure.compare_exchange_strong(active, false))
+            m_backpressureHandler(false);
+    }
+}
+
+void MessageQueue::drain()
+{
+    MqttPacket p;
+    while (tryPop(p))
+        ;
+}
+
+void MessageQueue::enablePersistence(const QString& path)
+{
+    QMutexLocker locker(&m_persistMutex);
+    m_persistPath = path;
+}
+
+void MessageQueue::setSyncInterval(int ms)
+{
+    QMutexLocker locker(&m_persistMutex);
+    m_syncIntervalMs = ms;
+    if (m_wal)
+        m_wal->setSyncInterval(ms);
+}
+
+void MessageQueue::saveToDisk()
+{
+    QMutexLocker locker(&m_persistMutex);
+    if (m_wal)
+        m_wal->sync();
+}
+
+void MessageQueue::loadFromDisk()
+{
+    QMutexLocker locker(&m_persistMutex);
+
+    if (m_persistPath.isEmpty() || m_wal)
+        return;
+
+    auto wal = std::make_unique<WriteAheadLog>(m_persistPath);
+    wal->setSyncInterval(m_syncIntervalMs);
+
+    QList<MqttPacket> recovered;
+    if (!wal->open(&recovered))
         return;
 
-    QJsonArray arr = doc.array();
-    for (const auto& v : arr)
+    int restored = 0;
+    for (const auto& p : recovered)
     {
-        QJsonObject obj = v.toObject();
-        MqttPacket p;
-        p.id = obj["id"].toString();
-        p.timestamp = obj["timestamp"].toString().toLongLong();
-        p.topic = obj["topic"].toString();
-        p.payload = obj["payload"].toString();
-        p.retryCount = obj["retryCount"].toInt();
-        m_queue.append(p);
+        if (!m_ring.tryPush(p))
+            break;
+        m_bytes.fetch_add(p.payload.size(), std::memory_order_relaxed);
+        ++restored;
+    }
+
+    // What the ring cannot take waits in the list behind it, in log order;
+    // new packets queue after it (see push()). Nothing recovered is dropped:
+    // the checkpoint must not pass a record that was never queued
+    if (restored < recovered.size()) {
+        QMutexLocker listLocker(&m_coalesceMutex);
+        for (qsizetype i = restored; i < recovered.size(); ++i) {
+            m_bytes.fetch_add(recovered[i].payload.size(), std::memory_order_relaxed);
+            m_coalesced.push_back(recovered[i]);
+        }
+        m_coalescedCount.fetch_add(int(recovered.size() - restored), std::memory_order_release);
+
+        GW_WARN("MessageQueue: %1 recovered packets over capacity, queued after the ring",
+                recovered.size() - restored);
+        restored = int(recovered.size());
+    }
+
+    m_wal = std::move(wal);
+    m_persistent.store(true, std::memory_order_release);
+
+    if (restored > 0) {
+        updateBackpressure();
+        wakeConsumer();
     }
 }
@@ -5,62 +5,221 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <QList>
-#include <QUuid>
+#include <QHash>
 #include <QDateTime>
 
+#include <atomic>
+#include <functional>
+#include <list>
+#include <set>
+
+#include "RingBuffer.h"
+#include "WriteAheadLog.h"
+#include "PacketTrace.h"
+#include "PacketPayload.h"
+#include "TopicTable.h"
+
+// 96 bytes, two of them pointers-worth of heap: the topic is an id into the
+// interned TopicTable and the payload a pooled, shared block. Copying a
+// packet through the ring, the retry schedule and the in-flight map costs
+// one atomic increment and no allocation.
 struct MqttPacket
 {
-    QString id;            // уникальный идентификатор
-    qint64 timestamp;      // время создания (ms since epoch)
-    QString topic;
-    QString payload;
-    int retryCount = 0;    // количество попыток отправки
+    quint64 id = 0;            // уникальный идентификатор, монотонный в процессе
+    qint64 timestamp = 0;      // время создания (ms since epoch)
+    PacketPayload payload;     // never modified after creation
+    quint64 seq = 0;           // WAL sequence number (0 = not logged)
+    quint64 coalesceKey = 0;   // newer packet with the same key supersedes (0 = never)
+    quint64 routeKey = 0;      // packets with equal keys keep their order (0 = by topic)
+    PacketTrace trace;         // monotonic stage stamps
+    quint32 topicId = 0;       // TopicTable id
+    int retryCount = 0;        // количество попыток отправки
 
     MqttPacket() = default;
 
-    MqttPacket(const QString& t, const QString& p)
-        : id(QUuid::createUuid().toString(QUuid::WithoutBraces)),
+    MqttPacket(quint32 topic, QByteArrayView bytes)
+        : id(nextId()),
         timestamp(QDateTime::currentMSecsSinceEpoch()),
-        topic(t),
-        payload(p)
+        payload(PacketPayload::copy(bytes)),
+        topicId(topic)
+    {}
+
+    // Interns the topic - hot paths keep the id and use the constructor above
+    MqttPacket(const QString& topic, QByteArrayView bytes)
+        : MqttPacket(TopicTable::intern(topic), bytes)
     {}
+
+    const QString& topic() const { return TopicTable::name(topicId); }
+
+    static quint64 nextId()
+    {
+        static std::atomic<quint64> counter { 0 };
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
 };
 
+struct MessageQueueStats
+{
+    int size = 0;
+    qint64 bytes = 0;               // payload bytes held
+    quint64 droppedOldest = 0;      // evicted to make room (DropOldest)
+    quint64 droppedNewest = 0;      // rejected on push (DropNewest, ring full)
+    quint64 blockTimeouts = 0;      // Block policy gave up waiting
+    quint64 coalesced = 0;          // packets superseded in coalescing mode
+    bool backpressure = false;
+};
+
+// Multi-producer / single-consumer queue on top of a lock-free ring.
+// push() never takes a lock; waitAndPop() only sleeps when the ring is empty.
+// The queue is bounded in packets and payload bytes; what happens to a push
+// that does not fit is decided by the overflow policy.
 class MessageQueue
 {
 public:
-    MessageQueue() = default;
+    static constexpr int DefaultCapacity = 4096;
+    static constexpr qint64 DefaultMaxBytes = 16 * 1024 * 1024;
+
+    enum OverflowPolicy {
+        DropNewest,     // reject the new packet
+        DropOldest,     // evict from the head until it fits
+        Block           // wait for the consumer up to the block timeout, then reject
+    };
 
-    // Add new msg
-    void push(const MqttPacket& packet);
+    // Called on the pushing/popping thread when the fill level crosses the
+    // high (on) or low (off) watermark
+    using BackpressureHandler = std::function<void(bool active)>;
 
-    // Blocking extraction
+    explicit MessageQueue(int capacity = DefaultCapacity);
+
+    // Add new msg. Returns false if the queue is full or stopped
+    bool push(const MqttPacket& packet);
+
+    // Blocking extraction (consumer thread only)
     bool waitAndPop(MqttPacket& packet);
+    // Waits at most timeoutMs; also returns (false) early on interrupt()
+    bool waitAndPop(MqttPacket& packet, int timeoutMs);
+    // Wakes a consumer parked in the timed waitAndPop()
+    void interrupt();
 
-    // Revert a message (for example, after a sending error)
+    // Revert a message (for example, after a sending error). Its seq stays
+    // unacknowledged, so its log record is kept until it is delivered.
     void returnBack(const MqttPacket& packet);
 
+    // Consumer is done with a popped packet: delivered, or given up on.
+    // Pops no longer advance the log checkpoint; it follows the oldest
+    // packet that was popped and not yet acknowledged.
+    void acknowledge(quint64 seq);
+
     // Current queue size
     int size() const;
+    int capacity() const;
+
+    // Limits; maxPackets is clamped to capacity(), maxBytes <= 0 = no byte limit.
+    // Limits are soft by at most one packet per concurrent producer.
+    void setLimits(int maxPackets, qint64 maxBytes);
+    void setOverflowPolicy(OverflowPolicy policy, int blockTimeoutMs = 1000);
+    // Set before producers start; watermarks are fractions of the limits
+    void setBackpressureHandler(BackpressureHandler handler,
+                                double high = 0.8, double low = 0.5);
+    MessageQueueStats stats() const;
+
+    // Coalescing mode: a packet whose coalesceKey is already queued replaces
+    // it, so the backlog holds one snapshot per key instead of one per poll.
+    // The replacement moves to the tail, keeping queue order == arrival order.
+    void setCoalescing(bool enabled);
+    bool isCoalescing() const { return m_coalescing.load(std::memory_order_relaxed); }
+
+    // Key for a full snapshot of one range: exact in topic id, device, start
+    // and count (16 bits each)
+    static quint64 coalesceKey(quint32 topicId, int deviceId, int start, int count);
     // wake up all wait()
     void stop();
-    void reset(); // clears the queue and removes stop
+    void resume(); // removes stop, keeps queued packets
+    // Drops every queued packet and acknowledges the whole log
+    void clear();
 
-    // В будущем — включение persistence
+    // Persistence: write-ahead log in the given directory.
+    // loadFromDisk() opens the log and replays unacknowledged packets,
+    // after that every push is appended and acknowledge() advances the checkpoint.
     void enablePersistence(const QString& path);
-    void saveToDisk();
+    void setSyncInterval(int ms);
+    void saveToDisk();     // group commit right now
     void loadFromDisk();
 
 private:
-    mutable QMutex m_mutex;
+    bool tryPop(MqttPacket& packet);
+    bool popQueued(MqttPacket& packet, bool outstanding);
+    void advanceCheckpoint();
+    bool pushCoalesced(const MqttPacket& packet);
+    bool popCoalesced(MqttPacket& packet);
+    bool isEmpty() const;
+    void wakeConsumer();
+    void drain();
+
+    // Overflow handling
+    bool hasRoom(qint64 bytes) const;
+    bool reserve(qint64 bytes);
+    bool dropOldest();
+    void released(qint64 bytes);
+    void updateBackpressure();
+
+private:
+    RingBuffer<MqttPacket> m_ring;
+
+    // Packets handed back after a failed send, served before the ring
+    QMutex m_returnedMutex;
+    QList<MqttPacket> m_returned;
+    std::atomic<int> m_returnedCount { 0 };
+
+    // Used only to park the consumer while the ring is empty
+    QMutex m_mutex;
     QWaitCondition m_wait;
-    QList<MqttPacket> m_queue;
+    std::atomic<bool> m_sleeping { false };
+    std::atomic<bool> m_stopped { false };
+    bool m_interrupted = false;     // m_mutex
+
+    // Coalescing mode: arrival-ordered list + index of keyed packets
+    using CoalescedList = std::list<MqttPacket>;
+    QMutex m_coalesceMutex;
+    CoalescedList m_coalesced;
+    QHash<quint64, CoalescedList::iterator> m_coalesceIndex;
+    std::atomic<int> m_coalescedCount { 0 };
+    std::atomic<bool> m_coalescing { false };
+    std::atomic<quint64> m_coalescedTotal { 0 };
+
+    // Limits and accounting
+    std::atomic<int> m_maxPackets;
+    std::atomic<qint64> m_maxBytes { DefaultMaxBytes };
+    std::atomic<int> m_policy { DropNewest };
+    std::atomic<int> m_blockTimeoutMs { 1000 };
+    std::atomic<qint64> m_bytes { 0 };
 
-    bool m_stopped = false;
+    std::atomic<quint64> m_droppedOldest { 0 };
+    std::atomic<quint64> m_droppedNewest { 0 };
+    std::atomic<quint64> m_blockTimeouts { 0 };
+
+    // Producers parked by the Block policy
+    QMutex m_spaceMutex;
+    QWaitCondition m_spaceCond;
+    std::atomic<int> m_blockedProducers { 0 };
+
+    BackpressureHandler m_backpressureHandler;
+    double m_highWatermark = 0.8;
+    double m_lowWatermark = 0.5;
+    std::atomic<bool> m_backpressure { false };
 
     // persistence
-    bool m_persistenceEnabled = false;
+    QMutex m_persistMutex;
     QString m_persistPath;
+    int m_syncIntervalMs = WriteAheadLog::DefaultSyncIntervalMs;
+    std::unique_ptr<WriteAheadLog> m_wal;
+    std::atomic<bool> m_persistent { false };
+
+    // Checkpoint tracking (m_ackMutex): seqs popped but not acknowledged,
+    // and the highest seq popped from the ring or the list (log order)
+    QMutex m_ackMutex;
+    std::set<quint64> m_outstanding;
+    quint64 m_poppedSeq = 0;
 };
 
 #endif // __MESSAGEQUEUE_H__
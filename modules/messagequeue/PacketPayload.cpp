@@ -0,0 +1,189 @@
+#include "PacketPayload.h"
+
+#include <QMutex>
+
+#include <atomic>
+#include <cstring>
+#include <new>
+
+struct PacketPayload::Block
+{
+    std::atomic<quint32> ref;
+    quint32 size;
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+namespace {
+
+constexpr int MinBlockShift = 6;                // 64-byte blocks
+constexpr int ClassCount = 11;                  // .. 64 KiB
+constexpr int SlabBytes = 64 * 1024;
+
+// Smallest class whose blocks hold total bytes; ClassCount = none does
+int classOf(qsizetype total)
+{
+    int c = 0;
+    while (c < ClassCount && (qsizetype(1) << (MinBlockShift + c)) < total)
+        ++c;
+    return c;
+}
+
+class Pool
+{
+public:
+    void* allocate(qsizetype total)
+    {
+        const int c = classOf(total);
+        m_blocksInUse.fetch_add(1, std::memory_order_relaxed);
+
+        if (c == ClassCount) {
+            m_oversized.fetch_add(1, std::memory_order_relaxed);
+            m_bytesInUse.fetch_add(quint64(total), std::memory_order_relaxed);
+            return ::operator new(size_t(total));
+        }
+
+        const int blockSize = 1 << (MinBlockShift + c);
+        m_bytesInUse.fetch_add(quint64(blockSize), std::memory_order_relaxed);
+
+        SizeClass& sc = m_classes[c];
+        QMutexLocker locker(&sc.mutex);
+        if (!sc.free)
+            carve(sc, blockSize);
+
+        void* block = sc.free;
+        sc.free = *static_cast<void**>(block);
+        return block;
+    }
+
+    void release(void* block, qsizetype total)
+    {
+        const int c = classOf(total);
+        m_blocksInUse.fetch_sub(1, std::memory_order_relaxed);
+
+        if (c == ClassCount) {
+            m_bytesInUse.fetch_sub(quint64(total), std::memory_order_relaxed);
+            ::operator delete(block);
+            return;
+        }
+
+        m_bytesInUse.fetch_sub(quint64(1) << (MinBlockShift + c), std::memory_order_relaxed);
+
+        // Free blocks keep the list link where the header was
+        SizeClass& sc = m_classes[c];
+        QMutexLocker locker(&sc.mutex);
+        *static_cast<void**>(block) = sc.free;
+        sc.free = block;
+    }
+
+    PayloadPoolStats stats() const
+    {
+        PayloadPoolStats s;
+        s.blocksInUse = m_blocksInUse.load(std::memory_order_relaxed);
+        s.bytesInUse = m_bytesInUse.load(std::memory_order_relaxed);
+        s.slabBytes = m_slabBytes.load(std::memory_order_relaxed);
+        s.oversized = m_oversized.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct SizeClass
+    {
+        QMutex mutex;
+        void* free = nullptr;
+    };
+
+    // sc.mutex held
+    void carve(SizeClass& sc, int blockSize)
+    {
+        const int count = qMax(1, SlabBytes / blockSize);
+        char* slab = static_cast<char*>(::operator new(size_t(count) * size_t(blockSize)));
+        m_slabBytes.fetch_add(quint64(count) * quint64(blockSize), std::memory_order_relaxed);
+
+        for (int i = count - 1; i >= 0; --i) {
+            void* block = slab + size_t(i) * size_t(blockSize);
+            *static_cast<void**>(block) = sc.free;
+            sc.free = block;
+        }
+    }
+
+    SizeClass m_classes[ClassCount];
+    std::atomic<quint64> m_blocksInUse { 0 };
+    std::atomic<quint64> m_bytesInUse { 0 };
+    std::atomic<quint64> m_slabBytes { 0 };
+    std::atomic<quint64> m_oversized { 0 };
+};
+
+// Never destroyed: packets may still be released during static destruction
+Pool& pool()
+{
+    static Pool* instance = new Pool;
+    return *instance;
+}
+
+} // namespace
+
+PacketPayload::PacketPayload(const PacketPayload& other)
+    : m_block(other.m_block)
+{
+    if (m_block)
+        m_block->ref.fetch_add(1, std::memory_order_relaxed);
+}
+
+PacketPayload& PacketPayload::operator=(const PacketPayload& other)
+{
+    if (other.m_block)
+        other.m_block->ref.fetch_add(1, std::memory_order_relaxed);
+    release();
+    m_block = other.m_block;
+    return *this;
+}
+
+PacketPayload& PacketPayload::operator=(PacketPayload&& other) noexcept
+{
+    if (this != &other) {
+        release();
+        m_block = other.m_block;
+        other.m_block = nullptr;
+    }
+    return *this;
+}
+
+PacketPayload PacketPayload::copy(QByteArrayView bytes)
+{
+    PacketPayload payload;
+    if (bytes.isEmpty())
+        return payload;
+
+    void* memory = pool().allocate(qsizetype(sizeof(Block)) + bytes.size());
+    Block* block = new (memory) Block { { 1 }, quint32(bytes.size()) };
+    std::memcpy(block->data(), bytes.data(), size_t(bytes.size()));
+
+    payload.m_block = block;
+    return payload;
+}
+
+const char* PacketPayload::data() const
+{
+    return m_block ? m_block->data() : nullptr;
+}
+
+qsizetype PacketPayload::size() const
+{
+    return m_block ? qsizetype(m_block->size) : 0;
+}
+
+PayloadPoolStats PacketPayload::poolStats()
+{
+    return pool().stats();
+}
+
+void PacketPayload::release()
+{
+    if (m_block && m_block->ref.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        const qsizetype total = qsizetype(sizeof(Block)) + qsizetype(m_block->size);
+        m_block->~Block();
+        pool().release(m_block, total);
+    }
+    m_block = nullptr;
+}
@@ -0,0 +1,49 @@
+#ifndef __PACKETPAYLOAD_H__
+#define __PACKETPAYLOAD_H__
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+struct PayloadPoolStats
+{
+    quint64 blocksInUse = 0;
+    quint64 bytesInUse = 0;     // block bytes, headers and rounding included
+    quint64 slabBytes = 0;      // carved from the heap so far, never returned
+    quint64 oversized = 0;      // payloads too big for a size class
+};
+
+// Immutable, reference-counted payload bytes in one pointer. Storage is
+// carved from size-class slabs (64 B .. 64 KiB blocks) and goes back to the
+// class free list when the last reference is dropped - after the publish is
+// acknowledged - so a steady packet stream stops allocating once warm.
+// Copies share the block; the count is atomic, any thread may drop one.
+class PacketPayload
+{
+public:
+    PacketPayload() = default;
+    PacketPayload(const PacketPayload& other);
+    PacketPayload(PacketPayload&& other) noexcept : m_block(other.m_block) { other.m_block = nullptr; }
+    PacketPayload& operator=(const PacketPayload& other);
+    PacketPayload& operator=(PacketPayload&& other) noexcept;
+    ~PacketPayload() { release(); }
+
+    static PacketPayload copy(QByteArrayView bytes);
+
+    const char* data() const;
+    qsizetype size() const;
+    bool isEmpty() const { return !m_block; }
+    QByteArrayView view() const { return QByteArrayView(data(), size()); }
+    // Deep copy, for logging and persistence
+    QByteArray toByteArray() const { return QByteArray(data(), size()); }
+
+    static PayloadPoolStats poolStats();
+
+private:
+    struct Block;
+
+    void release();
+
+    Block* m_block = nullptr;
+};
+
+#endif // __PACKETPAYLOAD_H__
@@ -0,0 +1,112 @@
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free queue (D. Vyukov's array-based MPMC algorithm).
+// Every cell carries a sequence number that tells producers and consumers
+// whether the slot is free for the current lap, so neither side needs a lock.
+// Capacity is rounded up to a power of two and fixed for the queue lifetime.
+template <typename T>
+class RingBuffer
+{
+public:
+    explicit RingBuffer(int capacity)
+    {
+        size_t n = 2;
+        while (n < size_t(capacity > 0 ? capacity : 1))
+            n <<= 1;
+
+        m_mask = n - 1;
+        m_cells.reset(new Cell[n]);
+        for (size_t i = 0; i < n; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // Returns false when the buffer is full
+    template <typename U>
+    bool tryPush(U&& value)
+    {
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = std::ptrdiff_t(seq) - std::ptrdiff_t(pos);
+
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::forward<U>(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false when the buffer is empty
+    bool tryPop(T& value)
+    {
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = std::ptrdiff_t(seq) - std::ptrdiff_t(pos + 1);
+
+            if (diff == 0) {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                                       std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        value = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    int capacity() const { return int(m_mask + 1); }
+
+    // Approximate while producers/consumers are active
+    int size() const
+    {
+        const size_t tail = m_dequeuePos.load(std::memory_order_acquire);
+        const size_t head = m_enqueuePos.load(std::memory_order_acquire);
+        return head > tail ? int(head - tail) : 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence { 0 };
+        T value {};
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask = 0;
+
+    alignas(64) std::atomic<size_t> m_enqueuePos { 0 };
+    alignas(64) std::atomic<size_t> m_dequeuePos { 0 };
+};
+
+#endif // __RINGBUFFER_H__
@@ -0,0 +1,77 @@
+#include "TopicTable.h"
+
+#include <QHash>
+#include <QMutex>
+
+#include <atomic>
+#include <memory>
+
+#include "Logger.h"
+
+namespace {
+
+struct Entry
+{
+    QString name;
+    std::string utf8;
+};
+
+struct Table
+{
+    QMutex mutex;
+    QHash<QString, quint32> ids;                // mutex
+    std::unique_ptr<Entry[]> entries { new Entry[TopicTable::MaxTopics] };
+    std::atomic<int> count { 1 };               // entry 0 is the empty topic
+};
+
+// Never destroyed: packets may still be released during static destruction
+Table& table()
+{
+    static Table* instance = new Table;
+    return *instance;
+}
+
+} // namespace
+
+quint32 TopicTable::intern(const QString& topic)
+{
+    if (topic.isEmpty())
+        return 0;
+
+    Table& t = table();
+    QMutexLocker locker(&t.mutex);
+
+    const auto it = t.ids.constFind(topic);
+    if (it != t.ids.constEnd())
+        return it.value();
+
+    const int id = t.count.load(std::memory_order_relaxed);
+    if (id == MaxTopics) {
+        GW_ERROR("Topic table full, %1 not interned", topic);
+        return 0;
+    }
+
+    // Filled in before the id can be seen by anyone
+    t.entries[id].name = topic;
+    t.entries[id].utf8 = topic.toStdString();
+    t.ids.insert(topic, quint32(id));
+    t.count.store(id + 1, std::memory_order_release);
+    return quint32(id);
+}
+
+const QString& TopicTable::name(quint32 id)
+{
+    Table& t = table();
+    return t.entries[id < quint32(t.count.load(std::memory_order_acquire)) ? id : 0].name;
+}
+
+const std::string& TopicTable::utf8(quint32 id)
+{
+    Table& t = table();
+    return t.entries[id < quint32(t.count.load(std::memory_order_acquire)) ? id : 0].utf8;
+}
+
+int TopicTable::size()
+{
+    return table().count.load(std::memory_order_acquire);
+}
@@ -0,0 +1,27 @@
+#ifndef __TOPICTABLE_H__
+#define __TOPICTABLE_H__
+
+#include <QString>
+
+#include <string>
+
+// Process-wide table of interned MQTT topics: a packet carries a 32-bit id
+// instead of its own QString. Lookups by id are lock-free; interning takes
+// a lock, so hot paths intern their topics once and keep the ids.
+// Topics are never removed - a gateway only ever uses a handful.
+class TopicTable
+{
+public:
+    static constexpr int MaxTopics = 4096;
+
+    // Same id for the same topic; 0 (the empty topic) once the table is full
+    static quint32 intern(const QString& topic);
+
+    static const QString& name(quint32 id);
+    // UTF-8 form for paho, converted once at intern time
+    static const std::string& utf8(quint32 id);
+
+    static int size();
+};
+
+#endif // __TOPICTABLE_H__
@@ -0,0 +1,407 @@
+#include "WriteAheadLog.h"
+#include "MessageQueue.h"
+#include "Logger.h"
+
+#include <QDir>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDeadlineTimer>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+const quint32 RecordMagic = 0x57414C31;    // "WAL1"
+const int RecordHeaderSize = 4 + 4 + 2;    // magic, body length, crc16
+
+bool fsyncHandle(int handle)
+{
+#ifdef Q_OS_WIN
+    return _commit(handle) == 0;
+#else
+    return ::fsync(handle) == 0;
+#endif
+}
+
+QByteArray encodeRecord(const MqttPacket& p, quint64 seq)
+{
+    QByteArray body;
+    {
+        QDataStream out(&body, QIODevice::WriteOnly);
+        out << seq << p.timestamp << qint32(p.retryCount)
+            << QByteArray::number(p.id) << p.topic().toUtf8()
+            << QByteArray::fromRawData(p.payload.data(), p.payload.size());
+    }
+
+    QByteArray record;
+    record.reserve(RecordHeaderSize + body.size());
+    {
+        QDataStream out(&record, QIODevice::WriteOnly);
+        out << RecordMagic << quint32(body.size()) << quint16(qChecksum(body));
+    }
+    record.append(body);
+    return record;
+}
+
+bool decodeRecord(const QByteArray& body, MqttPacket& p)
+{
+    QDataStream in(body);
+    QByteArray id, topic, payload;
+    qint32 retry = 0;
+
+    in >> p.seq >> p.timestamp >> retry >> id >> topic >> payload;
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    // Ids are per process (older logs hold UUID strings): replay gets new ones
+    p.id = MqttPacket::nextId();
+    p.retryCount = retry;
+    p.topicId = TopicTable::intern(QString::fromUtf8(topic));
+    p.payload = PacketPayload::copy(payload);
+    return true;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const QString& dir)
+    : m_dir(dir)
+{
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    close();
+}
+
+QString WriteAheadLog::segmentPath(quint64 firstSeq) const
+{
+    // Zero padded hex keeps name order == sequence order
+    return QDir(m_dir).filePath(QString("%1.wal").arg(firstSeq, 16, 16, QChar('0')));
+}
+
+QString WriteAheadLog::checkpointPath() const
+{
+    return QDir(m_dir).filePath("checkpoint");
+}
+
+bool WriteAheadLog::open(QList<MqttPacket>* recovered)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_open)
+        return true;
+
+    QDir dir(m_dir);
+    if (!dir.mkpath(".")) {
+        GW_ERROR("WAL: cannot create %1", m_dir);
+        return false;
+    }
+
+    const quint64 checkpoint = readCheckpoint();
+    m_checkpoint.store(checkpoint);
+    m_savedCheckpoint = checkpoint;
+
+    m_segments.clear();
+    const QStringList names = dir.entryList({ "*.wal" }, QDir::Files, QDir::Name);
+    for (const QString& name : names)
+    {
+        bool ok = false;
+        const quint64 first = name.chopped(4).toULongLong(&ok, 16);
+        if (ok)
+            m_segments.append({ first, dir.filePath(name) });
+    }
+
+    // A segment is fully acknowledged when its successor starts at or
+    // below checkpoint + 1; only the rest is read back.
+    m_nextSeq = checkpoint + 1;
+    for (int i = 0; i < m_segments.size(); ++i)
+    {
+        m_nextSeq = qMax(m_nextSeq, m_segments[i].firstSeq);
+
+        const bool acked = i + 1 < m_segments.size()
+                           && m_segments[i + 1].firstSeq <= checkpoint + 1;
+        if (acked)
+            continue;
+
+        const quint64 last = scanSegment(m_segments[i], checkpoint, recovered);
+        if (last)
+            m_nextSeq = qMax(m_nextSeq, last + 1);
+    }
+
+    // Never append behind a possibly torn tail: always start a fresh segment
+    if (!startSegmentLocked(m_nextSeq))
+        return false;
+
+    m_open = true;
+    m_closing = false;
+
+    m_flusher = QThread::create([this]() { backgroundLoop(); });
+    m_flusher->start();
+    return true;
+}
+
+void WriteAheadLog::close()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_open)
+            return;
+        m_closing = true;
+        m_wake.wakeAll();
+    }
+
+    if (m_flusher) {
+        m_flusher->wait();
+        delete m_flusher;
+        m_flusher = nullptr;
+    }
+
+    commit();
+
+    QMutexLocker locker(&m_mutex);
+    if (m_active) {
+        m_active->close();
+        m_active.reset();
+    }
+    m_open = false;
+}
+
+quint64 WriteAheadLog::scanSegment(const Segment& seg, quint64 checkpoint,
+                                   QList<MqttPacket>* recovered)
+{
+    QFile file(seg.path);
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    const QByteArray data = file.readAll();
+    quint64 lastSeq = 0;
+    qsizetype pos = 0;
+
+    while (pos + RecordHeaderSize <= data.size())
+    {
+        quint32 magic = 0, length = 0;
+        quint16 crc = 0;
+        {
+            QDataStream hdr(QByteArray::fromRawData(data.constData() + pos,
+                                                    RecordHeaderSize));
+            hdr >> magic >> length >> crc;
+        }
+
+        const qsizetype end = pos + RecordHeaderSize + qsizetype(length);
+        if (magic != RecordMagic || end > data.size())
+            break;  // torn tail after a crash
+
+        const QByteArray body = QByteArray::fromRawData(
+            data.constData() + pos + RecordHeaderSize, length);
+        if (qChecksum(body) != crc)
+            break;
+
+        MqttPacket p;
+        if (!decodeRecord(body, p))
+            break;
+
+        lastSeq = p.seq;
+        if (recovered && p.seq > checkpoint)
+            recovered->append(p);
+
+        pos = end;
+    }
+
+    if (pos != data.size())
+        GW_WARN("WAL: ignoring %1 trailing bytes in %2", data.size() - pos, seg.path);
+
+    return lastSeq;
+}
+
+bool WriteAheadLog::startSegmentLocked(quint64 firstSeq)
+{
+    // The flusher may be in fsync() on the current segment
+    while (m_syncing)
+        m_syncDone.wait(&m_mutex);
+
+    const QString path = segmentPath(firstSeq);
+    auto file = std::make_unique<QFile>(path);
+    if (!file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        GW_ERROR("WAL: cannot open segment %1", path);
+        return false;
+    }
+
+    if (m_active) {
+        if (m_dirty && !(m_active->flush() && fsyncHandle(m_active->handle())))
+            GW_ERROR("WAL: fsync failed on %1", m_active->fileName());
+        m_active->close();
+    }
+
+    m_active = std::move(file);
+    m_activeBytes = 0;
+    m_dirty = false;
+
+    if (m_segments.isEmpty() || m_segments.last().firstSeq != firstSeq)
+        m_segments.append({ firstSeq, path });
+    return true;
+}
+
+quint64 WriteAheadLog::append(const MqttPacket& packet)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_open || !writeLocked(packet, m_nextSeq))
+        return 0;
+    return m_nextSeq++;
+}
+
+quint64 WriteAheadLog::reserveSeq()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_open ? m_nextSeq++ : 0;
+}
+
+bool WriteAheadLog::write(const MqttPacket& packet)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_open && packet.seq != 0 && writeLocked(packet, packet.seq);
+}
+
+// m_mutex held
+bool WriteAheadLog::writeLocked(const MqttPacket& packet, quint64 seq)
+{
+    if (m_activeBytes >= m_segmentSize && !startSegmentLocked(seq))
+        return false;
+
+    const QByteArray record = encodeRecord(packet, seq);
+
+    if (m_active->write(record) != record.size()) {
+        GW_ERROR("WAL: write failed on %1", m_active->fileName());
+        return false;
+    }
+
+    m_activeBytes += record.size();
+    m_dirty = true;
+    return true;
+}
+
+void WriteAheadLog::acknowledge(quint64 seq)
+{
+    quint64 current = m_checkpoint.load(std::memory_order_relaxed);
+    while (seq > current
+           && !m_checkpoint.compare_exchange_weak(current, seq,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed))
+    {
+    }
+}
+
+void WriteAheadLog::acknowledgeAll()
+{
+    QMutexLocker locker(&m_mutex);
+    acknowledge(m_nextSeq - 1);
+}
+
+void WriteAheadLog::sync()
+{
+    commit();
+}
+
+void WriteAheadLog::setSyncInterval(int ms)
+{
+    QMutexLocker locker(&m_mutex);
+    m_syncIntervalMs = qMax(1, ms);
+    m_wake.wakeAll();
+}
+
+void WriteAheadLog::setSegmentSize(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_segmentSize = qMax<qint64>(4096, bytes);
+}
+
+quint64 WriteAheadLog::readCheckpoint() const
+{
+    QFile file(checkpointPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    QDataStream in(&file);
+    quint64 seq = 0;
+    in >> seq;
+    return in.status() == QDataStream::Ok ? seq : 0;
+}
+
+void WriteAheadLog::writeCheckpoint(quint64 seq)
+{
+    // QSaveFile writes to a temp file and renames, so a crash leaves
+    // either the old or the new checkpoint
+    QSaveFile file(checkpointPath());
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    QDataStream out(&file);
+    out << seq;
+    if (!file.commit())
+        GW_ERROR("WAL: cannot persist checkpoint");
+}
+
+void WriteAheadLog::commit()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_active)
+        return;
+
+    while (m_syncing)
+        m_syncDone.wait(&m_mutex);
+
+    // Flush Qt's buffer under the lock, fsync outside so producers keep
+    // appending while the disk catches up
+    const bool dirty = m_dirty;
+    m_dirty = false;
+    QFile* file = m_active.get();
+    if (dirty && !file->flush())
+        GW_ERROR("WAL: flush failed on %1", file->fileName());
+
+    m_syncing = true;
+    locker.unlock();
+
+    if (dirty && !fsyncHandle(file->handle()))
+        GW_ERROR("WAL: fsync failed on %1", file->fileName());
+
+    const quint64 checkpoint = m_checkpoint.load(std::memory_order_acquire);
+    if (checkpoint != m_savedCheckpoint) {
+        writeCheckpoint(checkpoint);
+        m_savedCheckpoint = checkpoint;
+    }
+
+    locker.relock();
+    m_syncing = false;
+    m_syncDone.wakeAll();
+
+    // Compaction: drop segments that lie entirely behind the durable checkpoint
+    QStringList obsolete;
+    while (m_segments.size() > 1
+           && m_segments[1].firstSeq <= m_savedCheckpoint + 1)
+        obsolete << m_segments.takeFirst().path;
+    locker.unlock();
+
+    for (const QString& path : obsolete)
+        QFile::remove(path);
+}
+
+void WriteAheadLog::backgroundLoop()
+{
+    for (;;)
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_closing)
+                break;
+            m_wake.wait(&m_mutex, QDeadlineTimer(m_syncIntervalMs));
+            if (m_closing)
+                break;
+        }
+        commit();
+    }
+}
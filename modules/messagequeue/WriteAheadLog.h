@@ -0,0 +1,102 @@
+#ifndef __WRITEAHEADLOG_H__
+#define __WRITEAHEADLOG_H__
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QThread>
+
+#include <atomic>
+#include <memory>
+
+struct MqttPacket;
+
+// Segmented append-only log of queued packets.
+//
+// Every record carries a monotonic sequence number. The consumer advances a
+// checkpoint (last consumed seq); a background thread group-commits the
+// active segment with fsync every syncInterval ms, persists the checkpoint
+// and deletes segments that lie entirely behind it.
+class WriteAheadLog
+{
+public:
+    static constexpr qint64 DefaultSegmentSize = 4 * 1024 * 1024;
+    static constexpr int DefaultSyncIntervalMs = 200;
+
+    explicit WriteAheadLog(const QString& dir);
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Reads the checkpoint, scans unacknowledged segments and starts a new
+    // active segment. Returns false if the directory is not usable.
+    bool open(QList<MqttPacket>* recovered = nullptr);
+    void close();
+    bool isOpen() const { return m_open; }
+
+    // Appends a record and returns its sequence number (0 on failure)
+    quint64 append(const MqttPacket& packet);
+    // Two-step append: take a number first, write the record under
+    // packet.seq later (in reservation order). A number never written
+    // leaves a gap, which replay does not mind. 0 when the log is closed.
+    quint64 reserveSeq();
+    bool write(const MqttPacket& packet);
+
+    // Everything up to and including seq has been consumed
+    void acknowledge(quint64 seq);
+    void acknowledgeAll();
+
+    // Forces a group commit now
+    void sync();
+
+    void setSyncInterval(int ms);
+    void setSegmentSize(qint64 bytes);
+
+private:
+    struct Segment
+    {
+        quint64 firstSeq = 0;
+        QString path;
+    };
+
+    QString segmentPath(quint64 firstSeq) const;
+    QString checkpointPath() const;
+
+    quint64 readCheckpoint() const;
+    void writeCheckpoint(quint64 seq);
+    quint64 scanSegment(const Segment& seg, quint64 checkpoint,
+                        QList<MqttPacket>* recovered);
+
+    bool startSegmentLocked(quint64 firstSeq);
+    bool writeLocked(const MqttPacket& packet, quint64 seq);
+    void commit();
+    void backgroundLoop();
+
+private:
+    QString m_dir;
+    qint64 m_segmentSize = DefaultSegmentSize;
+    int m_syncIntervalMs = DefaultSyncIntervalMs;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_syncDone;
+
+    QList<Segment> m_segments;   // oldest first, last one is active
+    std::unique_ptr<QFile> m_active;
+    qint64 m_activeBytes = 0;
+    quint64 m_nextSeq = 1;
+    bool m_dirty = false;
+    bool m_syncing = false;
+    bool m_open = false;
+    bool m_closing = false;
+
+    std::atomic<quint64> m_checkpoint { 0 };
+    quint64 m_savedCheckpoint = 0;
+
+    QThread* m_flusher = nullptr;
+};
+
+#endif // __WRITEAHEADLOG_H__
@@ -0,0 +1,84 @@
+#include "LatencyHistogram.h"
+
+#include <QtAlgorithms>
+
+int LatencyHistogram::bucketOf(quint64 value)
+{
+    if (value < quint64(SubCount))
+        return int(value);
+
+    // Exponent of the highest set bit, then the next SubBits bits below it
+    const int exponent = 63 - qCountLeadingZeroBits(value);
+    const int sub = int(value >> (exponent - SubBits)) - SubCount;
+    return (exponent - SubBits + 1) * SubCount + sub;
+}
+
+qint64 LatencyHistogram::valueOf(int bucket)
+{
+    if (bucket < 2 * SubCount)
+        return bucket;
+
+    const int exponent = bucket / SubCount + SubBits - 1;
+    const int shift = exponent - SubBits;
+    const quint64 low = quint64(bucket % SubCount + SubCount) << shift;
+    return qint64(low + (quint64(1) << shift) / 2);
+}
+
+void LatencyHistogram::record(qint64 us)
+{
+    const quint64 value = us > 0 ? quint64(us) : 0;
+
+    m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    qint64 max = m_max.load(std::memory_order_relaxed);
+    while (qint64(value) > max
+           && !m_max.compare_exchange_weak(max, qint64(value), std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto& bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::percentile(double q) const
+{
+    // Total from the buckets themselves, so a concurrent record() cannot
+    // push the rank past the end
+    quint64 total = 0;
+    for (const auto& bucket : m_buckets)
+        total += bucket.load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    const quint64 rank = qMax<quint64>(1, quint64(q * double(total) + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return qMin(valueOf(i), m_max.load(std::memory_order_relaxed));
+    }
+    return m_max.load(std::memory_order_relaxed);
+}
+
+QVariantMap LatencyHistogram::snapshot() const
+{
+    const quint64 n = count();
+
+    QVariantMap map;
+    map["count"] = n;
+    map["mean"] = n ? double(m_sum.load(std::memory_order_relaxed)) / double(n) : 0.0;
+    map["p50"] = percentile(0.50);
+    map["p90"] = percentile(0.90);
+    map["p99"] = percentile(0.99);
+    map["p999"] = percentile(0.999);
+    map["max"] = m_max.load(std::memory_order_relaxed);
+    return map;
+}
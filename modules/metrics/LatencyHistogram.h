@@ -0,0 +1,45 @@
+#ifndef __LATENCYHISTOGRAM_H__
+#define __LATENCYHISTOGRAM_H__
+
+#include <QVariantMap>
+
+#include <atomic>
+
+// Lock-free log-linear histogram (HDR style) of durations in microseconds.
+// Values below 32 us are exact; above that every power of two is split into
+// 16 sub-buckets, so any reported value is within ~6% of the recorded one.
+// record() may be called from any thread; snapshot() is approximate while
+// recording continues.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(qint64 us);
+    void reset();
+
+    quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+
+    // Value at quantile q (0..1), microseconds
+    qint64 percentile(double q) const;
+
+    // count, mean, p50, p90, p99, p999, max (us)
+    QVariantMap snapshot() const;
+
+private:
+    static constexpr int SubBits = 4;
+    static constexpr int SubCount = 1 << SubBits;
+    static constexpr int BucketCount = (64 - SubBits + 1) * SubCount;
+
+    static int bucketOf(quint64 value);
+    static qint64 valueOf(int bucket);    // midpoint of the bucket
+
+    std::atomic<quint64> m_buckets[BucketCount] = {};
+    std::atomic<quint64> m_count { 0 };
+    std::atomic<quint64> m_sum { 0 };
+    std::atomic<qint64> m_max { 0 };
+};
+
+#endif // __LATENCYHISTOGRAM_H__
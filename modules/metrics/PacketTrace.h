@@ -0,0 +1,24 @@
+#ifndef __PACKETTRACE_H__
+#define __PACKETTRACE_H__
+
+#include <QtGlobal>
+#include <chrono>
+
+// Monotonic stage stamps carried by every packet (ns, 0 = not reached).
+// Not persisted: packets replayed from the WAL start without a trace.
+struct PacketTrace
+{
+    qint64 requestSentNs = 0;     // Modbus request handed to the client
+    qint64 replyReceivedNs = 0;   // Modbus reply arrived
+    qint64 enqueuedNs = 0;        // pushed into MessageQueue
+    qint64 dequeuedNs = 0;        // taken by MqttWorker::run()
+    qint64 ackedNs = 0;           // broker acknowledged the publish
+
+    static qint64 now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+#endif // __PACKETTRACE_H__
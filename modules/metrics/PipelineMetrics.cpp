@@ -0,0 +1,107 @@
+#include "PipelineMetrics.h"
+
+#include <QHash>
+#include <QThread>
+
+namespace {
+
+inline void recordSpan(LatencyHistogram &histogram, qint64 fromNs, qint64 toNs)
+{
+    if (fromNs > 0 && toNs >= fromNs)
+        histogram.record((toNs - fromNs) / 1000);
+}
+
+} // namespace
+
+PipelineMetrics::PipelineMetrics() = default;
+
+PipelineMetrics::~PipelineMetrics()
+{
+    for (TopicSlot &slot : m_topics)
+        delete slot.histogram.load(std::memory_order_acquire);
+}
+
+const char *PipelineMetrics::stageName(Stage s)
+{
+    switch (s) {
+    case Device:  return "device";
+    case Process: return "process";
+    case Queue:   return "queue";
+    case Publish: return "publish";
+    case Total:   return "total";
+    default:      return "unknown";
+    }
+}
+
+void PipelineMetrics::record(const QString &topic, const PacketTrace &trace)
+{
+    recordSpan(m_stages[Device], trace.requestSentNs, trace.replyReceivedNs);
+    recordSpan(m_stages[Process], trace.replyReceivedNs, trace.enqueuedNs);
+    recordSpan(m_stages[Queue], trace.enqueuedNs, trace.dequeuedNs);
+    recordSpan(m_stages[Publish], trace.dequeuedNs, trace.ackedNs);
+
+    // Packets that did not come from a Modbus read start at enqueue
+    const qint64 startNs = trace.requestSentNs ? trace.requestSentNs : trace.enqueuedNs;
+    recordSpan(m_stages[Total], startNs, trace.ackedNs);
+    recordSpan(*topicHistogram(topic), startNs, trace.ackedNs);
+}
+
+LatencyHistogram *PipelineMetrics::topicHistogram(const QString &topic)
+{
+    const quint64 key = quint64(qHash(topic)) | 1;    // never 0
+    const int start = int(key % MaxTopics);
+
+    for (int i = 0; i < MaxTopics; ++i)
+    {
+        TopicSlot &slot = m_topics[(start + i) % MaxTopics];
+        quint64 current = slot.key.load(std::memory_order_acquire);
+
+        if (current == 0) {
+            if (slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+                slot.topic = topic;
+                auto *histogram = new LatencyHistogram;
+                slot.histogram.store(histogram, std::memory_order_release);
+                return histogram;
+            }
+            // lost the race; current now holds the winner's key
+        }
+
+        if (current == key) {
+            // The owner is still allocating
+            LatencyHistogram *histogram = nullptr;
+            while (!(histogram = slot.histogram.load(std::memory_order_acquire)))
+                QThread::yieldCurrentThread();
+            return histogram;
+        }
+    }
+    return &m_otherTopics;
+}
+
+void PipelineMetrics::reset()
+{
+    for (LatencyHistogram &histogram : m_stages)
+        histogram.reset();
+    for (TopicSlot &slot : m_topics)
+        if (LatencyHistogram *histogram = slot.histogram.load(std::memory_order_acquire))
+            histogram->reset();
+    m_otherTopics.reset();
+}
+
+QVariantMap PipelineMetrics::snapshot() const
+{
+    QVariantMap stages;
+    for (int s = 0; s < StageCount; ++s)
+        stages[stageName(Stage(s))] = m_stages[s].snapshot();
+
+    QVariantMap topics;
+    for (const TopicSlot &slot : m_topics)
+        if (const LatencyHistogram *histogram = slot.histogram.load(std::memory_order_acquire))
+            topics[slot.topic] = histogram->snapshot();
+    if (m_otherTopics.count())
+        topics["(other)"] = m_otherTopics.snapshot();
+
+    QVariantMap map;
+    map["stages"] = stages;
+    map["topics"] = topics;
+    return map;
+}
@@ -0,0 +1,58 @@
+#ifndef __PIPELINEMETRICS_H__
+#define __PIPELINEMETRICS_H__
+
+#include <QString>
+#include <QVariantMap>
+
+#include <atomic>
+#include <memory>
+
+#include "LatencyHistogram.h"
+#include "PacketTrace.h"
+
+// Stage latency histograms for the Modbus -> MQTT pipeline, plus an
+// end-to-end histogram per topic. Recording is lock-free; topics are
+// registered on first use in a fixed open-addressing table.
+class PipelineMetrics
+{
+public:
+    enum Stage {
+        Device,     // request sent -> reply received
+        Process,    // reply received -> enqueued (filter, encode)
+        Queue,      // enqueued -> dequeued
+        Publish,    // dequeued -> broker ack
+        Total,      // request sent (or enqueued) -> broker ack
+        StageCount
+    };
+
+    static constexpr int MaxTopics = 64;
+
+    PipelineMetrics();
+    ~PipelineMetrics();
+
+    // Record every stage the trace has both ends of
+    void record(const QString &topic, const PacketTrace &trace);
+    void reset();
+
+    const LatencyHistogram &stage(Stage s) const { return m_stages[s]; }
+    static const char *stageName(Stage s);
+
+    // { "stages": { name: histogram }, "topics": { topic: histogram } }
+    QVariantMap snapshot() const;
+
+private:
+    struct TopicSlot
+    {
+        std::atomic<quint64> key { 0 };     // topic hash, 0 = free
+        std::atomic<LatencyHistogram *> histogram { nullptr };
+        QString topic;                      // written before histogram is published
+    };
+
+    LatencyHistogram *topicHistogram(const QString &topic);
+
+    LatencyHistogram m_stages[StageCount];
+    TopicSlot m_topics[MaxTopics];
+    LatencyHistogram m_otherTopics;         // table full
+};
+
+#endif // __PIPELINEMETRICS_H__
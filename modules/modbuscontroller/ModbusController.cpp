@@ -1,23 +1,28 @@
-#include <QDebug>
 #include <QVariant>
 
 #include <QModbusDataUnit>
 
-#include "modbuscontroller.h"
-
-#include <QJsonArray>
-#include <QJsonObject>
-#include <QJsonDocument>
+#include "ModbusController.h"
 
 ModbusController::ModbusController (QObject *parent) : QObject(parent)
 {
-    m_client = new QModbusTcpClient(this);
+    m_pool = new ModbusDevicePool(this);
+
+    connect(m_pool, &ModbusDevicePool::deviceStateChanged,
+            this, &ModbusController::onDeviceStateChanged);
+
+    connect(m_pool, &ModbusDevicePool::deviceError,
+            this, &ModbusController::onDeviceError);
 
-    connect(m_client, &QModbusClient::stateChanged,
-            this, &ModbusController::onStateChanged);
+    m_scheduler = new PollScheduler(this);
+    connect(m_scheduler, &PollScheduler::due,
+            this, &ModbusController::onPollDue);
 
-    connect(m_client, &QModbusClient::errorOccurred,
-            this, &ModbusController::onErrorOccurred);
+    m_writeTimer = new QTimer(this);
+    m_writeTimer->setSingleShot(true);
+    m_writeTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_writeTimer, &QTimer::timeout,
+            this, &ModbusController::flushWrites);
 }
 
 ModbusTypes::ConnectionState ModbusController::state() const
@@ -28,49 +33,133 @@ ModbusTypes::ConnectionState ModbusController::state() const
 void ModbusController::connectToServer(const QString &host, int port, int unitId)
 {
     if (host.isEmpty() || port <= 0 || port > 65535) {
-        log("Invalid host or port");
+        GW_WARN("Invalid host or port");
         return;
     }
 
-    m_unitId = unitId;
-
-    log(QString("Connect request: %1:%2 (unit %3)")
-        .arg(host).arg(port).arg(unitId));
+    GW_INFO("Connect request: %1:%2 (unit %3)", host, port, unitId);
 
-    if (m_client->state() != QModbusDevice::UnconnectedState)
-        m_client->disconnectDevice();
+    // Devices created implicitly for the previous default endpoint go away
+    const int id = m_pool->addDevice(host, port, unitId);
+    for (int old : std::as_const(m_implicitDevices))
+        if (old != id)
+            m_pool->removeDevice(old);
+    m_implicitDevices.clear();
+    if (!m_explicitDevices.contains(id))
+        m_implicitDevices.insert(id);
 
-    m_client->setConnectionParameter(QModbusDevice::NetworkAddressParameter, host);
-    m_client->setConnectionParameter(QModbusDevice::NetworkPortParameter, port);
-    m_client->setTimeout(3000);
-    m_client->setNumberOfRetries(3);
+    m_host = host;
+    m_port = port;
+    m_unitId = unitId;
+    m_defaultDevice = id;
 
     setState(ModbusTypes::Connecting);
-    m_client->connectDevice();
+    m_pool->connectDevice(id);
 }
 
 void ModbusController::disconnectFromServer()
 {
-    log("Disconnect requested");
-    m_client->disconnectDevice();
+    GW_INFO("Disconnect requested");
+    m_pool->disconnectDevice(m_defaultDevice);
+}
+
+// Device registry
+int ModbusController::addDevice(const QString &host, int port, int unitId,
+                                int maxOutstanding)
+{
+    if (host.isEmpty() || port <= 0 || port > 65535) {
+        GW_WARN("Cannot add device: invalid host or port");
+        return 0;
+    }
+
+    const int id = m_pool->addDevice(host, port, unitId, maxOutstanding);
+    m_implicitDevices.remove(id);
+    m_explicitDevices.insert(id);
+
+    GW_INFO("Device %1 registered as #%2", m_pool->deviceName(id), id);
+    return id;
+}
+
+void ModbusController::removeDevice(int deviceId)
+{
+    m_explicitDevices.remove(deviceId);
+    if (deviceId == m_defaultDevice) {
+        // Still used by the default connection
+        m_implicitDevices.insert(deviceId);
+        return;
+    }
+
+    // Writes still waiting for the window never reach the device
+    for (int id : m_writes.removeDevice(deviceId)) {
+        if (m_writeStates.remove(id))
+            emit writeCompleted(id, false, "device removed");
+    }
+    m_pool->removeDevice(deviceId);
 }
 
-void ModbusController::onStateChanged(QModbusDevice::State state)
+void ModbusController::connectDevices()
 {
+    m_pool->connectAll();
+}
+
+void ModbusController::disconnectDevices()
+{
+    m_pool->disconnectAll();
+}
+
+QString ModbusController::deviceName(int deviceId) const
+{
+    return m_pool->deviceName(deviceId);
+}
+
+QVariantList ModbusController::deviceStats() const
+{
+    return m_pool->stats();
+}
+
+int ModbusController::resolveDevice(int deviceId, int unitId)
+{
+    if (deviceId)
+        return m_pool->contains(deviceId) ? deviceId : 0;
+
+    // Default connection: other unit ids share its endpoint
+    if (m_host.isEmpty())
+        return 0;
+    if (unitId == m_unitId)
+        return m_defaultDevice;
+
+    const int id = m_pool->addDevice(m_host, m_port, unitId);
+    if (!m_explicitDevices.contains(id))
+        m_implicitDevices.insert(id);
+    return id;
+}
+
+void ModbusController::onDeviceStateChanged(int deviceId, QModbusDevice::State state)
+{
+    if (deviceId != m_defaultDevice) {
+        if (m_explicitDevices.contains(deviceId)) {
+            if (state == QModbusDevice::ConnectedState)
+                GW_INFO("Device %1 connected", m_pool->deviceName(deviceId));
+            else if (state == QModbusDevice::UnconnectedState)
+                GW_INFO("Device %1 disconnected", m_pool->deviceName(deviceId));
+        }
+        return;
+    }
+
     switch (state) {
     case QModbusDevice::ConnectingState:
-        log("Connecting...");
+        GW_INFO("Connecting...");
         setState(ModbusTypes::Connecting);
         break;
     case QModbusDevice::ConnectedState:
-        log("Connection established");
+        GW_INFO("Connection established");
         setState(ModbusTypes::Connected);
         break;
     case QModbusDevice::ClosingState:
-        log("Closing connection...");
+        GW_INFO("Closing connection...");
         break;
     case QModbusDevice::UnconnectedState:
-        log("Disconnected");
+        GW_INFO("Disconnected");
         setState(ModbusTypes::Disconnected);
         break;
     default:
@@ -78,12 +167,15 @@ void ModbusController::onStateChanged(QModbusDevice::State state)
     }
 }
 
-void ModbusController::onErrorOccurred(QModbusDevice::Error error)
+void ModbusController::onDeviceError(int deviceId, const QString &message)
 {
-    if (error == QModbusDevice::NoError)
+    if (deviceId != m_defaultDevice) {
+        if (m_explicitDevices.contains(deviceId))
+            GW_WARN("Device %1 error: %2", m_pool->deviceName(deviceId), message);
         return;
+    }
 
-    log("Connection error: " + m_client->errorString());
+    GW_WARN("Connection error: %1", message);
     setState(ModbusTypes::Error);
 }
 
@@ -96,254 +188,402 @@ void ModbusController::setState(ModbusTypes::ConnectionState newState)
     emit stateChanged(newState);
 }
 
-void ModbusController::log(const QString &text)
+void ModbusController::readHoldingRegisters(int startAddress, int count)
 {
-    emit logMessage(text);
+    sendRead(singleRead(QModbusDataUnit::HoldingRegisters, startAddress, count));
 }
 
-void ModbusController::readHoldingRegisters(int startAddress, int count)
+// Запись одного регистра
+void ModbusController::writeHoldingRegister(int address, int value)
 {
-    // Клиент подключен?
-    if (!m_client || m_client->state() != QModbusDevice::ConnectedState) {
-        log("Cannot read: not connected");
-        return;
-    }
-
-    if (count <= 0) {
-        log("Cannot read: count must be > 0");
-        return;
-    }
-
-    QModbusDataUnit request(QModbusDataUnit::HoldingRegisters, startAddress, count);    // Настраиваем запрос
-
-    auto *reply = m_client->sendReadRequest(request, m_unitId); // Возвращает асинхронный ответ
-    if (!reply) {
-        log("Read request failed to send");
-        return;
-    }
-    // Обработка результата и логирование
-    if (!reply->isFinished()) {
-        connect(reply, &QModbusReply::finished, this, [this, reply, startAddress]() {
-            reply->deleteLater();
-
-            if (reply->error() != QModbusDevice::NoError) {
-                log("Read error: " + reply->errorString());
-                return;
-            }
-
-            const QModbusDataUnit unit = reply->result();
-            QVector<quint16> values;
-            values.reserve(unit.valueCount());
+    writeRegisters(0, 0, address, { static_cast<quint16>(value) });
+}
 
-            for (uint i = 0; i < unit.valueCount(); ++i) {
-                values.append(unit.value(i));
-            }
+void ModbusController::readCoils(int startAddress, int count)
+{
+    sendRead(singleRead(QModbusDataUnit::Coils, startAddress, count));
+}
 
-            log(QString("Read %1 holding registers from %2")
-                    .arg(unit.valueCount())
-                    .arg(startAddress));
+void ModbusController::writeSingleCoil(int address, bool value)
+{
+    writeCoils(0, 0, address, { value });
+}
 
-            emit holdingRegistersRead(startAddress, values);
+void ModbusController::writeMultipleCoils(int startAddress, const QVector<bool> &values)
+{
+    writeCoils(0, 0, startAddress, values);
+}
 
-            QJsonArray arr;
-            for (quint16 v : values)
-                arr.append(static_cast<int>(v));
+// Queued writes
+void ModbusController::writeRegisters(int writeId, int deviceId, int startAddress,
+                                      const QVector<quint16> &values)
+{
+    queueWrite(writeId, deviceId, QModbusDataUnit::HoldingRegisters, startAddress, values);
+}
 
-            QJsonObject obj;
-            obj["type"] = "holding_registers";
-            obj["start"] = startAddress;
-            obj["values"] = arr;
+void ModbusController::writeCoils(int writeId, int deviceId, int startAddress,
+                                  const QVector<bool> &values)
+{
+    QVector<quint16> words;
+    words.reserve(values.size());
+    for (bool v : values)
+        words.append(v ? 1 : 0);
+    queueWrite(writeId, deviceId, QModbusDataUnit::Coils, startAddress, words);
+}
 
-            QJsonDocument doc(obj);
+void ModbusController::setWriteWindow(int ms)
+{
+    m_writeWindowMs = qBound(0, ms, 1000);
+}
 
-        });
-    } else {
-        // Синхронный ответ (редко, но по API надо обработать) - от Copilot
-        reply->deleteLater();
-    }
+QVariantMap ModbusController::writeStats() const
+{
+    const WriteCoalescerStats &stats = m_writes.stats();
+
+    QVariantMap map;
+    map["windowMs"] = m_writeWindowMs;
+    map["writes"] = stats.writes;
+    map["values"] = stats.values;
+    map["superseded"] = stats.superseded;
+    map["requests"] = stats.requests;
+    map["savedRequests"] = stats.savedRequests();
+    map["failedRequests"] = m_failedWrites;
+    map["pendingValues"] = m_writes.pendingValues();
+    return map;
 }
 
-// Запись одного регистра
-void ModbusController::writeHoldingRegister(int address, int value)
+void ModbusController::queueWrite(int writeId, int deviceId, QModbusDataUnit::RegisterType type,
+                                  int startAddress, const QVector<quint16> &values)
 {
-    if (!m_client || m_client->state() != QModbusDevice::ConnectedState) {
-        log("Cannot write: not connected");
+    const char *what = (type == QModbusDataUnit::Coils) ? "coils" : "registers";
+
+    const int device = resolveDevice(deviceId, m_unitId);
+    if (!device) {
+        GW_WARN("Cannot write %1: no such device", what);
+        if (writeId)
+            emit writeCompleted(writeId, false, "no such device");
         return;
     }
 
-    if (address < 0) {
-        log("Cannot write: invalid address");
+    if (values.isEmpty() || startAddress < 0 || startAddress + values.size() > 65536) {
+        GW_WARN("Cannot write %1: invalid address or count", what);
+        if (writeId)
+            emit writeCompleted(writeId, false, "invalid address or count");
         return;
     }
 
-    QModbusDataUnit request(QModbusDataUnit::HoldingRegisters, address, 1);
-    request.setValue(0, static_cast<quint16>(value));
+    if (writeId)
+        m_writeStates.insert(writeId, WriteState());
+    m_writes.add(writeId, device, type, startAddress, values);
 
-    auto *reply = m_client->sendWriteRequest(request, m_unitId);    // Асинхронная запись
-    if (!reply) {
-        log("Write request failed to send");
-        return;
-    }
+    // Everything written within the window goes out together
+    if (!m_writeTimer->isActive())
+        m_writeTimer->start(m_writeWindowMs);
+}
 
-    if (!reply->isFinished()) {
-        connect(reply, &QModbusReply::finished, this, [this, reply, address, value]() {
-            reply->deleteLater();
+void ModbusController::flushWrites()
+{
+    m_writeTimer->stop();
+    const QList<WriteBatch> batches = m_writes.take();
 
-            if (reply->error() != QModbusDevice::NoError) {
-                log("Write error: " + reply->errorString());
-                return;
+    // Count first: a request that fails right away must not complete
+    // a write that still has values in a later one
+    for (const WriteBatch &batch : batches)
+        for (int id : batch.writeIds)
+            ++m_writeStates[id].remaining;
+
+    for (const WriteBatch &batch : batches)
+        sendWrite(batch);
+}
+
+void ModbusController::sendWrite(const WriteBatch &batch)
+{
+    m_pool->submit(batch.deviceId,
+        [batch](QModbusTcpClient *client, int unitId) {
+            // One value: FC05/FC06, more: FC15/FC16
+            const QModbusDataUnit request(batch.type, batch.startAddress, batch.values);
+            return client->sendWriteRequest(request, unitId);    // Асинхронная запись
+        },
+        [this, batch](QModbusReply *reply) {
+            const char *what = (batch.type == QModbusDataUnit::Coils) ? "coils" : "registers";
+
+            QString error;
+            if (!reply)
+                error = "request failed to send";
+            else if (reply->error() != QModbusDevice::NoError)
+                error = reply->errorString();
+
+            if (error.isEmpty()) {
+                GW_INFO("Wrote %1 %2 starting at %3", batch.values.size(), what, batch.startAddress);
+            } else {
+                ++m_failedWrites;
+                GW_WARN("Write %1 at %2 failed: %3", what, batch.startAddress, error);
             }
 
-            log(QString("Wrote value %1 to holding register %2")
-                    .arg(value)
-                    .arg(address));
+            for (int id : batch.writeIds)
+                completeWrite(id, error);
         });
-    } else {
-        reply->deleteLater();
-    }
 }
 
-void ModbusController::readCoils(int startAddress, int count)
+void ModbusController::completeWrite(int writeId, const QString &error)
 {
-    if (!m_client || m_client->state() != QModbusDevice::ConnectedState) {
-        log("Cannot read coils: not connected");
+    auto it = m_writeStates.find(writeId);
+    if (it == m_writeStates.end())
         return;
-    }
 
-    if (count <= 0) {
-        log("Cannot read coils: count must be > 0");
+    if (it->error.isEmpty())
+        it->error = error;
+    if (--it->remaining > 0)
         return;
-    }
 
-    QModbusDataUnit request(QModbusDataUnit::Coils, startAddress, count);
+    const QString firstError = it->error;
+    m_writeStates.erase(it);
+    emit writeCompleted(writeId, firstError.isEmpty(), firstError);
+}
+
+PlannedRead ModbusController::singleRead(QModbusDataUnit::RegisterType type,
+                                         int startAddress, int count) const
+{
+    ReadRange range;
+    range.type = type;
+    range.deviceId = m_defaultDevice;
+    range.startAddress = startAddress;
+    range.count = count;
+
+    PlannedRead read;
+    read.type = type;
+    read.deviceId = m_defaultDevice;
+    read.startAddress = startAddress;
+    read.count = count;
+    read.members.append(range);
+    return read;
+}
+
+void ModbusController::sendRead(const PlannedRead &read)
+{
+    const char *what = (read.type == QModbusDataUnit::Coils) ? "coils" : "holding registers";
 
-    auto *reply = m_client->sendReadRequest(request, m_unitId);
-    if (!reply) {
-        log("Read coils request failed to send");
+    // Клиент подключен?
+    if (!m_pool->isConnected(read.deviceId)) {
+        GW_WARN("Cannot read %1: not connected", what);
+        completePolls(read);
         return;
     }
 
-    if (!reply->isFinished()) {
-        connect(reply, &QModbusReply::finished, this,
-                [this, reply, startAddress]() {
-                    reply->deleteLater();
+    // One PDU; the planner never merges beyond it, one-off reads may ask for more
+    const int limit = (read.type == QModbusDataUnit::Coils) ? ReadPlanner::MaxCoils
+                                                            : ReadPlanner::MaxRegisters;
+    if (read.count <= 0 || read.count > limit) {
+        GW_WARN("Cannot read %1: count must be 1..%2", what, limit);
+        completePolls(read);
+        return;
+    }
 
-                    if (reply->error() != QModbusDevice::NoError) {
-                        log("Read coils error: " + reply->errorString());
-                        return;
-                    }
+    // Set when the request actually leaves, which may be after queueing
+    auto sentNs = std::make_shared<qint64>(0);
+
+    // The pool sends it as soon as the device has a free transaction slot
+    m_pool->submit(read.deviceId,
+        [read, sentNs](QModbusTcpClient *client, int unitId) {
+            QModbusDataUnit request(read.type, read.startAddress, read.count);    // Настраиваем запрос
+            *sentNs = PacketTrace::now();
+            return client->sendReadRequest(request, unitId); // Возвращает асинхронный ответ
+        },
+        [this, read, what, sentNs](QModbusReply *reply) {
+            const qint64 receivedNs = PacketTrace::now();
+            completePolls(read);
+
+            if (!reply) {
+                GW_WARN("Read %1 request failed to send", what);
+                return;
+            }
 
-                    const QModbusDataUnit unit = reply->result();
-                    QVector<bool> values;
-                    values.reserve(unit.valueCount());
+            if (reply->error() != QModbusDevice::NoError) {
+                GW_WARN("Read %1 error: %2", what, reply->errorString());
+                return;
+            }
 
-                    for (uint i = 0; i < unit.valueCount(); ++i)
-                        values.append(unit.value(i));
+            const QModbusDataUnit unit = reply->result();
+
+            // Polled reads only at trace level, manual ones at info
+            if (read.members.first().id)
+                GW_TRACE("Polled %1 %2 from %3", unit.valueCount(), what, read.startAddress);
+            else
+                GW_INFO("Read %1 %2 from %3", unit.valueCount(), what, read.startAddress);
 
-                    log(QString("Read %1 coils from %2")
-                            .arg(unit.valueCount())
-                            .arg(startAddress));
+            // Ответ делится обратно по запрошенным диапазонам
+            for (const ReadRange &range : read.members) {
+                const qsizetype offset = range.startAddress - read.startAddress;
+                if (offset + range.count > unit.valueCount())
+                    continue;   // short reply
 
-                    emit coilsRead(startAddress, values);
+                if (read.type == QModbusDataUnit::Coils) {
+                    QVector<bool> values;
+                    values.reserve(range.count);
+                    for (qsizetype i = 0; i < range.count; ++i)
+                        values.append(unit.value(offset + i));
+
+                    emit coilsRead(read.deviceId, range.startAddress, values,
+                                   *sentNs, receivedNs);
+                } else {
+                    emit holdingRegistersRead(read.deviceId, range.startAddress,
+                                              unit.values().mid(offset, range.count),
+                                              *sentNs, receivedNs);
+                }
+            }
+        });
+}
 
-                    QJsonArray arr;
-                    for (bool v : values)
-                        arr.append(v);
+void ModbusController::completePolls(const PlannedRead &read)
+{
+    for (const ReadRange &range : read.members)
+        if (range.id)
+            m_scheduler->complete(range.id);
+}
 
-                    QJsonObject obj;
-                    obj["type"] = "coils";
-                    obj["start"] = startAddress;
-                    obj["values"] = arr;
+// Polling
+int ModbusController::addPollGroup(int functionCode, int startAddress, int count,
+                                   int unitId, int periodMs)
+{
+    return schedulePollGroup(0, unitId, functionCode, startAddress, count, periodMs);
+}
 
-                    QJsonDocument doc(obj);
-                });
-    } else {
-        reply->deleteLater();
+int ModbusController::addDevicePollGroup(int deviceId, int functionCode,
+                                         int startAddress, int count, int periodMs)
+{
+    if (!m_pool->contains(deviceId)) {
+        GW_WARN("Cannot add poll group: unknown device #%1", deviceId);
+        return 0;
     }
+    return schedulePollGroup(deviceId, m_pool->unitId(deviceId),
+                             functionCode, startAddress, count, periodMs);
 }
 
-void ModbusController::writeSingleCoil(int address, bool value)
+int ModbusController::schedulePollGroup(int deviceId, int unitId, int functionCode,
+                                        int startAddress, int count, int periodMs)
 {
-    if (!m_client || m_client->state() != QModbusDevice::ConnectedState) {
-        log("Cannot write coil: not connected");
-        return;
-    }
+    PollGroup group;
 
-    if (address < 0) {
-        log("Cannot write coil: invalid address");
-        return;
+    switch (functionCode) {
+    case 1:
+        group.type = QModbusDataUnit::Coils;
+        break;
+    case 3:
+        group.type = QModbusDataUnit::HoldingRegisters;
+        break;
+    default:
+        GW_WARN("Cannot add poll group: unsupported function code %1", functionCode);
+        return 0;
     }
 
-    QModbusDataUnit request(QModbusDataUnit::Coils, address, 1);
-    request.setValue(0, value);
+    if (startAddress < 0 || count <= 0 || periodMs <= 0) {
+        GW_WARN("Cannot add poll group: invalid range or period");
+        return 0;
+    }
 
-    auto *reply = m_client->sendWriteRequest(request, m_unitId);
-    if (!reply) {
-        log("Write coil request failed to send");
-        return;
+    // A group is read with one request
+    const int limit = (group.type == QModbusDataUnit::Coils) ? ReadPlanner::MaxCoils
+                                                             : ReadPlanner::MaxRegisters;
+    if (count > limit) {
+        GW_WARN("Cannot add poll group: %1 values, at most %2 per request", count, limit);
+        return 0;
     }
 
-    if (!reply->isFinished()) {
-        connect(reply, &QModbusReply::finished, this,
-                [this, reply, address, value]() {
-                    reply->deleteLater();
+    group.deviceId = deviceId;
+    group.startAddress = startAddress;
+    group.count = count;
+    group.unitId = unitId;
+    group.periodMs = periodMs;
 
-                    if (reply->error() != QModbusDevice::NoError) {
-                        log("Write coil error: " + reply->errorString());
-                        return;
-                    }
+    return m_scheduler->addGroup(group);
+}
 
-                    log(QString("Wrote coil %1 = %2")
-                            .arg(address)
-                            .arg(value));
+void ModbusController::removePollGroup(int id)
+{
+    m_scheduler->removeGroup(id);
+}
 
-                    emit coilWritten(address, value);
-                });
-    } else {
-        reply->deleteLater();
-    }
+void ModbusController::startPolling()
+{
+    GW_INFO("Polling started (%1 groups)", m_scheduler->groupCount());
+    m_scheduler->start();
 }
 
-void ModbusController::writeMultipleCoils(int startAddress, const QVector<bool> &values)
+void ModbusController::stopPolling()
 {
-    if (!m_client || m_client->state() != QModbusDevice::ConnectedState) {
-        log("Cannot write coils: not connected");
-        return;
-    }
+    m_scheduler->stop();
+    GW_INFO("Polling stopped");
+}
 
-    if (values.isEmpty()) {
-        log("Cannot write coils: values list is empty");
+void ModbusController::setPollSlowdown(int factor)
+{
+    if (factor == m_scheduler->slowdown())
         return;
-    }
 
-    QModbusDataUnit request(QModbusDataUnit::Coils, startAddress, values.size());
+    m_scheduler->setSlowdown(factor);
+    if (factor > 1)
+        GW_INFO("Polling slowed down x%1", factor);
+    else
+        GW_INFO("Polling back to configured rate");
+}
 
-    for (int i = 0; i < values.size(); ++i)
-        request.setValue(i, values[i]);
+QVariantMap ModbusController::pollStats() const
+{
+    const PollGroupStats total = m_scheduler->totalStats();
+    const quint64 samples = total.ticks + total.skipped;
+
+    QVariantMap map;
+    map["groups"] = m_scheduler->groupCount();
+    map["slowdown"] = m_scheduler->slowdown();
+    map["ticks"] = total.ticks;
+    map["skipped"] = total.skipped;
+    map["maxJitterUs"] = total.maxJitterUs;
+    map["avgJitterUs"] = samples ? double(total.totalJitterUs) / samples : 0.0;
+    return map;
+}
 
-    auto *reply = m_client->sendWriteRequest(request, m_unitId);
-    if (!reply) {
-        log("Write multiple coils request failed to send");
-        return;
+void ModbusController::onPollDue(const QList<PollGroup> &groups)
+{
+    QList<ReadRange> ranges;
+    ranges.reserve(groups.size());
+
+    for (const PollGroup &group : groups) {
+        const int deviceId = resolveDevice(group.deviceId, group.unitId);
+
+        // No point in queueing requests (and log lines) while offline
+        if (!deviceId || !m_pool->isConnected(deviceId)) {
+            m_scheduler->complete(group.id);
+            continue;
+        }
+
+        ReadRange range;
+        range.id = group.id;
+        range.type = group.type;
+        range.deviceId = deviceId;
+        range.startAddress = group.startAddress;
+        range.count = group.count;
+        ranges.append(range);
     }
 
-    if (!reply->isFinished()) {
-        connect(reply, &QModbusReply::finished, this,
-                [this, reply, startAddress, values]() {
-                    reply->deleteLater();
-
-                    if (reply->error() != QModbusDevice::NoError) {
-                        log("Write multiple coils error: " + reply->errorString());
-                        return;
-                    }
+    // Groups due together are merged into as few PDUs as possible
+    const QList<PlannedRead> reads = m_planner.plan(ranges);
+    for (const PlannedRead &read : reads)
+        sendRead(read);
+}
 
-                    log(QString("Wrote %1 coils starting at %2")
-                            .arg(values.size())
-                            .arg(startAddress));
+void ModbusController::setReadGap(int registers, int coils)
+{
+    m_planner.setMaxGap(registers, coils);
+}
 
-                    emit multipleCoilsWritten(startAddress, values.size());
-                });
-    } else {
-        reply->deleteLater();
-    }
+QVariantMap ModbusController::plannerStats() const
+{
+    const ReadPlannerStats &stats = m_planner.stats();
+
+    QVariantMap map;
+    map["requestedRanges"] = stats.requestedRanges;
+    map["roundTrips"] = stats.roundTrips;
+    map["savedRoundTrips"] = stats.savedRoundTrips();
+    map["gapValues"] = stats.gapValues;
+    return map;
 }
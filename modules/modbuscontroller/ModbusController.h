@@ -3,12 +3,21 @@
 
 #include <QObject>
 #include <QTimer>
+#include <QVariantMap>
+#include <QHash>
+#include <QSet>
 
 // Проверить установку пакетов Qt Serial Bus и Qt Serial Port (без последнего не соберётся!)
 #include <QtSerialBus/QModbusTcpClient>
 #include <QtSerialBus/QModbusDevice>
 
 #include "ModbusTypes.h"
+#include "Logger.h"
+#include "ModbusDevicePool.h"
+#include "PollScheduler.h"
+#include "ReadPlanner.h"
+#include "WriteCoalescer.h"
+#include "PacketTrace.h"
 
 class ModbusController : public QObject
 {
@@ -17,13 +26,24 @@ class ModbusController : public QObject
 public:
     Q_PROPERTY(ModbusTypes::ConnectionState state READ state NOTIFY stateChanged)
 
+    static constexpr int DefaultWriteWindowMs = 5;
+
     explicit ModbusController(QObject *parent = nullptr);
 
     ModbusTypes::ConnectionState state() const;
 
-    // TCP/IP connection
+    // TCP/IP connection (default device)
     Q_INVOKABLE void connectToServer(const QString &host, int port, int unitId);
     Q_INVOKABLE void disconnectFromServer();
+    // Device registry: devices on the same host:port share one connection.
+    // maxOutstanding 0 keeps the limit of an already registered device.
+    Q_INVOKABLE int addDevice(const QString &host, int port, int unitId,
+                              int maxOutstanding = 0);
+    Q_INVOKABLE void removeDevice(int deviceId);
+    Q_INVOKABLE void connectDevices();
+    Q_INVOKABLE void disconnectDevices();
+    Q_INVOKABLE QString deviceName(int deviceId) const;
+    Q_INVOKABLE QVariantList deviceStats() const;
     // Holding registers
     Q_INVOKABLE void readHoldingRegisters(int startAddress, int count);
     Q_INVOKABLE void writeHoldingRegister(int address, int value);
@@ -31,29 +51,90 @@ public:
     Q_INVOKABLE void readCoils(int startAddress, int count);
     Q_INVOKABLE void writeSingleCoil(int address, bool value);
     Q_INVOKABLE void writeMultipleCoils(int startAddress, const QVector<bool>& values);
+    // Writes are queued per device (0 = default device): values written within
+    // the write window are merged into FC15/FC16 requests, the last value per
+    // address wins. A non-zero writeId is reported through writeCompleted().
+    Q_INVOKABLE void writeRegisters(int writeId, int deviceId, int startAddress,
+                                    const QVector<quint16>& values);
+    Q_INVOKABLE void writeCoils(int writeId, int deviceId, int startAddress,
+                                const QVector<bool>& values);
+    Q_INVOKABLE void setWriteWindow(int ms);
+    // Sends the queued writes now instead of at the end of the window
+    void flushWrites();
+    Q_INVOKABLE QVariantMap writeStats() const;
+    // Continuous acquisition (function code 1 = coils, 3 = holding registers);
+    // count up to 2000 coils / 125 registers (one request), 0 = rejected
+    Q_INVOKABLE int addPollGroup(int functionCode, int startAddress, int count,
+                                 int unitId, int periodMs);
+    Q_INVOKABLE int addDevicePollGroup(int deviceId, int functionCode,
+                                       int startAddress, int count, int periodMs);
+    Q_INVOKABLE void removePollGroup(int id);
+    Q_INVOKABLE void startPolling();
+    Q_INVOKABLE void stopPolling();
+    Q_INVOKABLE QVariantMap pollStats() const;
+    // Poll every group factor times less often (1 = configured rate)
+    Q_INVOKABLE void setPollSlowdown(int factor);
+    // Largest hole read through when merging polled ranges into one request
+    Q_INVOKABLE void setReadGap(int registers, int coils);
+    Q_INVOKABLE QVariantMap plannerStats() const;
 
 signals:
     void stateChanged(ModbusTypes::ConnectionState state);
-    void logMessage(const QString &message);
 
-    void holdingRegistersRead(int startAddress, const QVector<quint16> &values); // Регистры 16бит
-    void coilsRead(int startAddress, const QVector<bool>& values);
-    void coilWritten(int address, bool value);
-    void multipleCoilsWritten(int startAddress, int count);
+    // sentNs / receivedNs: monotonic request and reply stamps (PacketTrace clock)
+    void holdingRegistersRead(int deviceId, int startAddress, const QVector<quint16> &values,
+                              qint64 sentNs, qint64 receivedNs); // Регистры 16бит
+    void coilsRead(int deviceId, int startAddress, const QVector<bool>& values,
+                   qint64 sentNs, qint64 receivedNs);
+    // Once every value of the write is acknowledged or one request failed
+    void writeCompleted(int writeId, bool ok, const QString &error);
 
 private slots:
-    void onStateChanged(QModbusDevice::State state);
-    void onErrorOccurred(QModbusDevice::Error error);
+    void onDeviceStateChanged(int deviceId, QModbusDevice::State state);
+    void onDeviceError(int deviceId, const QString &message);
+    void onPollDue(const QList<PollGroup> &groups);
 
 private:
     void setState(ModbusTypes::ConnectionState newState);
-    void log(const QString &text);
+    PlannedRead singleRead(QModbusDataUnit::RegisterType type,
+                           int startAddress, int count) const;
+    void sendRead(const PlannedRead &read);
+    void completePolls(const PlannedRead &read);
+    int resolveDevice(int deviceId, int unitId);
+    int schedulePollGroup(int deviceId, int unitId, int functionCode,
+                          int startAddress, int count, int periodMs);
+    void queueWrite(int writeId, int deviceId, QModbusDataUnit::RegisterType type,
+                    int startAddress, const QVector<quint16> &values);
+    void sendWrite(const WriteBatch &batch);
+    void completeWrite(int writeId, const QString &error);
 
     // Modbus
     ModbusTypes::ConnectionState m_state = ModbusTypes::Disconnected;
-    QModbusTcpClient *m_client = nullptr;
+    ModbusDevicePool *m_pool = nullptr;
+    PollScheduler *m_scheduler = nullptr;
+    ReadPlanner m_planner;
+
+    // Writes
+    struct WriteState
+    {
+        int remaining = 0;      // requests not yet answered
+        QString error;          // first failure
+    };
 
+    WriteCoalescer m_writes;
+    QTimer *m_writeTimer = nullptr;
+    int m_writeWindowMs = DefaultWriteWindowMs;
+    QHash<int, WriteState> m_writeStates;
+    quint64 m_failedWrites = 0;
+
+    // Default device (connectToServer)
+    QString m_host;
+    int m_port = 0;
     int m_unitId = 1;
+    int m_defaultDevice = 0;
+
+    QSet<int> m_explicitDevices;    // added through addDevice()
+    QSet<int> m_implicitDevices;    // other unit ids on the default endpoint
 };
 
 #endif // __MODBUSCONTROLLER_H__
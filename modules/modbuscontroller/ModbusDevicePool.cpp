@@ -0,0 +1,240 @@
+#include "ModbusDevicePool.h"
+
+#include <QVariantMap>
+
+ModbusDevicePool::ModbusDevicePool(QObject *parent) : QObject(parent)
+{
+}
+
+QString ModbusDevicePool::endpointKey(const QString &host, int port)
+{
+    return QString("%1:%2").arg(host).arg(port);
+}
+
+int ModbusDevicePool::addDevice(const QString &host, int port, int unitId,
+                                int maxOutstanding)
+{
+    const QString endpoint = endpointKey(host, port);
+    const QString key = QString("%1/%2").arg(endpoint).arg(unitId);
+
+    if (const int existing = m_deviceByKey.value(key)) {
+        if (maxOutstanding > 0)
+            m_devices.value(existing)->maxOutstanding = maxOutstanding;
+        return existing;
+    }
+
+    Endpoint &ep = m_endpoints[endpoint];
+    if (!ep.client) {
+        auto *client = new QModbusTcpClient(this);
+        client->setConnectionParameter(QModbusDevice::NetworkAddressParameter, host);
+        client->setConnectionParameter(QModbusDevice::NetworkPortParameter, port);
+        client->setTimeout(3000);
+        client->setNumberOfRetries(3);
+
+        connect(client, &QModbusClient::stateChanged, this,
+                [this, endpoint](QModbusDevice::State state) {
+                    for (int id : devicesOn(endpoint))
+                        emit deviceStateChanged(id, state);
+                });
+
+        connect(client, &QModbusClient::errorOccurred, this,
+                [this, endpoint, client](QModbusDevice::Error error) {
+                    if (error == QModbusDevice::NoError)
+                        return;
+                    for (int id : devicesOn(endpoint))
+                        emit deviceError(id, client->errorString());
+                });
+
+        ep.client = client;
+    }
+    ++ep.devices;
+
+    auto device = std::make_shared<Device>();
+    device->id = m_nextId++;
+    device->endpoint = endpoint;
+    device->unitId = unitId;
+    device->maxOutstanding = maxOutstanding > 0 ? maxOutstanding : DefaultMaxOutstanding;
+
+    m_devices.insert(device->id, device);
+    m_deviceByKey.insert(key, device->id);
+    return device->id;
+}
+
+bool ModbusDevicePool::removeDevice(int deviceId)
+{
+    const std::shared_ptr<Device> device = m_devices.take(deviceId);
+    if (!device)
+        return false;
+
+    m_deviceByKey.remove(QString("%1/%2").arg(device->endpoint).arg(device->unitId));
+
+    while (!device->pending.isEmpty())
+        device->pending.dequeue().done(nullptr);
+
+    auto ep = m_endpoints.find(device->endpoint);
+    if (ep != m_endpoints.end() && --ep->devices == 0) {
+        ep->client->disconnectDevice();
+        ep->client->deleteLater();
+        m_endpoints.erase(ep);
+    }
+    return true;
+}
+
+QModbusTcpClient *ModbusDevicePool::clientFor(const Device &device) const
+{
+    return m_endpoints.value(device.endpoint).client;
+}
+
+QList<int> ModbusDevicePool::devicesOn(const QString &endpoint) const
+{
+    QList<int> ids;
+    for (const auto &device : m_devices)
+        if (device->endpoint == endpoint)
+            ids.append(device->id);
+    return ids;
+}
+
+void ModbusDevicePool::connectDevice(int deviceId)
+{
+    const auto device = m_devices.value(deviceId);
+    QModbusTcpClient *client = device ? clientFor(*device) : nullptr;
+    if (!client)
+        return;
+
+    // The connection may already be up for another unit on the same endpoint
+    if (client->state() == QModbusDevice::UnconnectedState)
+        client->connectDevice();
+    else
+        emit deviceStateChanged(deviceId, client->state());
+}
+
+void ModbusDevicePool::disconnectDevice(int deviceId)
+{
+    const auto device = m_devices.value(deviceId);
+    if (QModbusTcpClient *client = device ? clientFor(*device) : nullptr)
+        client->disconnectDevice();
+}
+
+void ModbusDevicePool::connectAll()
+{
+    for (const Endpoint &ep : std::as_const(m_endpoints))
+        if (ep.client->state() == QModbusDevice::UnconnectedState)
+            ep.client->connectDevice();
+}
+
+void ModbusDevicePool::disconnectAll()
+{
+    for (const Endpoint &ep : std::as_const(m_endpoints))
+        ep.client->disconnectDevice();
+}
+
+bool ModbusDevicePool::isConnected(int deviceId) const
+{
+    return deviceState(deviceId) == QModbusDevice::ConnectedState;
+}
+
+QModbusDevice::State ModbusDevicePool::deviceState(int deviceId) const
+{
+    const auto device = m_devices.value(deviceId);
+    QModbusTcpClient *client = device ? clientFor(*device) : nullptr;
+    return client ? client->state() : QModbusDevice::UnconnectedState;
+}
+
+QString ModbusDevicePool::deviceName(int deviceId) const
+{
+    const auto device = m_devices.value(deviceId);
+    return device ? QString("%1/%2").arg(device->endpoint).arg(device->unitId) : QString();
+}
+
+int ModbusDevicePool::unitId(int deviceId) const
+{
+    const auto device = m_devices.value(deviceId);
+    return device ? device->unitId : 0;
+}
+
+void ModbusDevicePool::submit(int deviceId, Sender send, Handler done)
+{
+    const auto device = m_devices.value(deviceId);
+    if (!device) {
+        done(nullptr);
+        return;
+    }
+
+    Pending request { std::move(send), std::move(done) };
+
+    if (device->outstanding < device->maxOutstanding) {
+        dispatch(device, std::move(request));
+    } else {
+        device->pending.enqueue(std::move(request));
+        device->maxQueued = qMax(device->maxQueued, int(device->pending.size()));
+    }
+}
+
+void ModbusDevicePool::dispatch(const std::shared_ptr<Device> &device, Pending request)
+{
+    QModbusTcpClient *client = clientFor(*device);
+    QModbusReply *reply = nullptr;
+
+    if (client && client->state() == QModbusDevice::ConnectedState)
+        reply = request.send(client, device->unitId);
+
+    if (!reply) {
+        ++device->failed;
+        request.done(nullptr);
+        return;
+    }
+
+    // Broadcast requests finish immediately
+    if (reply->isFinished()) {
+        ++device->completed;
+        request.done(reply);
+        reply->deleteLater();
+        return;
+    }
+
+    ++device->outstanding;
+    ++device->sent;
+
+    connect(reply, &QModbusReply::finished, this,
+            [this, device, reply, done = std::move(request.done)]() {
+                --device->outstanding;
+                if (reply->error() == QModbusDevice::NoError)
+                    ++device->completed;
+                else
+                    ++device->failed;
+
+                done(reply);
+                reply->deleteLater();
+                release(device);
+            });
+}
+
+void ModbusDevicePool::release(const std::shared_ptr<Device> &device)
+{
+    // Device may have been removed from inside the handler
+    if (m_devices.value(device->id) != device)
+        return;
+
+    while (device->outstanding < device->maxOutstanding && !device->pending.isEmpty())
+        dispatch(device, device->pending.dequeue());
+}
+
+QVariantList ModbusDevicePool::stats() const
+{
+    QVariantList list;
+    for (const auto &device : m_devices) {
+        QVariantMap map;
+        map["id"] = device->id;
+        map["name"] = deviceName(device->id);
+        map["state"] = int(deviceState(device->id));
+        map["maxOutstanding"] = device->maxOutstanding;
+        map["outstanding"] = device->outstanding;
+        map["queued"] = int(device->pending.size());
+        map["maxQueued"] = device->maxQueued;
+        map["sent"] = device->sent;
+        map["completed"] = device->completed;
+        map["failed"] = device->failed;
+        list.append(map);
+    }
+    return list;
+}
@@ -0,0 +1,103 @@
+#ifndef __MODBUSDEVICEPOOL_H__
+#define __MODBUSDEVICEPOOL_H__
+
+#include <QObject>
+#include <QHash>
+#include <QQueue>
+#include <QVariantList>
+
+#include <QtSerialBus/QModbusTcpClient>
+#include <QtSerialBus/QModbusReply>
+
+#include <functional>
+#include <memory>
+
+// Registry of Modbus TCP devices keyed by host:port + unit id.
+//
+// Devices on the same host:port share one pooled QModbusTcpClient. Modbus
+// TCP matches replies by transaction id, so several requests can be on the
+// wire at once; each device has its own limit (1 for devices that cannot
+// pipeline) and requests beyond it wait in a per-device FIFO.
+class ModbusDevicePool : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultMaxOutstanding = 4;
+
+    // Issues the request on the pooled client; nullptr if it could not be sent
+    using Sender = std::function<QModbusReply *(QModbusTcpClient *client, int unitId)>;
+    // Called once per request: with the finished reply, or nullptr if never sent.
+    // The pool deletes the reply afterwards.
+    using Handler = std::function<void(QModbusReply *reply)>;
+
+    explicit ModbusDevicePool(QObject *parent = nullptr);
+
+    // Returns the existing id if the same host:port/unit is already registered.
+    // maxOutstanding <= 0 keeps the limit of an existing device
+    // (DefaultMaxOutstanding for a new one).
+    int addDevice(const QString &host, int port, int unitId, int maxOutstanding = 0);
+    bool removeDevice(int deviceId);
+    bool contains(int deviceId) const { return m_devices.contains(deviceId); }
+    QList<int> deviceIds() const { return m_devices.keys(); }
+
+    void connectDevice(int deviceId);
+    void disconnectDevice(int deviceId);
+    void connectAll();
+    void disconnectAll();
+
+    bool isConnected(int deviceId) const;
+    QModbusDevice::State deviceState(int deviceId) const;
+    QString deviceName(int deviceId) const;     // "host:port/unit"
+    int unitId(int deviceId) const;
+
+    void submit(int deviceId, Sender send, Handler done);
+
+    QVariantList stats() const;
+
+signals:
+    void deviceStateChanged(int deviceId, QModbusDevice::State state);
+    void deviceError(int deviceId, const QString &message);
+
+private:
+    struct Pending
+    {
+        Sender send;
+        Handler done;
+    };
+
+    struct Device
+    {
+        int id = 0;
+        QString endpoint;       // host:port
+        int unitId = 1;
+        int maxOutstanding = DefaultMaxOutstanding;
+        int outstanding = 0;
+        QQueue<Pending> pending;
+
+        quint64 sent = 0;
+        quint64 completed = 0;
+        quint64 failed = 0;
+        int maxQueued = 0;
+    };
+
+    struct Endpoint
+    {
+        QModbusTcpClient *client = nullptr;
+        int devices = 0;
+    };
+
+    static QString endpointKey(const QString &host, int port);
+
+    QModbusTcpClient *clientFor(const Device &device) const;
+    QList<int> devicesOn(const QString &endpoint) const;
+    void dispatch(const std::shared_ptr<Device> &device, Pending request);
+    void release(const std::shared_ptr<Device> &device);
+
+    QHash<int, std::shared_ptr<Device>> m_devices;
+    QHash<QString, int> m_deviceByKey;          // "host:port/unit" -> id
+    QHash<QString, Endpoint> m_endpoints;
+    int m_nextId = 1;
+};
+
+#endif // __MODBUSDEVICEPOOL_H__
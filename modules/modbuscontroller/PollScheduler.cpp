@@ -0,0 +1,194 @@
+#include "PollScheduler.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Groups due within this window are fired together (and batched)
+const qint64 CoalesceWindowNs = 1000000;
+
+}
+
+PollScheduler::PollScheduler(QObject *parent) : QObject(parent), m_timer(this)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+
+    connect(&m_timer, &QTimer::timeout,
+            this, &PollScheduler::onTimeout);
+
+    m_clock.start();
+}
+
+int PollScheduler::addGroup(const PollGroup &group)
+{
+    Entry entry;
+    entry.group = group;
+    entry.group.id = m_nextId++;
+    entry.group.periodMs = qMax(1, group.periodMs);
+
+    const int id = entry.group.id;
+    Entry &stored = m_groups.insert(id, entry).value();
+
+    if (m_running) {
+        stored.deadlineNs = m_clock.nsecsElapsed();
+        schedule(id, stored);
+        arm();
+    }
+    return id;
+}
+
+bool PollScheduler::removeGroup(int id)
+{
+    if (!m_groups.remove(id))
+        return false;
+
+    // Heap items of removed groups are skipped on pop; compact when they pile up
+    if (m_heap.size() > size_t(2 * m_groups.size() + 16)) {
+        m_heap.erase(std::remove_if(m_heap.begin(), m_heap.end(),
+                                    [this](const HeapItem &item) {
+                                        return !m_groups.contains(item.id);
+                                    }),
+                     m_heap.end());
+        std::make_heap(m_heap.begin(), m_heap.end(), std::greater<HeapItem>());
+    }
+    return true;
+}
+
+void PollScheduler::clear()
+{
+    m_groups.clear();
+    m_heap.clear();
+    m_timer.stop();
+}
+
+void PollScheduler::start()
+{
+    if (m_running)
+        return;
+
+    m_running = true;
+    m_heap.clear();
+
+    const qint64 now = m_clock.nsecsElapsed();
+    for (auto it = m_groups.begin(); it != m_groups.end(); ++it) {
+        it->deadlineNs = now;
+        it->inFlight = false;
+        schedule(it.key(), it.value());
+    }
+    arm();
+}
+
+void PollScheduler::stop()
+{
+    m_running = false;
+    m_heap.clear();
+    m_timer.stop();
+}
+
+void PollScheduler::setSlowdown(int factor)
+{
+    // Takes effect from each group's next deadline on
+    m_slowdown = qMax(1, factor);
+}
+
+void PollScheduler::complete(int id)
+{
+    auto it = m_groups.find(id);
+    if (it != m_groups.end())
+        it->inFlight = false;
+}
+
+QList<PollGroup> PollScheduler::groups() const
+{
+    QList<PollGroup> out;
+    out.reserve(m_groups.size());
+    for (const Entry &e : m_groups)
+        out.append(e.group);
+    return out;
+}
+
+PollGroupStats PollScheduler::stats(int id) const
+{
+    return m_groups.value(id).stats;
+}
+
+PollGroupStats PollScheduler::totalStats() const
+{
+    PollGroupStats total;
+    for (const Entry &e : m_groups) {
+        total.ticks += e.stats.ticks;
+        total.skipped += e.stats.skipped;
+        total.totalJitterUs += e.stats.totalJitterUs;
+        total.maxJitterUs = qMax(total.maxJitterUs, e.stats.maxJitterUs);
+    }
+    return total;
+}
+
+void PollScheduler::schedule(int id, Entry &entry)
+{
+    entry.generation = ++m_generation;
+    m_heap.push_back({ entry.deadlineNs, id, entry.generation });
+    std::push_heap(m_heap.begin(), m_heap.end(), std::greater<HeapItem>());
+}
+
+void PollScheduler::arm()
+{
+    if (!m_running || m_heap.empty()) {
+        m_timer.stop();
+        return;
+    }
+
+    const qint64 waitNs = m_heap.front().deadlineNs - m_clock.nsecsElapsed();
+    m_timer.start(int(qMax<qint64>(0, (waitNs + 999999) / 1000000)));
+}
+
+void PollScheduler::onTimeout()
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    QList<PollGroup> batch;
+
+    while (!m_heap.empty() && m_heap.front().deadlineNs <= now + CoalesceWindowNs)
+    {
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<HeapItem>());
+        const HeapItem item = m_heap.back();
+        m_heap.pop_back();
+
+        auto it = m_groups.find(item.id);
+        if (it == m_groups.end() || it->generation != item.generation)
+            continue;
+
+        Entry &e = it.value();
+        const qint64 periodNs = qint64(e.group.periodMs) * m_slowdown * 1000000;
+
+        const qint64 jitterUs = qAbs(now - e.deadlineNs) / 1000;
+        e.stats.lastJitterUs = jitterUs;
+        e.stats.maxJitterUs = qMax(e.stats.maxJitterUs, jitterUs);
+        e.stats.totalJitterUs += jitterUs;
+
+        if (e.inFlight) {
+            ++e.stats.skipped;
+        } else {
+            e.inFlight = true;
+            ++e.stats.ticks;
+            batch.append(e.group);
+        }
+
+        // Next deadline stays on the period grid; whole periods we are
+        // already late for are skipped, not replayed
+        e.deadlineNs += periodNs;
+        if (e.deadlineNs <= now) {
+            const qint64 missed = (now - e.deadlineNs) / periodNs + 1;
+            e.stats.skipped += quint64(missed);
+            e.deadlineNs += missed * periodNs;
+        }
+
+        schedule(item.id, e);
+    }
+
+    arm();
+
+    if (!batch.isEmpty())
+        emit due(batch);
+}
@@ -0,0 +1,109 @@
+#ifndef __POLLSCHEDULER_H__
+#define __POLLSCHEDULER_H__
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+
+#include <QModbusDataUnit>
+
+#include <vector>
+
+struct PollGroup
+{
+    int id = 0;
+    int deviceId = 0;           // 0 = default connection, unit from unitId
+    QModbusDataUnit::RegisterType type = QModbusDataUnit::HoldingRegisters;
+    int startAddress = 0;
+    int count = 0;
+    int unitId = 1;
+    int periodMs = 1000;
+};
+
+struct PollGroupStats
+{
+    quint64 ticks = 0;          // requests issued
+    quint64 skipped = 0;        // ticks dropped (overrun or still in flight)
+    qint64 lastJitterUs = 0;    // wake-up lateness vs. deadline
+    qint64 maxJitterUs = 0;
+    qint64 totalJitterUs = 0;
+};
+
+// Single-timer deadline scheduler for periodic poll groups.
+// Deadlines live in a min-heap; one precise QTimer is armed for the earliest
+// one, so idle cost does not depend on the number of groups. A group whose
+// previous request is still in flight, or whose deadline has already passed
+// by a whole period, skips ticks instead of queueing them up.
+class PollScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PollScheduler(QObject *parent = nullptr);
+
+    int addGroup(const PollGroup &group);     // returns assigned id
+    bool removeGroup(int id);
+    void clear();
+
+    void start();
+    void stop();
+    bool isRunning() const { return m_running; }
+
+    // Stretch every period by factor (>= 1), e.g. while downstream is congested
+    void setSlowdown(int factor);
+    int slowdown() const { return m_slowdown; }
+
+    // Reply for the group arrived (or failed); it may be polled again
+    void complete(int id);
+
+    int groupCount() const { return m_groups.size(); }
+    QList<PollGroup> groups() const;
+    PollGroupStats stats(int id) const;
+    PollGroupStats totalStats() const;
+
+signals:
+    // All groups that became due on the same wake-up
+    void due(const QList<PollGroup> &groups);
+
+private slots:
+    void onTimeout();
+
+private:
+    struct Entry
+    {
+        PollGroup group;
+        qint64 deadlineNs = 0;
+        quint32 generation = 0;
+        bool inFlight = false;
+        PollGroupStats stats;
+    };
+
+    struct HeapItem
+    {
+        qint64 deadlineNs;
+        int id;
+        quint32 generation;
+
+        bool operator>(const HeapItem &other) const
+        {
+            return deadlineNs > other.deadlineNs;
+        }
+    };
+
+    void schedule(int id, Entry &entry);
+    void arm();
+
+    QHash<int, Entry> m_groups;
+    std::vector<HeapItem> m_heap;     // stale items are dropped lazily
+    QTimer m_timer;                   // child, so it follows moveToThread()
+    QElapsedTimer m_clock;
+
+    int m_nextId = 1;
+    int m_slowdown = 1;
+    quint32 m_generation = 0;
+    bool m_running = false;
+};
+
+#endif // __POLLSCHEDULER_H__
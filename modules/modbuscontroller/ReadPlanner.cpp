@@ -0,0 +1,60 @@
+#include "ReadPlanner.h"
+
+#include <algorithm>
+
+void ReadPlanner::setMaxGap(int registers, int coils)
+{
+    m_maxRegisterGap = qMax(0, registers);
+    m_maxCoilGap = qMax(0, coils);
+}
+
+QList<PlannedRead> ReadPlanner::plan(QList<ReadRange> ranges)
+{
+    std::sort(ranges.begin(), ranges.end(),
+              [](const ReadRange &a, const ReadRange &b) {
+                  if (a.deviceId != b.deviceId)
+                      return a.deviceId < b.deviceId;
+                  if (a.type != b.type)
+                      return a.type < b.type;
+                  return a.startAddress < b.startAddress;
+              });
+
+    QList<PlannedRead> plans;
+
+    for (const ReadRange &range : ranges)
+    {
+        const bool coils = range.type == QModbusDataUnit::Coils;
+        const int limit = coils ? MaxCoils : MaxRegisters;
+        const int gap = coils ? m_maxCoilGap : m_maxRegisterGap;
+        const int end = range.startAddress + range.count;
+
+        if (!plans.isEmpty()) {
+            PlannedRead &last = plans.last();
+            const int lastEnd = last.startAddress + last.count;
+
+            if (last.deviceId == range.deviceId && last.type == range.type
+                && range.startAddress <= lastEnd + gap
+                && qMax(lastEnd, end) - last.startAddress <= limit)
+            {
+                if (range.startAddress > lastEnd)
+                    m_stats.gapValues += quint64(range.startAddress - lastEnd);
+
+                last.count = qMax(lastEnd, end) - last.startAddress;
+                last.members.append(range);
+                continue;
+            }
+        }
+
+        PlannedRead read;
+        read.type = range.type;
+        read.deviceId = range.deviceId;
+        read.startAddress = range.startAddress;
+        read.count = range.count;
+        read.members.append(range);
+        plans.append(read);
+    }
+
+    m_stats.requestedRanges += quint64(ranges.size());
+    m_stats.roundTrips += quint64(plans.size());
+    return plans;
+}
@@ -0,0 +1,60 @@
+#ifndef __READPLANNER_H__
+#define __READPLANNER_H__
+
+#include <QList>
+#include <QModbusDataUnit>
+
+// One requested range (poll group id, or 0 for a one-off read)
+struct ReadRange
+{
+    int id = 0;
+    QModbusDataUnit::RegisterType type = QModbusDataUnit::HoldingRegisters;
+    int deviceId = 0;
+    int startAddress = 0;
+    int count = 0;
+};
+
+// One Modbus request covering one or more requested ranges
+struct PlannedRead
+{
+    QModbusDataUnit::RegisterType type = QModbusDataUnit::HoldingRegisters;
+    int deviceId = 0;
+    int startAddress = 0;
+    int count = 0;
+    QList<ReadRange> members;
+};
+
+struct ReadPlannerStats
+{
+    quint64 requestedRanges = 0;
+    quint64 roundTrips = 0;
+    quint64 gapValues = 0;      // values read only to bridge gaps
+
+    quint64 savedRoundTrips() const { return requestedRanges - roundTrips; }
+};
+
+// Merges overlapping or nearby ranges of the same device and function code
+// into the fewest requests that fit one PDU (125 registers / 2000 coils).
+class ReadPlanner
+{
+public:
+    static constexpr int MaxRegisters = 125;
+    static constexpr int MaxCoils = 2000;
+
+    // Largest hole (in values) that is read through instead of split
+    void setMaxGap(int registers, int coils);
+    int maxRegisterGap() const { return m_maxRegisterGap; }
+    int maxCoilGap() const { return m_maxCoilGap; }
+
+    QList<PlannedRead> plan(QList<ReadRange> ranges);
+
+    const ReadPlannerStats &stats() const { return m_stats; }
+    void resetStats() { m_stats = ReadPlannerStats(); }
+
+private:
+    int m_maxRegisterGap = 8;
+    int m_maxCoilGap = 64;
+    ReadPlannerStats m_stats;
+};
+
+#endif // __READPLANNER_H__
@@ -0,0 +1,80 @@
+#include "WriteCoalescer.h"
+
+void WriteCoalescer::add(int writeId, int deviceId, QModbusDataUnit::RegisterType type,
+                         int startAddress, const QVector<quint16> &values)
+{
+    ++m_stats.writes;
+    m_stats.values += values.size();
+
+    for (int i = 0; i < values.size(); ++i) {
+        Pending &pending = m_pending[key(deviceId, type, startAddress + i)];
+        if (!pending.writeIds.isEmpty())
+            ++m_stats.superseded;
+
+        pending.value = values[i];
+        if (!pending.writeIds.contains(writeId))
+            pending.writeIds.append(writeId);
+    }
+}
+
+QList<WriteBatch> WriteCoalescer::take()
+{
+    QList<WriteBatch> batches;
+
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+        const int deviceId = int(it.key() >> 33);
+        const auto type = (it.key() >> 32) & 1 ? QModbusDataUnit::Coils
+                                               : QModbusDataUnit::HoldingRegisters;
+        const int address = int(quint16(it.key()));
+        const int maxCount = type == QModbusDataUnit::Coils ? MaxCoils : MaxRegisters;
+
+        bool extend = false;
+        if (!batches.isEmpty()) {
+            const WriteBatch &last = batches.last();
+            extend = last.deviceId == deviceId && last.type == type
+                     && last.startAddress + last.values.size() == address
+                     && last.values.size() < maxCount;
+        }
+
+        if (!extend) {
+            WriteBatch batch;
+            batch.type = type;
+            batch.deviceId = deviceId;
+            batch.startAddress = address;
+            batches.append(batch);
+        }
+
+        WriteBatch &batch = batches.last();
+        batch.values.append(it.value().value);
+        for (int id : it.value().writeIds)
+            if (id && !batch.writeIds.contains(id))
+                batch.writeIds.append(id);
+    }
+
+    m_pending.clear();
+    m_stats.requests += batches.size();
+    return batches;
+}
+
+QVector<int> WriteCoalescer::removeDevice(int deviceId)
+{
+    QVector<int> lost;
+
+    auto it = m_pending.lowerBound(quint64(quint32(deviceId)) << 33);
+    while (it != m_pending.end() && int(it.key() >> 33) == deviceId) {
+        for (int id : it.value().writeIds)
+            if (id && !lost.contains(id))
+                lost.append(id);
+        it = m_pending.erase(it);
+    }
+    return lost;
+}
+
+// Device in the high bits, then coils after registers, then address:
+// iteration order is the batching order
+quint64 WriteCoalescer::key(int deviceId, QModbusDataUnit::RegisterType type, int address)
+{
+    return (quint64(quint32(deviceId)) << 33)
+           | (quint64(type == QModbusDataUnit::Coils ? 1 : 0) << 32)
+           | quint16(address);
+}
@@ -0,0 +1,70 @@
+#ifndef __WRITECOALESCER_H__
+#define __WRITECOALESCER_H__
+
+#include <QList>
+#include <QMap>
+#include <QModbusDataUnit>
+#include <QVector>
+
+// One Modbus write request (FC05/06 for one value, FC15/16 for more)
+// and the caller writes it carries
+struct WriteBatch
+{
+    QModbusDataUnit::RegisterType type = QModbusDataUnit::HoldingRegisters;
+    int deviceId = 0;
+    int startAddress = 0;
+    QVector<quint16> values;    // coils as 0/1
+    QVector<int> writeIds;      // distinct, 0 = not reported
+};
+
+struct WriteCoalescerStats
+{
+    quint64 writes = 0;         // add() calls
+    quint64 values = 0;         // values passed to add()
+    quint64 superseded = 0;     // values overwritten before they were sent
+    quint64 requests = 0;       // batches handed out
+
+    // Against one request per write
+    quint64 savedRequests() const { return writes > requests ? writes - requests : 0; }
+};
+
+// Collects register and coil writes per device and function code. A value
+// written again before take() replaces the pending one (last write wins,
+// both writes complete with the request that carries it). take() merges
+// contiguous addresses into the fewest requests that fit one PDU.
+// Not thread-safe; owned and called by a single thread.
+class WriteCoalescer
+{
+public:
+    static constexpr int MaxRegisters = 123;
+    static constexpr int MaxCoils = 1968;
+
+    void add(int writeId, int deviceId, QModbusDataUnit::RegisterType type,
+             int startAddress, const QVector<quint16> &values);
+
+    bool isEmpty() const { return m_pending.isEmpty(); }
+    int pendingValues() const { return m_pending.size(); }
+
+    // Everything pending, ordered by device, type and address
+    QList<WriteBatch> take();
+
+    // Drops the device's pending values; returns the writes that lost some
+    QVector<int> removeDevice(int deviceId);
+
+    const WriteCoalescerStats &stats() const { return m_stats; }
+    void resetStats() { m_stats = WriteCoalescerStats(); }
+
+private:
+    struct Pending
+    {
+        quint16 value = 0;
+        QVector<int> writeIds;
+    };
+
+    static quint64 key(int deviceId, QModbusDataUnit::RegisterType type, int address);
+
+    QMap<quint64, Pending> m_pending;
+    WriteCoalescerStats m_stats;
+};
+
+#endif // __WRITECOALESCER_H__
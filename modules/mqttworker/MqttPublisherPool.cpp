@@ -0,0 +1,325 @@
+#include "MqttPublisherPool.h"
+
+#include <QDir>
+#include <QVariantMap>
+
+#include "Logger.h"
+
+MqttPublisherPool::MqttPublisherPool(int shards)
+{
+    createShards(shards);
+}
+
+MqttPublisherPool::~MqttPublisherPool()
+{
+    // The owner is going away too; don't report the release
+    m_backpressureHandler = nullptr;
+    destroyShards();
+}
+
+void MqttPublisherPool::setShardCount(int shards)
+{
+    shards = qBound(1, shards, MaxShards);
+    if (shards == shardCount())
+        return;
+
+    destroyShards();
+    createShards(shards);
+
+    if (m_loaded)
+        loadFromDisk();
+}
+
+int MqttPublisherPool::shardOf(const MqttPacket& packet) const
+{
+    const int count = shardCount();
+    if (count == 1)
+        return 0;
+
+    const quint64 key = packet.routeKey ? packet.routeKey : qHash(packet.topicId);
+    // Fold the high bits in: route keys differ mostly in their low fields
+    return int((key ^ (key >> 32)) % quint64(count));
+}
+
+bool MqttPublisherPool::push(const MqttPacket& packet)
+{
+    return m_shards[size_t(shardOf(packet))].queue->push(packet);
+}
+
+void MqttPublisherPool::setLimits(int maxPackets, qint64 maxBytes)
+{
+    m_maxPackets = maxPackets;
+    m_maxBytes = maxBytes;
+    for (const Shard& shard : m_shards)
+        configure(*shard.queue);
+}
+
+void MqttPublisherPool::setOverflowPolicy(MessageQueue::OverflowPolicy policy, int blockTimeoutMs)
+{
+    m_policy = policy;
+    m_blockTimeoutMs = blockTimeoutMs;
+    for (const Shard& shard : m_shards)
+        shard.queue->setOverflowPolicy(policy, blockTimeoutMs);
+}
+
+void MqttPublisherPool::setCoalescing(bool enabled)
+{
+    m_coalescing = enabled;
+    for (const Shard& shard : m_shards)
+        shard.queue->setCoalescing(enabled);
+}
+
+void MqttPublisherPool::setBackpressureHandler(MessageQueue::BackpressureHandler handler)
+{
+    m_backpressureHandler = std::move(handler);
+}
+
+void MqttPublisherPool::enablePersistence(const QString& path)
+{
+    m_persistPath = path;
+    for (size_t i = 0; i < m_shards.size(); ++i)
+        m_shards[i].queue->enablePersistence(shardPath(int(i)));
+}
+
+void MqttPublisherPool::loadFromDisk()
+{
+    if (m_persistPath.isEmpty())
+        return;
+
+    for (const Shard& shard : m_shards)
+        shard.queue->loadFromDisk();
+    m_loaded = true;
+
+    adoptOrphanedBacklogs();
+}
+
+void MqttPublisherPool::start(const QString& host, const QString& clientId, int qos,
+                              int maxInFlight, int maxRetries, int retryBaseMs, int retryMaxMs,
+                              PipelineMetrics* metrics)
+{
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        Shard& shard = m_shards[i];
+
+        if (shard.worker) {
+            shard.worker->stop();
+            shard.worker->reset();
+        }
+
+        shard.worker = std::make_unique<MqttWorker>(
+            host,
+            QString("%1_%2").arg(clientId).arg(i),
+            qos,
+            shard.queue.get()
+            );
+        shard.worker->setMaxInFlight(maxInFlight);
+        shard.worker->setRetryPolicy(maxRetries, retryBaseMs, retryMaxMs);
+        shard.worker->setMetrics(metrics);
+        if (i == 0)
+            shard.worker->setSubscriptions(m_subscriptions, m_messageHandler);
+        shard.lastPublished = 0;
+
+        // Keep whatever was recovered from the log
+        shard.queue->resume();
+        shard.worker->start();
+    }
+
+    m_rateTimer.start();
+}
+
+void MqttPublisherPool::setSubscriptions(const QStringList& topicFilters,
+                                         MqttWorker::MessageHandler handler)
+{
+    m_subscriptions = topicFilters;
+    m_messageHandler = std::move(handler);
+}
+
+void MqttPublisherPool::stop()
+{
+    for (const Shard& shard : m_shards) {
+        if (shard.worker) {
+            shard.worker->stop();
+            shard.worker->reset();
+        }
+    }
+}
+
+void MqttPublisherPool::clear()
+{
+    for (const Shard& shard : m_shards)
+        shard.queue->clear();
+}
+
+void MqttPublisherPool::close()
+{
+    for (Shard& shard : m_shards)
+        shard.worker.reset();
+}
+
+MessageQueueStats MqttPublisherPool::queueStats() const
+{
+    MessageQueueStats total;
+    for (const Shard& shard : m_shards) {
+        const MessageQueueStats stats = shard.queue->stats();
+        total.size += stats.size;
+        total.bytes += stats.bytes;
+        total.droppedOldest += stats.droppedOldest;
+        total.droppedNewest += stats.droppedNewest;
+        total.blockTimeouts += stats.blockTimeouts;
+        total.coalesced += stats.coalesced;
+        total.backpressure = total.backpressure || stats.backpressure;
+    }
+    return total;
+}
+
+MqttWorkerStats MqttPublisherPool::workerStats() const
+{
+    MqttWorkerStats total;
+    total.connected = !m_shards.empty();
+    for (const Shard& shard : m_shards) {
+        if (!shard.worker) {
+            total.connected = false;
+            continue;
+        }
+
+        const MqttWorkerStats stats = shard.worker->stats();
+        total.connected = total.connected && stats.connected;
+        total.published += stats.published;
+        total.inFlight += stats.inFlight;
+        total.pendingRetries += stats.pendingRetries;
+        total.retried += stats.retried;
+        total.retryDropped += stats.retryDropped;
+        total.superseded += stats.superseded;
+        total.heldBack += stats.heldBack;
+        total.connectFailures += stats.connectFailures;
+    }
+    return total;
+}
+
+QVariantList MqttPublisherPool::shardStats() const
+{
+    const double seconds = m_rateTimer.isValid() ? m_rateTimer.restart() / 1000.0 : 0.0;
+
+    QVariantList list;
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        const Shard& shard = m_shards[i];
+        const MessageQueueStats queue = shard.queue->stats();
+
+        QVariantMap map;
+        map["shard"] = int(i);
+        map["queued"] = queue.size;
+        map["bytes"] = queue.bytes;
+        map["dropped"] = queue.droppedOldest + queue.droppedNewest;
+
+        if (shard.worker) {
+            const MqttWorkerStats stats = shard.worker->stats();
+            map["connected"] = stats.connected;
+            map["published"] = stats.published;
+            map["publishRate"] = seconds > 0 ? (stats.published - shard.lastPublished) / seconds : 0.0;
+            map["inFlight"] = stats.inFlight;
+            map["pendingRetries"] = stats.pendingRetries;
+            map["retried"] = stats.retried;
+            shard.lastPublished = stats.published;
+        }
+        list.append(map);
+    }
+    return list;
+}
+
+void MqttPublisherPool::createShards(int count)
+{
+    count = qBound(1, count, MaxShards);
+    m_pressuredShards.store(0);
+
+    m_shards.resize(size_t(count));
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        Shard& shard = m_shards[i];
+        shard.queue = std::make_unique<MessageQueue>();
+        shard.queue->setBackpressureHandler([this](bool active) { onShardBackpressure(active); });
+        configure(*shard.queue);
+        shard.queue->setOverflowPolicy(m_policy, m_blockTimeoutMs);
+        shard.queue->setCoalescing(m_coalescing);
+        if (!m_persistPath.isEmpty())
+            shard.queue->enablePersistence(shardPath(int(i)));
+    }
+}
+
+void MqttPublisherPool::destroyShards()
+{
+    // Workers first: they drain the queues
+    for (Shard& shard : m_shards)
+        shard.worker.reset();
+    m_shards.clear();
+
+    if (m_pressuredShards.exchange(0) > 0 && m_backpressureHandler)
+        m_backpressureHandler(false);
+}
+
+void MqttPublisherPool::configure(MessageQueue& queue) const
+{
+    const int count = shardCount();
+    const int maxPackets = m_maxPackets > 0 ? (m_maxPackets + count - 1) / count
+                                            : queue.capacity();
+    const qint64 maxBytes = m_maxBytes > 0 ? (m_maxBytes + count - 1) / count : 0;
+    queue.setLimits(maxPackets, maxBytes);
+}
+
+// Logs left by shards that no longer exist (the pool used to be bigger)
+// are replayed into the current shards, then removed. A log is removed only
+// once everything in it is durable in the current shards; if a shard refuses
+// a packet, the rest stays in the orphan log for the next load.
+void MqttPublisherPool::adoptOrphanedBacklogs()
+{
+    for (int i = shardCount(); i < MaxShards; ++i) {
+        const QString path = shardPath(i);
+        if (!QDir(path).exists())
+            continue;
+
+        bool complete = true;
+        {
+            MessageQueue orphan;
+            orphan.enablePersistence(path);
+            orphan.loadFromDisk();
+
+            QVector<quint64> adopted;
+            MqttPacket packet;
+            while (orphan.waitAndPop(packet, 0)) {
+                if (!push(packet)) {
+                    complete = false;
+                    break;
+                }
+                adopted.append(packet.seq);
+            }
+
+            for (const Shard& shard : m_shards)
+                shard.queue->saveToDisk();
+
+            // Only now may the orphan log let go of them
+            for (quint64 seq : std::as_const(adopted))
+                orphan.acknowledge(seq);
+            orphan.saveToDisk();
+
+            if (!complete)
+                GW_WARN("Publisher pool: backlogs full, %1 kept for later", path);
+        }
+
+        if (!complete)
+            break;
+        QDir(path).removeRecursively();
+    }
+}
+
+QString MqttPublisherPool::shardPath(int index) const
+{
+    return index == 0 ? m_persistPath : QString("%1-%2").arg(m_persistPath).arg(index);
+}
+
+void MqttPublisherPool::onShardBackpressure(bool active)
+{
+    if (active) {
+        if (m_pressuredShards.fetch_add(1) == 0 && m_backpressureHandler)
+            m_backpressureHandler(true);
+    } else {
+        if (m_pressuredShards.fetch_sub(1) == 1 && m_backpressureHandler)
+            m_backpressureHandler(false);
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef __MQTTPUBLISHERPOOL_H__
+#define __MQTTPUBLISHERPOOL_H__
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVariantList>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "MessageQueue.h"
+#include "MqttWorker.h"
+#include "PipelineMetrics.h"
+
+// Publisher shards: each is a MessageQueue drained by its own MqttWorker
+// over its own broker connection, so producers and workers of different
+// shards never touch the same queue. A packet goes to the shard picked by
+// its routeKey (topic hash when 0); packets of one stream always take the
+// same shard and keep their order.
+class MqttPublisherPool
+{
+public:
+    static constexpr int MaxShards = 16;
+
+    explicit MqttPublisherPool(int shards = 1);
+    ~MqttPublisherPool();
+
+    // Rebuilds the shard queues; call while stopped. With persistence the
+    // backlogs are reloaded and those of removed shards re-routed.
+    void setShardCount(int shards);
+    int shardCount() const { return int(m_shards.size()); }
+    int shardOf(const MqttPacket& packet) const;
+
+    bool push(const MqttPacket& packet);
+
+    // Queue settings, applied to every shard; limits are split evenly
+    void setLimits(int maxPackets, qint64 maxBytes);
+    void setOverflowPolicy(MessageQueue::OverflowPolicy policy, int blockTimeoutMs);
+    void setCoalescing(bool enabled);
+    bool isCoalescing() const { return m_coalescing; }
+    // On while any shard is above its high watermark, off when none is
+    void setBackpressureHandler(MessageQueue::BackpressureHandler handler);
+
+    // Shard 0 logs to path, shard i to path-i
+    void enablePersistence(const QString& path);
+    void loadFromDisk();
+
+    // Subscribed through shard 0's connection; applies from the next start()
+    void setSubscriptions(const QStringList& topicFilters, MqttWorker::MessageHandler handler);
+
+    // One connection per shard; client ids are clientId_0 .. clientId_<n-1>
+    void start(const QString& host, const QString& clientId, int qos,
+               int maxInFlight, int maxRetries, int retryBaseMs, int retryMaxMs,
+               PipelineMetrics* metrics);
+    // Disconnects every shard; the backlogs stay queued (and logged) for
+    // the next start()
+    void stop();
+    // Drops every shard's backlog and acknowledges its log
+    void clear();
+    // Disconnects and drops the workers, keeping the backlogs (and their
+    // logs) for the next start; no callback runs after it returns
+    void close();
+
+    MessageQueueStats queueStats() const;   // summed over shards
+    MqttWorkerStats workerStats() const;    // summed; connected = all shards connected
+    // One map per shard: queue fill, worker counters, msgs/s since the previous call
+    QVariantList shardStats() const;
+
+private:
+    struct Shard
+    {
+        std::unique_ptr<MessageQueue> queue;
+        std::unique_ptr<MqttWorker> worker;
+        mutable quint64 lastPublished = 0;
+    };
+
+    void createShards(int count);
+    void destroyShards();
+    void configure(MessageQueue& queue) const;
+    void adoptOrphanedBacklogs();
+    QString shardPath(int index) const;
+    void onShardBackpressure(bool active);
+
+    std::vector<Shard> m_shards;
+
+    // Settings re-applied whenever the shards are rebuilt
+    int m_maxPackets = 0;                   // 0 = queue default
+    qint64 m_maxBytes = MessageQueue::DefaultMaxBytes;
+    MessageQueue::OverflowPolicy m_policy = MessageQueue::DropNewest;
+    int m_blockTimeoutMs = 1000;
+    bool m_coalescing = false;
+    QString m_persistPath;
+    bool m_loaded = false;
+
+    QStringList m_subscriptions;
+    MqttWorker::MessageHandler m_messageHandler;
+
+    MessageQueue::BackpressureHandler m_backpressureHandler;
+    std::atomic<int> m_pressuredShards { 0 };
+
+    mutable QElapsedTimer m_rateTimer;
+};
+
+#endif // __MQTTPUBLISHERPOOL_H__
@@ -1,7 +1,56 @@
 #include "MqttWorker.h"
-#include <QDebug>
 
-static const int RETRY_LIMIT = 3;
+#include <QDeadlineTimer>
+
+#include <algorithm>
+
+// Longest the worker sleeps without re-checking retries and reconnects
+static const int IDLE_WAIT_MS = 1000;
+
+// Completion callbacks arrive on the paho thread; the dispatch sequence
+// number travels as the token user context.
+class MqttWorker::DeliveryListener : public mqtt::iaction_listener
+{
+public:
+    explicit DeliveryListener(MqttWorker* worker) : m_worker(worker) {}
+
+    void on_success(const mqtt::token& tok) override
+    {
+        m_worker->onDelivery(seqOf(tok), true);
+    }
+
+    void on_failure(const mqtt::token& tok) override
+    {
+        m_worker->onDelivery(seqOf(tok), false);
+    }
+
+private:
+    static quint64 seqOf(const mqtt::token& tok)
+    {
+        return quint64(reinterpret_cast<quintptr>(tok.get_user_context()));
+    }
+
+    MqttWorker* m_worker;
+};
+
+class MqttWorker::ConnectListener : public mqtt::iaction_listener
+{
+public:
+    explicit ConnectListener(MqttWorker* worker) : m_worker(worker) {}
+
+    void on_success(const mqtt::token&) override
+    {
+        m_worker->onConnected();
+    }
+
+    void on_failure(const mqtt::token& tok) override
+    {
+        m_worker->onConnectFailed(QString("return code %1").arg(tok.get_return_code()));
+    }
+
+private:
+    MqttWorker* m_worker;
+};
 
 MqttWorker::MqttWorker(const QString& host,
                        const QString& clientId,
@@ -12,14 +61,11 @@ MqttWorker::MqttWorker(const QString& host,
     m_host(host),
     m_clientId(clientId),
     m_qos(qos),
-    m_queue(queue)
+    m_queue(queue),
+    m_listener(std::make_unique<DeliveryListener>(this)),
+    m_connectListener(std::make_unique<ConnectListener>(this))
 {
-    m_client = new mqtt::async_client(host.toStdString(),
-                                      clientId.toStdString());
-
-    mqtt::connect_options_builder builder;
-    builder.clean_session(true);
-    m_connOpts = builder.finalize();
+    createClient();
 }
 
 MqttWorker::~MqttWorker()
@@ -37,15 +83,85 @@ MqttWorker::~MqttWorker()
         m_client = nullptr; }
 }
 
+void MqttWorker::createClient()
+{
+    m_client = new mqtt::async_client(m_host.toStdString(),
+                                      m_clientId.toStdString());
+    m_client->set_connection_lost_handler([this](const std::string& cause) {
+        onConnectionLost(QString::fromStdString(cause));
+    });
+    // Straight from the paho thread to the handler, no copies
+    m_client->set_message_callback([this](mqtt::const_message_ptr message) {
+        if (!m_messageHandler)
+            return;
+        const std::string& topic = message->get_topic();
+        const mqtt::binary& payload = message->get_payload();
+        m_messageHandler(QByteArrayView(topic.data(), qsizetype(topic.size())),
+                         QByteArrayView(payload.data(), qsizetype(payload.size())));
+    });
+
+    mqtt::connect_options_builder builder;
+    builder.clean_session(true);
+    builder.max_inflight(m_maxInFlight);
+    m_connOpts = builder.finalize();
+
+    QMutexLocker windowLocker(&m_windowMutex);
+    m_link = Disconnected;
+    m_reconnectDueMs = 0;
+    m_reconnectAttempt = 0;
+}
+
+void MqttWorker::setMaxInFlight(int window)
+{
+    m_maxInFlight = qMax(1, window);
+    m_connOpts.set_max_inflight(m_maxInFlight);
+}
+
+void MqttWorker::setSubscriptions(const QStringList& topicFilters, MessageHandler handler)
+{
+    m_subscriptions = topicFilters;
+    m_messageHandler = std::move(handler);
+}
+
+void MqttWorker::setRetryPolicy(int maxRetries, int baseMs, int maxMs)
+{
+    QMutexLocker locker(&m_windowMutex);
+    m_maxRetries = qMax(0, maxRetries);
+    m_retryBaseMs = qMax(1, baseMs);
+    m_retryMaxMs = qMax(m_retryBaseMs, maxMs);
+}
+
+MqttWorkerStats MqttWorker::stats() const
+{
+    QMutexLocker locker(&m_windowMutex);
+    MqttWorkerStats stats = m_stats;
+    stats.connected = (m_link == Connected);
+    stats.inFlight = int(m_inFlight.size());
+    stats.pendingRetries = m_retries.size();
+    return stats;
+}
+
 void MqttWorker::stop()
 {
     QMutexLocker locker(&m_mutex);
 
     m_running.storeRelease(false);
 
-    // Будим очередь, чтобы поток вышел из waitAndPop()
-    if (m_queue)
+    QList<MqttPacket> pending;
+    {
+        QMutexLocker windowLocker(&m_windowMutex);
+        pending = m_retries.takeAll();
+        m_windowCond.wakeAll();
+    }
+
+    if (m_queue) {
+        // returnBack() prepends, so walk latest to earliest
+        for (auto it = pending.crbegin(); it != pending.crend(); ++it)
+            m_queue->returnBack(*it);
+
+        // Будим очередь, чтобы поток вышел из waitAndPop()
         m_queue->stop();
+    }
 }
 
 void MqttWorker::reset()
@@ -56,6 +172,10 @@ void MqttWorker::reset()
     m_running.storeRelease(false);
     if (m_queue)
         m_queue->stop();
+    {
+        QMutexLocker windowLocker(&m_windowMutex);
+        m_windowCond.wakeAll();
+    }
 
     locker.unlock();
 
@@ -74,95 +194,296 @@ void MqttWorker::reset()
         m_client = nullptr;
     }
 
-    // 4. Сбрасываем очередь (очищаем и снимаем stop)
-    if (m_queue)
-        m_queue->reset();
+    // 4. Снимаем stop с очереди, её содержимое остаётся. Пакеты в полёте
+    //    (с clean session их токены уже не завершатся) и ожидающие повтора
+    //    возвращаются в неё в порядке создания
+    QList<MqttPacket> pending;
+    {
+        QMutexLocker windowLocker(&m_windowMutex);
+        pending = m_inFlight.values();
+        pending += m_retries.takeAll();
+        m_inFlight.clear();
+    }
 
-    // 5. Создаём новый MQTT‑клиент и опции
-    m_client = new mqtt::async_client(m_host.toStdString(),
-                                      m_clientId.toStdString());
+    if (m_queue) {
+        m_queue->resume();
 
-    mqtt::connect_options_builder builder;
-    builder.clean_session(true);
-    m_connOpts = builder.finalize();
+        std::sort(pending.begin(), pending.end(),
+                  [](const MqttPacket& a, const MqttPacket& b) { return a.id < b.id; });
+        // returnBack() prepends, so walk latest to earliest
+        for (auto it = pending.crbegin(); it != pending.crend(); ++it)
+            m_queue->returnBack(*it);
+    }
+
+    // 5. Создаём новый MQTT‑клиент и опции
+    createClient();
 
     // 6. Готовы к новому запуску
     m_running.storeRelease(true);
 }
 
+// One loop: connect when a reconnect is due, otherwise publish the earliest
+// due retry or the next queued packet while the window has room. Failed
+// publishes wait in m_retries, so they never hold up fresh traffic.
 void MqttWorker::run()
 {
-    connectToBroker();
-
     while (m_running.loadAcquire())
     {
         MqttPacket packet;
+        bool retry = false;
+        bool connect = false;
+        int waitMs = IDLE_WAIT_MS;
 
-        // waitAndPop теперь возвращает false, если очередь остановлена
-        if (!m_queue->waitAndPop(packet)) {
-            // если нас остановили — выходим
-            if (!m_running.loadAcquire())
-                break;
-            // иначе просто продолжаем цикл (например, после reset())
+        {
+            QMutexLocker locker(&m_windowMutex);
+            const qint64 now = nowMs();
+
+            if (m_link == Disconnected) {
+                if (now >= m_reconnectDueMs) {
+                    m_link = Connecting;
+                    connect = true;
+                } else {
+                    waitMs = int(qMin<qint64>(m_reconnectDueMs - now, IDLE_WAIT_MS));
+                }
+            }
+
+            if (!connect) {
+                // Not connected or window full: wait for a paho callback
+                if (m_link != Connected || m_inFlight.size() >= m_maxInFlight) {
+                    if (m_running.loadAcquire())
+                        m_windowCond.wait(&m_windowMutex, QDeadlineTimer(waitMs));
+                    continue;
+                }
+
+                retry = m_retries.takeDue(now, packet);
+                const qint64 dueMs = retry ? -1 : m_retries.nextDueMs();
+                if (dueMs >= 0)
+                    waitMs = int(qBound<qint64>(1, dueMs - now, IDLE_WAIT_MS));
+            }
+        }
+
+        if (connect) {
+            startConnect();
             continue;
         }
 
-        publishPacket(packet);
+        if (!retry) {
+            // false on timeout, interrupt() or stop: re-check state
+            if (!m_queue->waitAndPop(packet, waitMs))
+                continue;
+            packet.trace.dequeuedNs = PacketTrace::now();
+        }
+
+        publishPacket(packet, !retry);
     }
 }
 
-void MqttWorker::connectToBroker()
+void MqttWorker::startConnect()
+{
+    GW_DEBUG("MQTT: connecting to broker %1...", m_host);
+
+    try {
+        // Completion is reported through m_connectListener
+        m_client->connect(m_connOpts, nullptr, *m_connectListener);
+    }
+    catch (const mqtt::exception& e) {
+        onConnectFailed(QString::fromUtf8(e.what()));
+    }
+}
+
+void MqttWorker::onConnected()
 {
-    while (m_running.loadAcquire())
     {
+        QMutexLocker locker(&m_windowMutex);
+        m_link = Connected;
+        m_reconnectAttempt = 0;
+        m_windowCond.wakeAll();
+    }
+
+    GW_INFO("Connected to MQTT broker");
+
+    // Clean session: the broker forgot them with the old connection
+    if (!m_subscriptions.isEmpty()) {
+        std::vector<std::string> filters;
+        for (const QString& filter : std::as_const(m_subscriptions))
+            filters.push_back(filter.toStdString());
+
         try {
-            qDebug() << "MQTT: connecting to broker...";
-            m_client->connect(m_connOpts)->wait();
-            qDebug() << "MQTT: connected";
-            emit logMessage("Connected to MQTT broker");
-            return;
+            m_client->subscribe(mqtt::string_collection::create(filters),
+                                mqtt::iasync_client::qos_collection(filters.size(), m_qos));
+            GW_INFO("MQTT: subscribed to %1", m_subscriptions.join(", "));
         }
         catch (const mqtt::exception& e) {
-            qDebug() << "MQTT: connection failed:" << e.what();
-            emit logMessage(QString("MQTT connection failed: %1").arg(e.what()));
-            QThread::sleep(2);
+            GW_WARN("MQTT subscribe failed: %1", QString::fromUtf8(e.what()));
         }
     }
 }
 
-void MqttWorker::publishPacket(const MqttPacket& packet)
+void MqttWorker::onConnectFailed(const QString& reason)
+{
+    int delay = 0;
+    {
+        QMutexLocker locker(&m_windowMutex);
+        m_link = Disconnected;
+        delay = RetrySchedule::backoffMs(m_reconnectAttempt++, ReconnectBaseMs, ReconnectMaxMs);
+        m_reconnectDueMs = nowMs() + delay;
+        ++m_stats.connectFailures;
+        m_windowCond.wakeAll();
+    }
+
+    GW_WARN("MQTT connection failed: %1, next attempt in %2 ms", reason, delay);
+}
+
+void MqttWorker::onConnectionLost(const QString& cause)
 {
+    {
+        QMutexLocker locker(&m_windowMutex);
+        m_link = Disconnected;
+        m_reconnectAttempt = 1;
+        m_reconnectDueMs = nowMs() + RetrySchedule::backoffMs(0, ReconnectBaseMs, ReconnectMaxMs);
+
+        // Their tokens may never complete with a clean session: send them
+        // again after the reconnect; a late callback finds nothing to do
+        for (const MqttPacket& packet : std::as_const(m_inFlight)) {
+            m_retries.done(packet);
+            requeue(packet);
+        }
+        m_inFlight.clear();
+
+        m_windowCond.wakeAll();
+    }
+
+    GW_WARN("MQTT connection lost: %1", cause);
+    if (m_queue)
+        m_queue->interrupt();
+}
+
+void MqttWorker::publishPacket(const MqttPacket& packet, bool fresh)
+{
+    quint64 seq = 0;
+    {
+        QMutexLocker locker(&m_windowMutex);
+        // A fresh snapshot makes a waiting retry of the same range pointless
+        MqttPacket dropped;
+        if (fresh && m_retries.supersede(packet, &dropped)) {
+            ++m_stats.superseded;
+            m_queue->acknowledge(dropped.seq);
+        }
+
+        // Must not overtake a retry of its stream: wait behind it
+        if (fresh && packet.routeKey && m_retries.isHolding(packet.routeKey)
+            && m_retries.hold(packet, nowMs())) {
+            ++m_stats.heldBack;
+            return;
+        }
+
+        seq = ++m_nextSeq;
+        m_inFlight.insert(seq, packet);
+    }
+
     try {
+        // Payload bytes go to paho as-is; its message keeps the only copy.
+        // The topic's UTF-8 form is converted once, when it is interned.
         mqtt::message_ptr msg = mqtt::make_message(
-            packet.topic.toStdString(),
-            packet.payload.toStdString(),
+            TopicTable::utf8(packet.topicId),
+            packet.payload.data(),
+            size_t(packet.payload.size()),
             m_qos,
             false
             );
 
-        m_client->publish(msg)->wait();
-        qDebug() << "MQTT: sent" << packet.topic << packet.payload;
-        emit logMessage(QString("MQTT published: %1 = %2")
-                        .arg(packet.topic, packet.payload));
+        // Completion is reported through m_listener, no wait() here
+        m_client->publish(msg,
+                          reinterpret_cast<void*>(quintptr(seq)),
+                          *m_listener);
     }
     catch (const mqtt::exception& e) {
-        qDebug() << "MQTT: publish failed:" << e.what();
+        GW_WARN("MQTT: publish failed: %1", e.what());
+        onDelivery(seq, false);
+    }
+}
 
-        if (packet.retryCount < RETRY_LIMIT)
-        {
-            MqttPacket retry = packet;
-            retry.retryCount++;
-            m_queue->returnBack(retry);
-            emit logMessage(QString("MQTT retry %1 for topic %2")
-                            .arg(packet.retryCount)
-                            .arg(packet.topic));
-        }
-        else {
-            qDebug() << "MQTT: retry limit reached, dropping packet";
-            emit logMessage("MQTT: retry limit reached, dropping packet");
+void MqttWorker::onDelivery(quint64 seq, bool ok)
+{
+    bool scheduled = false;
+    bool released = false;
+    {
+        QMutexLocker locker(&m_windowMutex);
+
+        auto it = m_inFlight.find(seq);
+        if (it == m_inFlight.end())
+            return;
+
+        MqttPacket& packet = it.value();
+        released = m_retries.done(packet);
+        if (!ok && m_link != Connected) {
+            // Failed because the link is gone, not a publish failure
+            requeue(packet);
+            scheduled = true;
+        } else if (ok) {
+            ++m_stats.published;
+            if (m_metrics) {
+                packet.trace.ackedNs = PacketTrace::now();
+                m_metrics->record(packet.topic(), packet.trace);
+            }
+            GW_DEBUG("MQTT published: %1 = %2", packet.topic(), packet.payload.toByteArray());
+            m_queue->acknowledge(packet.seq);
+        } else {
+            scheduled = scheduleRetry(packet);
         }
 
-        connectToBroker();
-        emit logMessage("MQTT reconnected, retrying publish...");
+        m_inFlight.erase(it);
+        m_windowCond.wakeAll();
     }
+
+    // The worker may be parked on the queue with a longer timeout
+    if ((scheduled || released) && m_queue)
+        m_queue->interrupt();
+}
+
+// m_windowMutex held. A packet that is given up on (or superseded) is
+// acknowledged: its log record would only replay it after a restart.
+bool MqttWorker::scheduleRetry(MqttPacket packet)
+{
+    if (packet.retryCount >= m_maxRetries) {
+        ++m_stats.retryDropped;
+        GW_WARN("MQTT: retry limit reached, dropping packet for %1", packet.topic());
+        m_queue->acknowledge(packet.seq);
+        return false;
+    }
+
+    const int delay = RetrySchedule::backoffMs(packet.retryCount, m_retryBaseMs, m_retryMaxMs);
+    packet.retryCount++;
+
+    MqttPacket superseded;
+    const bool scheduled = m_retries.schedule(packet, nowMs() + delay, &superseded);
+    m_queue->acknowledge(superseded.seq);
+
+    if (!scheduled) {
+        ++m_stats.retryDropped;
+        GW_WARN("MQTT: retry schedule full, dropping packet for %1", packet.topic());
+        m_queue->acknowledge(packet.seq);
+        return false;
+    }
+
+    ++m_stats.retried;
+    GW_DEBUG("MQTT retry %1 for topic %2 in %3 ms", packet.retryCount, packet.topic(), delay);
+    return true;
+}
+
+// m_windowMutex held. Sent again once connected, without using up a retry;
+// back to the queue (still unacknowledged) if the schedule is full
+void MqttWorker::requeue(const MqttPacket& packet)
+{
+    MqttPacket superseded;
+    const bool scheduled = m_retries.schedule(packet, nowMs(), &superseded);
+    m_queue->acknowledge(superseded.seq);
+
+    if (!scheduled)
+        m_queue->returnBack(packet);
+}
+
+qint64 MqttWorker::nowMs()
+{
+    return PacketTrace::now() / 1000000;
 }
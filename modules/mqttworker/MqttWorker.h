@@ -6,17 +6,37 @@
 #include <QThread>
 #include <QAtomicInt>
 #include <QMutex>
+#include <QWaitCondition>
+#include <QMap>
+#include <QByteArrayView>
+#include <QStringList>
 
+#include <functional>
+#include <memory>
+
+#include "Logger.h"
 #include "MessageQueue.h"
+#include "PipelineMetrics.h"
+#include "RetrySchedule.h"
 #include <mqtt/async_client.h>
 
+struct MqttWorkerStats
+{
+    bool connected = false;
+    quint64 published = 0;          // acknowledged by the broker
+    int inFlight = 0;
+    int pendingRetries = 0;         // waiting in the retry schedule
+    quint64 retried = 0;            // failed publishes scheduled again
+    quint64 retryDropped = 0;       // retry limit reached or schedule full
+    quint64 superseded = 0;         // retries replaced by a newer snapshot
+    quint64 heldBack = 0;           // fresh packets queued behind a retry of their stream
+    quint64 connectFailures = 0;
+};
+
 class MqttWorker : public QThread
 {
     Q_OBJECT
 
-signals:
-    void logMessage(const QString &msg);
-
 public:
     MqttWorker(const QString& host,
                const QString& clientId,
@@ -26,14 +46,64 @@ public:
 
     ~MqttWorker() override;
 
+    static constexpr int DefaultMaxInFlight = 32;
+    static constexpr int DefaultRetryLimit = 3;
+    static constexpr int DefaultRetryBaseMs = 200;
+    static constexpr int DefaultRetryMaxMs = 30000;
+    static constexpr int ReconnectBaseMs = 500;
+    static constexpr int ReconnectMaxMs = 30000;
+
+    // Max number of unacknowledged publishes; call before start()
+    void setMaxInFlight(int window);
+    int maxInFlight() const { return m_maxInFlight; }
+
+    // A failed publish is retried up to maxRetries times, attempt n after
+    // RetrySchedule::backoffMs(n, baseMs, maxMs); call before start()
+    void setRetryPolicy(int maxRetries, int baseMs, int maxMs);
+
+    // Stage latencies of acknowledged packets are recorded here (optional)
+    void setMetrics(PipelineMetrics* metrics) { m_metrics = metrics; }
+
+    // Inbound messages, called on the paho callback thread: must not block.
+    // The views are only valid during the call.
+    using MessageHandler = std::function<void(QByteArrayView topic, QByteArrayView payload)>;
+    // Subscribed again on every (re)connect; call before start()
+    void setSubscriptions(const QStringList& topicFilters, MessageHandler handler);
+
+    MqttWorkerStats stats() const;
+
+    // Pending retries go back to the queue before it is stopped
     void stop();
+    // After stop(): waits for run(), replaces the client and hands in-flight
+    // packets and retries back to the queue, which keeps its backlog
     void reset();
 protected:
     void run() override;
 
 private:
-    void connectToBroker();
-    void publishPacket(const MqttPacket& packet);
+    class DeliveryListener;
+    class ConnectListener;
+
+    enum LinkState {
+        Disconnected,
+        Connecting,
+        Connected
+    };
+
+    void createClient();
+
+    // Connection, driven by paho callbacks (no blocking waits)
+    void startConnect();
+    void onConnected();
+    void onConnectFailed(const QString& reason);
+    void onConnectionLost(const QString& cause);
+
+    void publishPacket(const MqttPacket& packet, bool fresh);
+    void onDelivery(quint64 seq, bool ok);
+    bool scheduleRetry(MqttPacket packet);
+    void requeue(const MqttPacket& packet);
+
+    static qint64 nowMs();
 
 private:
     QString m_host;
@@ -43,12 +113,36 @@ private:
     mqtt::connect_options m_connOpts;
 
     MessageQueue* m_queue = nullptr;
+    PipelineMetrics* m_metrics = nullptr;
 
     int m_qos = 0;
 
+    QStringList m_subscriptions;
+    MessageHandler m_messageHandler;
+
     QAtomicInt m_running { true };
     QMutex m_mutex;
-    // bool m_resetting = false;
+
+    std::unique_ptr<DeliveryListener> m_listener;
+    std::unique_ptr<ConnectListener> m_connectListener;
+
+    // Publish window, retries and link state (m_windowMutex)
+    int m_maxInFlight = DefaultMaxInFlight;
+    mutable QMutex m_windowMutex;
+    QWaitCondition m_windowCond;
+    QMap<quint64, MqttPacket> m_inFlight;
+    quint64 m_nextSeq = 0;
+
+    RetrySchedule m_retries;
+    int m_maxRetries = DefaultRetryLimit;
+    int m_retryBaseMs = DefaultRetryBaseMs;
+    int m_retryMaxMs = DefaultRetryMaxMs;
+
+    LinkState m_link = Disconnected;
+    qint64 m_reconnectDueMs = 0;
+    int m_reconnectAttempt = 0;
+
+    MqttWorkerStats m_stats;
 };
 
 #endif // __MQTTWORKER_H__
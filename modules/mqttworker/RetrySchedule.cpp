@@ -0,0 +1,184 @@
+#include "RetrySchedule.h"
+
+#include <QRandomGenerator>
+
+#include <vector>
+
+int RetrySchedule::backoffMs(int attempt, int baseMs, int maxMs)
+{
+    const qint64 delay = qMin<qint64>(maxMs, qint64(qMax(1, baseMs)) << qBound(0, attempt, 20));
+    const qint64 half = delay / 2;
+    return int(half + QRandomGenerator::global()->bounded(half + 1));
+}
+
+bool RetrySchedule::schedule(const MqttPacket& packet, qint64 dueMs, MqttPacket* superseded)
+{
+    // A retry for the same snapshot key that is still waiting is older
+    supersede(packet, superseded);
+
+    if (size() >= m_maxPending)
+        return false;
+
+    insert(packet, dueMs);
+    return true;
+}
+
+bool RetrySchedule::takeDue(qint64 nowMs, MqttPacket& packet)
+{
+    if (m_due.empty() || m_due.begin()->first > nowMs)
+        return false;
+
+    const auto it = m_waiting.find(m_due.begin()->second);
+    // Out before it leaves, so the next one of its route stays back
+    if (it->second.packet.routeKey)
+        m_routes[it->second.packet.routeKey].out = it->first;
+
+    packet = extract(it);
+    return true;
+}
+
+qint64 RetrySchedule::nextDueMs() const
+{
+    return m_due.empty() ? -1 : m_due.begin()->first;
+}
+
+bool RetrySchedule::supersede(const MqttPacket& newer, MqttPacket* dropped)
+{
+    if (!newer.coalesceKey)
+        return false;
+
+    const auto keyed = m_keyed.constFind(newer.coalesceKey);
+    if (keyed == m_keyed.constEnd())
+        return false;
+
+    const auto it = m_waiting.find(keyed.value());
+    if (it->second.packet.topicId != newer.topicId)
+        return false;
+
+    MqttPacket packet = extract(it);
+    if (dropped)
+        *dropped = std::move(packet);
+    return true;
+}
+
+QList<MqttPacket> RetrySchedule::takeAll()
+{
+    QList<MqttPacket> packets;
+    packets.reserve(size());
+    for (auto& entry : m_waiting)
+        packets.append(std::move(entry.second.packet));
+
+    m_waiting.clear();
+    m_due.clear();
+    m_keyed.clear();
+    m_routes.clear();
+    return packets;
+}
+
+bool RetrySchedule::isHolding(quint64 routeKey) const
+{
+    return m_routes.contains(routeKey);
+}
+
+bool RetrySchedule::hold(const MqttPacket& packet, qint64 nowMs)
+{
+    if (size() >= m_maxPending)
+        return false;
+
+    // Newest of its route: due as soon as the older ones are through
+    insert(packet, nowMs);
+    return true;
+}
+
+bool RetrySchedule::done(const MqttPacket& packet)
+{
+    if (!packet.routeKey)
+        return false;
+
+    const auto route = m_routes.find(packet.routeKey);
+    if (route == m_routes.end() || route.value().out != packet.id)
+        return false;
+
+    route.value().out = 0;
+    if (route.value().ids.empty()) {
+        m_routes.erase(route);
+        return false;
+    }
+
+    updateRoute(packet.routeKey);
+    return true;
+}
+
+void RetrySchedule::insert(const MqttPacket& packet, qint64 dueMs)
+{
+    Entry& entry = m_waiting[packet.id];
+    entry.dueMs = dueMs;
+    entry.packet = packet;
+    entry.due = m_due.end();
+
+    // A key already taken by another topic (hash collision) stays unindexed
+    if (packet.coalesceKey && !m_keyed.contains(packet.coalesceKey))
+        m_keyed.insert(packet.coalesceKey, packet.id);
+
+    if (!packet.routeKey) {
+        setDue(entry, true);
+        return;
+    }
+
+    m_routes[packet.routeKey].ids.insert(packet.id);
+    updateRoute(packet.routeKey);
+}
+
+MqttPacket RetrySchedule::extract(Waiting::iterator it)
+{
+    Entry& entry = it->second;
+    setDue(entry, false);
+
+    const auto keyed = m_keyed.find(entry.packet.coalesceKey);
+    if (keyed != m_keyed.end() && keyed.value() == it->first)
+        m_keyed.erase(keyed);
+
+    MqttPacket packet = std::move(entry.packet);
+    m_waiting.erase(it);
+
+    const quint64 routeKey = packet.routeKey;
+    if (routeKey) {
+        const auto route = m_routes.find(routeKey);
+        route.value().ids.erase(packet.id);
+        if (route.value().due == packet.id)
+            route.value().due = 0;
+        if (route.value().ids.empty() && !route.value().out)
+            m_routes.erase(route);
+        else
+            updateRoute(routeKey);
+    }
+    return packet;
+}
+
+void RetrySchedule::updateRoute(quint64 routeKey)
+{
+    Route& route = m_routes[routeKey];
+    const quint64 head = route.out || route.ids.empty() ? 0 : *route.ids.begin();
+    if (head == route.due)
+        return;
+
+    // A newer packet steps back when an older one of its route is scheduled
+    if (route.due)
+        setDue(m_waiting.at(route.due), false);
+    if (head)
+        setDue(m_waiting.at(head), true);
+    route.due = head;
+}
+
+void RetrySchedule::setDue(Entry& entry, bool due)
+{
+    if (due == (entry.due != m_due.end()))
+        return;
+
+    if (due) {
+        entry.due = m_due.emplace(entry.dueMs, entry.packet.id);
+    } else {
+        m_due.erase(entry.due);
+        entry.due = m_due.end();
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef __RETRYSCHEDULE_H__
+#define __RETRYSCHEDULE_H__
+
+#include <QHash>
+
+#include <map>
+#include <set>
+
+#include "MessageQueue.h"
+
+// Failed publishes waiting for their next attempt, ordered by due time
+// (monotonic ms). Packets with a coalesce key can be superseded by a newer
+// packet for the same key, so a late retry never overwrites fresher data.
+//
+// Packets with a routeKey keep their order (packet id) within the route:
+// while one of them waits here or is out for publishing, newer packets of
+// the route are held behind it (hold()), and takeDue() hands out one packet
+// of a route at a time, the next one only after done(). A retried
+// report-by-exception delta therefore never lands after a newer one.
+// Only the oldest packet of a route with nothing out is in the due order,
+// so every operation is O(log n) however many packets a route holds back.
+// Not thread-safe; MqttWorker guards it with its window mutex.
+class RetrySchedule
+{
+public:
+    static constexpr int DefaultMaxPending = 1024;
+
+    // Exponential backoff with equal jitter: half of min(max, base * 2^attempt)
+    // plus a random part of up to the other half
+    static int backoffMs(int attempt, int baseMs, int maxMs);
+
+    // Returns false (packet not taken) when maxPending retries are waiting.
+    // A retry it supersedes is moved to *superseded. Newer packets of the
+    // route stay behind it.
+    bool schedule(const MqttPacket& packet, qint64 dueMs, MqttPacket* superseded = nullptr);
+    // Earliest packet with dueMs <= nowMs whose route has nothing out
+    bool takeDue(qint64 nowMs, MqttPacket& packet);
+    // -1 when nothing can be taken (empty, or every route has a packet out)
+    qint64 nextDueMs() const;
+    // Drops the retry waiting for newer's key and topic; true if one was
+    // dropped, which is then moved to *dropped
+    bool supersede(const MqttPacket& newer, MqttPacket* dropped = nullptr);
+    // All waiting packets in id (creation) order
+    QList<MqttPacket> takeAll();
+
+    // True while a packet of the route waits here or is out for publishing
+    bool isHolding(quint64 routeKey) const;
+    // Queues a fresh packet behind the last one of its route; false when
+    // maxPending packets are waiting
+    bool hold(const MqttPacket& packet, qint64 nowMs);
+    // The packet was acknowledged, failed or dropped; if takeDue() handed
+    // it out, the next packet of its route may go. True if one is waiting.
+    bool done(const MqttPacket& packet);
+
+    void setMaxPending(int maxPending) { m_maxPending = qMax(1, maxPending); }
+    int size() const { return int(m_waiting.size()); }
+    bool isEmpty() const { return m_waiting.empty(); }
+
+private:
+    using Due = std::multimap<qint64, quint64>;     // due time -> packet id
+
+    struct Entry
+    {
+        qint64 dueMs = 0;
+        MqttPacket packet;
+        Due::iterator due;                          // m_due.end() while held back
+    };
+
+    struct Route
+    {
+        std::set<quint64> ids;                      // waiting, oldest first
+        quint64 out = 0;                            // id of the packet out, 0 = none
+        quint64 due = 0;                            // id in the due order, 0 = none
+    };
+
+    using Waiting = std::map<quint64, Entry>;       // by packet id
+
+    void insert(const MqttPacket& packet, qint64 dueMs);
+    MqttPacket extract(Waiting::iterator it);
+    // Puts the route's oldest packet into the due order, unless one is out
+    void updateRoute(quint64 routeKey);
+    void setDue(Entry& entry, bool due);
+
+    Waiting m_waiting;
+    Due m_due;                                  // equal due times stay FIFO
+    QHash<quint64, quint64> m_keyed;            // coalesce key -> packet id
+    QHash<quint64, Route> m_routes;             // route key -> waiting and out
+    int m_maxPending = DefaultMaxPending;
+};
+
+#endif // __RETRYSCHEDULE_H__
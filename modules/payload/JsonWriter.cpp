@@ -0,0 +1,174 @@
+#include "JsonWriter.h"
+
+#include <charconv>
+#include <cmath>
+
+JsonWriter::JsonWriter(int reserve)
+{
+    m_buf.reserve(reserve);
+}
+
+void JsonWriter::reset()
+{
+    m_buf.resize(0);    // never shrinks capacity
+    m_needComma = 0;
+    m_depth = 0;
+    m_afterKey = false;
+}
+
+void JsonWriter::separator()
+{
+    if (m_afterKey) {
+        m_afterKey = false;
+        return;
+    }
+
+    const quint64 bit = quint64(1) << (m_depth & 63);
+    if (m_needComma & bit)
+        m_buf.append(',');
+    m_needComma |= bit;
+}
+
+JsonWriter &JsonWriter::beginObject()
+{
+    separator();
+    m_buf.append('{');
+    ++m_depth;
+    m_needComma &= ~(quint64(1) << (m_depth & 63));
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject()
+{
+    --m_depth;
+    m_buf.append('}');
+    return *this;
+}
+
+JsonWriter &JsonWriter::beginArray()
+{
+    separator();
+    m_buf.append('[');
+    ++m_depth;
+    m_needComma &= ~(quint64(1) << (m_depth & 63));
+    return *this;
+}
+
+JsonWriter &JsonWriter::endArray()
+{
+    --m_depth;
+    m_buf.append(']');
+    return *this;
+}
+
+JsonWriter &JsonWriter::key(QByteArrayView name)
+{
+    separator();
+    appendEscaped(name);
+    m_buf.append(':');
+    m_afterKey = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(int v)
+{
+    separator();
+    appendInt(v);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(qint64 v)
+{
+    separator();
+    appendInt(v);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(bool v)
+{
+    separator();
+    if (v)
+        m_buf.append("true", 4);
+    else
+        m_buf.append("false", 5);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(double v)
+{
+    separator();
+    if (!std::isfinite(v)) {
+        m_buf.append("null", 4);
+        return *this;
+    }
+
+    // Shortest round-trip form, always with '.': not locale-dependent
+    char tmp[32];
+    const auto res = std::to_chars(tmp, tmp + sizeof(tmp), v);
+    m_buf.append(tmp, res.ptr - tmp);
+    return *this;
+}
+
+JsonWriter &JsonWriter::raw(QByteArrayView json)
+{
+    separator();
+    m_buf.append(json.data(), json.size());
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(QByteArrayView utf8)
+{
+    separator();
+    appendEscaped(utf8);
+    return *this;
+}
+
+void JsonWriter::appendInt(qint64 v)
+{
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *p = end;
+
+    quint64 u = v < 0 ? quint64(0) - quint64(v) : quint64(v);
+    do {
+        *--p = char('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    if (v < 0)
+        *--p = '-';
+
+    m_buf.append(p, end - p);
+}
+
+void JsonWriter::appendEscaped(QByteArrayView s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    m_buf.append('"');
+    qsizetype run = 0;  // start of the pending unescaped run
+
+    for (qsizetype i = 0; i < s.size(); ++i) {
+        const uchar c = uchar(s[i]);
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        m_buf.append(s.data() + run, i - run);
+        run = i + 1;
+
+        switch (c) {
+        case '"':  m_buf.append("\\\"", 2); break;
+        case '\\': m_buf.append("\\\\", 2); break;
+        case '\n': m_buf.append("\\n", 2); break;
+        case '\r': m_buf.append("\\r", 2); break;
+        case '\t': m_buf.append("\\t", 2); break;
+        default: {
+            const char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            m_buf.append(esc, 6);
+        }
+        }
+    }
+
+    m_buf.append(s.data() + run, s.size() - run);
+    m_buf.append('"');
+}
@@ -0,0 +1,48 @@
+#ifndef __JSONWRITER_H__
+#define __JSONWRITER_H__
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+// Minimal streaming JSON writer for MQTT payloads.
+// Formats straight into a reused buffer (no QJson* DOM, no UTF-16 detour);
+// take() returns the result as one exact-size QByteArray, which is the only
+// allocation per message once the buffer has warmed up.
+class JsonWriter
+{
+public:
+    explicit JsonWriter(int reserve = 1024);
+
+    void reset();   // start a new document, keeps capacity
+
+    JsonWriter &beginObject();
+    JsonWriter &endObject();
+    JsonWriter &beginArray();
+    JsonWriter &endArray();
+
+    JsonWriter &key(QByteArrayView name);
+
+    JsonWriter &value(int v);
+    JsonWriter &value(qint64 v);
+    JsonWriter &value(bool v);
+    JsonWriter &value(double v);
+    JsonWriter &value(QByteArrayView utf8);     // string, escaped
+    JsonWriter &value(const char *utf8) { return value(QByteArrayView(utf8)); }
+    // Already encoded JSON value, copied as is
+    JsonWriter &raw(QByteArrayView json);
+
+    QByteArrayView view() const { return m_buf; }
+    QByteArray take() const { return QByteArray(m_buf.constData(), m_buf.size()); }
+
+private:
+    void separator();
+    void appendInt(qint64 v);
+    void appendEscaped(QByteArrayView s);
+
+    QByteArray m_buf;
+    quint64 m_needComma = 0;    // one bit per nesting level
+    int m_depth = 0;
+    bool m_afterKey = false;
+};
+
+#endif // __JSONWRITER_H__
@@ -0,0 +1,155 @@
+#include "ReportFilter.h"
+
+ReportFilter::ReportFilter()
+{
+    m_clock.start();
+}
+
+void ReportFilter::setDefaultDeadband(DeadbandMode mode, double value)
+{
+    m_default.mode = mode;
+    m_default.value = qMax(0.0, value);
+}
+
+void ReportFilter::setDeadband(int deviceId, int address, DeadbandMode mode, double value)
+{
+    Deadband db;
+    db.mode = mode;
+    db.value = qMax(0.0, value);
+    m_deadbands.insert(deadbandKey(deviceId, address), db);
+}
+
+void ReportFilter::clearDeadbands()
+{
+    m_deadbands.clear();
+    m_default = Deadband();
+}
+
+void ReportFilter::reset()
+{
+    m_caches.clear();
+    m_lastSnapshot.clear();
+}
+
+void ReportFilter::forgetRegisters(int deviceId, int start, int count)
+{
+    forget(deviceId, false, start, count);
+}
+
+void ReportFilter::forgetCoils(int deviceId, int start, int count)
+{
+    forget(deviceId, true, start, count);
+}
+
+void ReportFilter::forget(int deviceId, bool coils, int start, int count)
+{
+    auto it = m_caches.find(cacheKey(deviceId, coils));
+    if (it == m_caches.end() || start < 0)
+        return;
+
+    QVector<bool> &valid = it.value().valid;
+    const int end = qMin(start + count, int(valid.size()));
+    for (int address = start; address < end; ++address)
+        valid[address] = false;
+}
+
+quint64 ReportFilter::cacheKey(int deviceId, bool coils)
+{
+    return (quint64(quint32(deviceId)) << 1) | (coils ? 1 : 0);
+}
+
+quint64 ReportFilter::deadbandKey(int deviceId, int address)
+{
+    return (quint64(quint32(deviceId)) << 32) | quint32(address);
+}
+
+bool ReportFilter::heartbeatDue(int deviceId, bool coils, int start, int count)
+{
+    if (m_heartbeatMs <= 0)
+        return false;
+
+    const quint64 key = (cacheKey(deviceId, coils) << 32)
+                        ^ (quint64(quint16(start)) << 16) ^ quint16(count);
+    const qint64 now = m_clock.elapsed();
+
+    auto it = m_lastSnapshot.find(key);
+    if (it != m_lastSnapshot.end() && now - it.value() < m_heartbeatMs)
+        return false;
+
+    m_lastSnapshot.insert(key, now);
+    return true;
+}
+
+bool ReportFilter::exceeds(int deviceId, int address, quint16 last, quint16 value) const
+{
+    if (value == last)
+        return false;
+
+    const Deadband db = m_deadbands.isEmpty()
+                            ? m_default
+                            : m_deadbands.value(deadbandKey(deviceId, address), m_default);
+
+    const double diff = qAbs(double(value) - double(last));
+    if (db.mode == Percent)
+        return diff > double(last) * db.value / 100.0;
+    return diff > db.value;
+}
+
+template <typename T>
+bool ReportFilter::filter(int deviceId, bool coils, int start, const QVector<T> &values,
+                          QVector<int> &changed)
+{
+    changed.clear();
+
+    const int count = int(values.size());
+    if (count == 0 || start < 0)
+        return false;
+
+    Cache &cache = m_caches[cacheKey(deviceId, coils)];
+    if (cache.values.size() < start + count) {
+        cache.values.resize(start + count);
+        cache.valid.resize(start + count);
+    }
+
+    // First sighting of any address in the block, or heartbeat: full snapshot
+    bool full = heartbeatDue(deviceId, coils, start, count);
+    for (int i = 0; i < count && !full; ++i)
+        full = !cache.valid[start + i];
+
+    for (int i = 0; i < count; ++i) {
+        const int address = start + i;
+        const quint16 value = quint16(values[i]);
+
+        if (full) {
+            cache.values[address] = value;
+            cache.valid[address] = true;
+            continue;
+        }
+
+        const quint16 last = cache.values[address];
+        const bool report = coils ? value != last
+                                  : exceeds(deviceId, address, last, value);
+        if (report) {
+            // Deadband is measured against the last *published* value
+            cache.values[address] = value;
+            changed.append(i);
+        }
+    }
+
+    const int published = full ? count : int(changed.size());
+    m_published += quint64(published);
+    m_suppressed += quint64(count - published);
+    return full;
+}
+
+bool ReportFilter::filterRegisters(int deviceId, int start, const QVector<quint16> &values,
+                                   QVector<int> &changed)
+{
+    return filter(deviceId, false, start, values, changed);
+}
+
+bool ReportFilter::filterCoils(int deviceId, int start, const QVector<bool> &values,
+                               QVector<int> &changed)
+{
+    return filter(deviceId, true, start, values, changed);
+}
@@ -0,0 +1,91 @@
+#ifndef __REPORTFILTER_H__
+#define __REPORTFILTER_H__
+
+#include <QHash>
+#include <QVector>
+#include <QElapsedTimer>
+
+// Report-by-exception: keeps the last published value per device and address
+// and lets through only values that moved past their deadband. An optional
+// heartbeat forces a full snapshot of a block every N ms.
+// Not thread-safe; owned and called by a single thread.
+class ReportFilter
+{
+public:
+    enum DeadbandMode {
+        Absolute,   // |new - last| > value
+        Percent     // |new - last| > value % of |last|
+    };
+
+    ReportFilter();
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+
+    // 0 = any change is reported
+    void setDefaultDeadband(DeadbandMode mode, double value);
+    void setDeadband(int deviceId, int address, DeadbandMode mode, double value);
+    void clearDeadbands();
+
+    // 0 disables the periodic full snapshot
+    void setHeartbeatInterval(int ms) { m_heartbeatMs = qMax(0, ms); }
+    int heartbeatInterval() const { return m_heartbeatMs; }
+
+    // Fills 'changed' with offsets (from start) to publish. Returns true when
+    // the whole block is to be published (first read or heartbeat due).
+    bool filterRegisters(int deviceId, int start, const QVector<quint16> &values,
+                         QVector<int> &changed);
+    bool filterCoils(int deviceId, int start, const QVector<bool> &values,
+                     QVector<int> &changed);
+
+    // Values that never reached the backlog: the next read of the range
+    // is published in full
+    void forgetRegisters(int deviceId, int start, int count);
+    void forgetCoils(int deviceId, int start, int count);
+
+    void reset();   // forget cached values
+
+    quint64 publishedCount() const { return m_published; }
+    quint64 suppressedCount() const { return m_suppressed; }
+
+private:
+    struct Deadband
+    {
+        DeadbandMode mode = Absolute;
+        double value = 0.0;
+    };
+
+    // Dense last-value table for one device and register type
+    struct Cache
+    {
+        QVector<quint16> values;
+        QVector<bool> valid;
+    };
+
+    static quint64 cacheKey(int deviceId, bool coils);
+    static quint64 deadbandKey(int deviceId, int address);
+
+    bool heartbeatDue(int deviceId, bool coils, int start, int count);
+    bool exceeds(int deviceId, int address, quint16 last, quint16 value) const;
+
+    void forget(int deviceId, bool coils, int start, int count);
+
+    template <typename T>
+    bool filter(int deviceId, bool coils, int start, const QVector<T> &values,
+                QVector<int> &changed);
+
+    bool m_enabled = false;
+    int m_heartbeatMs = 0;
+
+    Deadband m_default;
+    QHash<quint64, Deadband> m_deadbands;
+    QHash<quint64, Cache> m_caches;
+    QHash<quint64, qint64> m_lastSnapshot;   // block -> ms on m_clock
+
+    QElapsedTimer m_clock;
+
+    quint64 m_published = 0;
+    quint64 m_suppressed = 0;
+};
+
+#endif // __REPORTFILTER_H__
@@ -0,0 +1,236 @@
+#include "TagDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+using Type = TagDefinition::Type;
+using Order = TagDefinition::Order;
+
+inline quint16 swapBytes(quint16 w)
+{
+    return quint16((w << 8) | (w >> 8));
+}
+
+// i-th most significant word of an n-word value
+template <Order O>
+inline quint16 wordAt(const quint16 *w, int i, int n)
+{
+    const quint16 v = (O == TagDefinition::CDAB || O == TagDefinition::DCBA) ? w[n - 1 - i] : w[i];
+    return (O == TagDefinition::BADC || O == TagDefinition::DCBA) ? swapBytes(v) : v;
+}
+
+template <Type T, Order O>
+void decodeGroup(const quint16 *words, const int *offsets,
+                 const double *scale, const double *bias,
+                 double *out, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const quint16 *w = words + offsets[i];
+        double raw;
+
+        if constexpr (T == TagDefinition::UInt16) {
+            raw = wordAt<O>(w, 0, 1);
+        } else if constexpr (T == TagDefinition::Int16) {
+            raw = qint16(wordAt<O>(w, 0, 1));
+        } else if constexpr (T == TagDefinition::Float64) {
+            const quint64 bits = (quint64(wordAt<O>(w, 0, 4)) << 48)
+                                 | (quint64(wordAt<O>(w, 1, 4)) << 32)
+                                 | (quint64(wordAt<O>(w, 2, 4)) << 16)
+                                 | quint64(wordAt<O>(w, 3, 4));
+            std::memcpy(&raw, &bits, sizeof(raw));
+        } else {
+            const quint32 bits = (quint32(wordAt<O>(w, 0, 2)) << 16) | wordAt<O>(w, 1, 2);
+            if constexpr (T == TagDefinition::UInt32) {
+                raw = bits;
+            } else if constexpr (T == TagDefinition::Int32) {
+                raw = qint32(bits);
+            } else {
+                float f;
+                std::memcpy(&f, &bits, sizeof(f));
+                raw = f;
+            }
+        }
+
+        out[i] = raw * scale[i] + bias[i];
+    }
+}
+
+template <Type T>
+auto decoderFor(Order order)
+{
+    switch (order) {
+    case TagDefinition::CDAB: return &decodeGroup<T, TagDefinition::CDAB>;
+    case TagDefinition::BADC: return &decodeGroup<T, TagDefinition::BADC>;
+    case TagDefinition::DCBA: return &decodeGroup<T, TagDefinition::DCBA>;
+    case TagDefinition::ABCD: break;
+    }
+    return &decodeGroup<T, TagDefinition::ABCD>;
+}
+
+auto decoderFor(Type type, Order order)
+{
+    switch (type) {
+    case TagDefinition::Int16: return decoderFor<TagDefinition::Int16>(order);
+    case TagDefinition::UInt32: return decoderFor<TagDefinition::UInt32>(order);
+    case TagDefinition::Int32: return decoderFor<TagDefinition::Int32>(order);
+    case TagDefinition::Float32: return decoderFor<TagDefinition::Float32>(order);
+    case TagDefinition::Float64: return decoderFor<TagDefinition::Float64>(order);
+    case TagDefinition::UInt16: break;
+    }
+    return decoderFor<TagDefinition::UInt16>(order);
+}
+
+// Single-register values only know about byte swapping
+Order effectiveOrder(const TagDefinition &tag)
+{
+    if (tag.registers() > 1)
+        return tag.order;
+    return (tag.order == TagDefinition::BADC || tag.order == TagDefinition::DCBA)
+               ? TagDefinition::BADC : TagDefinition::ABCD;
+}
+
+} // namespace
+
+// TagDefinition
+
+int TagDefinition::registers() const
+{
+    switch (type) {
+    case UInt16:
+    case Int16:
+        return 1;
+    case Float64:
+        return 4;
+    default:
+        return 2;
+    }
+}
+
+bool TagDefinition::typeFromString(const QString &name, Type *type)
+{
+    static const char *const names[] = { "uint16", "int16", "uint32", "int32", "float32", "float64" };
+    for (int i = 0; i < 6; ++i) {
+        if (name.compare(QLatin1String(names[i]), Qt::CaseInsensitive) == 0) {
+            *type = Type(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TagDefinition::orderFromString(const QString &name, Order *order)
+{
+    static const char *const names[] = { "ABCD", "CDAB", "BADC", "DCBA" };
+    for (int i = 0; i < 4; ++i) {
+        if (name.compare(QLatin1String(names[i]), Qt::CaseInsensitive) == 0) {
+            *order = Order(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// TagDecodePlan
+
+TagDecodePlan TagDecodePlan::compile(const QVector<TagDefinition> &tags, int start, int count)
+{
+    QVector<int> inside;
+    for (int i = 0; i < tags.size(); ++i) {
+        const TagDefinition &tag = tags[i];
+        if (tag.address >= start && tag.address + tag.registers() <= start + count)
+            inside.append(i);
+    }
+
+    // By decoder, then by address: each group reads the block front to back
+    std::sort(inside.begin(), inside.end(), [&tags](int a, int b) {
+        const TagDefinition &ta = tags[a];
+        const TagDefinition &tb = tags[b];
+        const Order oa = effectiveOrder(ta);
+        const Order ob = effectiveOrder(tb);
+        if (ta.type != tb.type)
+            return ta.type < tb.type;
+        if (oa != ob)
+            return oa < ob;
+        return ta.address < tb.address;
+    });
+
+    TagDecodePlan plan;
+    plan.m_offsets.reserve(inside.size());
+    plan.m_scale.reserve(inside.size());
+    plan.m_bias.reserve(inside.size());
+    plan.m_names.reserve(inside.size());
+
+    for (int i : inside) {
+        const TagDefinition &tag = tags[i];
+        const DecodeFn decode = decoderFor(tag.type, effectiveOrder(tag));
+
+        if (plan.m_groups.isEmpty() || plan.m_groups.last().decode != decode)
+            plan.m_groups.append({ decode, int(plan.m_names.size()), 0 });
+        ++plan.m_groups.last().count;
+
+        plan.m_offsets.append(tag.address - start);
+        plan.m_scale.append(tag.scale);
+        plan.m_bias.append(tag.offset);
+        plan.m_names.append(tag.name);
+    }
+    return plan;
+}
+
+void TagDecodePlan::decode(const quint16 *words, double *out) const
+{
+    for (const Group &group : m_groups)
+        group.decode(words, m_offsets.constData() + group.first,
+                     m_scale.constData() + group.first, m_bias.constData() + group.first,
+                     out + group.first, group.count);
+}
+
+// TagMap
+
+void TagMap::addTag(int deviceId, const TagDefinition &tag)
+{
+    QVector<TagDefinition> &tags = m_tags[deviceId];
+    auto it = std::find_if(tags.begin(), tags.end(), [&tag](const TagDefinition &t) {
+        return t.name == tag.name;
+    });
+    if (it != tags.end())
+        *it = tag;
+    else
+        tags.append(tag);
+
+    m_plans.clear();
+}
+
+void TagMap::removeDevice(int deviceId)
+{
+    if (m_tags.remove(deviceId))
+        m_plans.clear();
+}
+
+void TagMap::clear()
+{
+    m_tags.clear();
+    m_plans.clear();
+}
+
+int TagMap::tagCount() const
+{
+    return std::accumulate(m_tags.cbegin(), m_tags.cend(), 0,
+                           [](int sum, const QVector<TagDefinition> &tags) { return sum + tags.size(); });
+}
+
+const TagDecodePlan &TagMap::plan(int deviceId, int start, int count)
+{
+    const quint64 key = planKey(deviceId, start, count);
+    auto it = m_plans.find(key);
+    if (it == m_plans.end())
+        it = m_plans.insert(key, TagDecodePlan::compile(m_tags.value(deviceId), start, count));
+    return it.value();
+}
+
+quint64 TagMap::planKey(int deviceId, int start, int count)
+{
+    return (quint64(quint32(deviceId)) << 32) | (quint64(quint16(start)) << 16) | quint16(count);
+}
@@ -0,0 +1,93 @@
+#ifndef __TAGDECODER_H__
+#define __TAGDECODER_H__
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// A typed value spread over 1..4 holding registers
+struct TagDefinition
+{
+    enum Type { UInt16, Int16, UInt32, Int32, Float32, Float64 };
+
+    // Where bytes A (most significant) .. D land, in Modbus notation:
+    // ABCD big endian, CDAB word swap, BADC byte swap, DCBA little endian.
+    // 64-bit values apply the same pattern to their four words.
+    enum Order { ABCD, CDAB, BADC, DCBA };
+
+    QByteArray name;
+    int address = 0;
+    Type type = UInt16;
+    Order order = ABCD;
+    double scale = 1.0;     // value = raw * scale + offset
+    double offset = 0.0;
+
+    int registers() const;
+
+    // "uint16", "int16", "uint32", "int32", "float32", "float64"
+    static bool typeFromString(const QString &name, Type *type);
+    // "ABCD", "CDAB", "BADC", "DCBA"
+    static bool orderFromString(const QString &name, Order *order);
+};
+
+// Tag definitions compiled for one register block. Tags are grouped by
+// type and order, so decode() runs one branch-free loop per group and
+// writes the values in plan order to a caller-owned array.
+class TagDecodePlan
+{
+public:
+    static TagDecodePlan compile(const QVector<TagDefinition> &tags, int start, int count);
+
+    bool isEmpty() const { return m_names.isEmpty(); }
+    int size() const { return m_names.size(); }
+    // Tag names in output order
+    const QVector<QByteArray> &names() const { return m_names; }
+
+    // words: the block the plan was compiled for; out: room for size() values
+    void decode(const quint16 *words, double *out) const;
+
+private:
+    using DecodeFn = void (*)(const quint16 *words, const int *offsets,
+                              const double *scale, const double *bias,
+                              double *out, int count);
+
+    struct Group
+    {
+        DecodeFn decode;
+        int first;          // into m_offsets, m_scale, m_bias and the output
+        int count;
+    };
+
+    QVector<Group> m_groups;
+    QVector<int> m_offsets;     // first register, relative to the block start
+    QVector<double> m_scale;
+    QVector<double> m_bias;
+    QVector<QByteArray> m_names;
+};
+
+// Tag definitions per device, with decode plans compiled on first use per
+// polled block. Not thread-safe; owned and called by a single thread.
+class TagMap
+{
+public:
+    // Replaces a tag of the same name on that device
+    void addTag(int deviceId, const TagDefinition &tag);
+    void removeDevice(int deviceId);
+    void clear();
+
+    bool isEmpty() const { return m_tags.isEmpty(); }
+    int tagCount() const;
+
+    // Tags lying entirely inside [start, start + count) of the device.
+    // Valid until the next call.
+    const TagDecodePlan &plan(int deviceId, int start, int count);
+
+private:
+    static quint64 planKey(int deviceId, int start, int count);
+
+    QHash<int, QVector<TagDefinition>> m_tags;
+    QHash<quint64, TagDecodePlan> m_plans;     // dropped on every change
+};
+
+#endif // __TAGDECODER_H__
@@ -0,0 +1,174 @@
+#include "ValueTableModel.h"
+
+#include <algorithm>
+#include <climits>
+
+ValueTableModel::ValueTableModel(Kind kind, QObject *parent)
+    : QAbstractListModel(parent),
+    m_kind(kind)
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FlushIntervalMs);
+    connect(&m_flushTimer, &QTimer::timeout, this, &ValueTableModel::flush);
+}
+
+void ValueTableModel::update(int deviceId, int start, const QVector<quint16> &values)
+{
+    if (values.isEmpty())
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    m_pending.insert(blockKey(deviceId, start), values);    // shared, an older read of the block is dropped
+    schedule();
+}
+
+void ValueTableModel::update(int deviceId, int start, const QVector<bool> &values)
+{
+    if (values.isEmpty())
+        return;
+
+    QVector<quint16> words(values.size());
+    for (int i = 0; i < values.size(); ++i)
+        words[i] = values[i] ? 1 : 0;
+
+    QMutexLocker locker(&m_mutex);
+    m_pending.insert(blockKey(deviceId, start), std::move(words));
+    schedule();
+}
+
+void ValueTableModel::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending.clear();
+    m_clearPending = true;
+    schedule();
+}
+
+// m_mutex held
+void ValueTableModel::schedule()
+{
+    if (m_flushScheduled)
+        return;
+
+    m_flushScheduled = true;
+    QMetaObject::invokeMethod(this, [this]() { m_flushTimer.start(); },
+                              Qt::QueuedConnection);
+}
+
+// GUI thread, at most once per FlushIntervalMs
+void ValueTableModel::flush()
+{
+    QHash<quint64, QVector<quint16>> pending;
+    bool clearRows = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        pending.swap(m_pending);
+        clearRows = m_clearPending;
+        m_clearPending = false;
+        m_flushScheduled = false;
+    }
+
+    const int sizeBefore = int(m_rows.size());
+
+    if (clearRows && !m_rows.isEmpty()) {
+        beginResetModel();
+        m_rows.clear();
+        endResetModel();
+    }
+
+    for (auto it = pending.cbegin(); it != pending.cend(); ++it)
+        apply(int(it.key() >> 32), int(quint32(it.key())), it.value());
+
+    if (m_rows.size() != sizeBefore || clearRows)
+        emit countChanged();
+}
+
+// Walks the block alongside the sorted rows: runs of missing addresses are
+// inserted, runs of changed values get one dataChanged each.
+void ValueTableModel::apply(int deviceId, int start, const QVector<quint16> &values)
+{
+    const QVector<int> roles { ValueRole };
+
+    int row = int(std::lower_bound(m_rows.cbegin(), m_rows.cend(), start,
+                                   [deviceId](const Row &r, int address) {
+                                       return r.deviceId != deviceId ? r.deviceId < deviceId
+                                                                     : r.address < address;
+                                   })
+                  - m_rows.cbegin());
+    int changedFirst = -1;
+
+    auto flushChanged = [&](int end) {
+        if (changedFirst >= 0)
+            emit dataChanged(index(changedFirst), index(end - 1), roles);
+        changedFirst = -1;
+    };
+
+    int i = 0;
+    while (i < values.size()) {
+        const int address = start + i;
+
+        if (row < m_rows.size() && m_rows[row].deviceId == deviceId
+            && m_rows[row].address == address) {
+            if (m_rows[row].value != values[i]) {
+                m_rows[row].value = values[i];
+                if (changedFirst < 0)
+                    changedFirst = row;
+            } else {
+                flushChanged(row);
+            }
+            ++row;
+            ++i;
+            continue;
+        }
+
+        // Addresses [address, next existing address) are new
+        flushChanged(row);
+        const int nextAddress = row < m_rows.size() && m_rows[row].deviceId == deviceId
+                                ? m_rows[row].address : INT_MAX;
+        const int n = int(qMin<qint64>(values.size() - i, qint64(nextAddress) - address));
+
+        beginInsertRows(QModelIndex(), row, row + n - 1);
+        m_rows.insert(row, n, Row());
+        for (int k = 0; k < n; ++k)
+            m_rows[row + k] = Row { deviceId, address + k, values[i + k] };
+        endInsertRows();
+
+        row += n;
+        i += n;
+    }
+
+    flushChanged(row);
+}
+
+int ValueTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_rows.size());
+}
+
+QVariant ValueTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.size())
+        return QVariant();
+
+    const Row &row = m_rows[index.row()];
+    switch (role) {
+    case AddressRole:
+        return row.address;
+    case DeviceRole:
+        return row.deviceId;
+    case Qt::DisplayRole:
+    case ValueRole:
+        return m_kind == Coils ? QVariant(row.value != 0) : QVariant(int(row.value));
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> ValueTableModel::roleNames() const
+{
+    return {
+        { AddressRole, "address" },
+        { ValueRole, "value" },
+        { DeviceRole, "device" },
+    };
+}
@@ -0,0 +1,78 @@
+#ifndef __VALUETABLEMODEL_H__
+#define __VALUETABLEMODEL_H__
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QMutex>
+#include <QTimer>
+#include <QVector>
+
+// Live register or coil table: one row per device and address, sorted by
+// device, then address.
+// update() may be called from any thread; reads are coalesced per block
+// and applied at most once per frame. Only rows whose value changed get
+// dataChanged, new addresses are inserted in place, nothing is reset.
+class ValueTableModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+
+public:
+    enum Kind {
+        Registers,  // value role is an int
+        Coils       // value role is a bool
+    };
+
+    enum Roles {
+        AddressRole = Qt::UserRole + 1,
+        ValueRole,
+        DeviceRole      // device id (ModbusController registry)
+    };
+
+    static constexpr int FlushIntervalMs = 16;
+
+    explicit ValueTableModel(Kind kind, QObject *parent = nullptr);
+
+    void update(int deviceId, int start, const QVector<quint16> &values);
+    void update(int deviceId, int start, const QVector<bool> &values);
+    Q_INVOKABLE void clear();
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+signals:
+    void countChanged();
+
+private:
+    struct Row
+    {
+        int deviceId = 0;
+        int address = 0;
+        quint16 value = 0;
+    };
+
+    // Device in the high half, start address in the low half
+    static quint64 blockKey(int deviceId, int start)
+    {
+        return (quint64(quint32(deviceId)) << 32) | quint32(start);
+    }
+
+    void schedule();
+    void flush();
+    void apply(int deviceId, int start, const QVector<quint16> &values);
+
+    const Kind m_kind;
+    QVector<Row> m_rows;                    // GUI thread
+
+    // Newest read per device and start address since the last flush (any thread)
+    QMutex m_mutex;
+    QHash<quint64, QVector<quint16>> m_pending;
+    bool m_clearPending = false;
+    bool m_flushScheduled = false;
+
+    QTimer m_flushTimer;
+};
+
+#endif // __VALUETABLEMODEL_H__